@@ -0,0 +1,462 @@
+/*
+ * Asynchronous access log (see access_log.h).
+ */
+
+#include "access_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include "stats.h"
+#include "dbg.h"
+
+enum {
+    ZV_AL_LITERAL = 0,
+    ZV_AL_REMOTE_ADDR,
+    ZV_AL_TIME_LOCAL,
+    ZV_AL_TIME_ISO8601,
+    ZV_AL_MSEC,
+    ZV_AL_REQUEST,
+    ZV_AL_REQUEST_METHOD,
+    ZV_AL_REQUEST_URI,
+    ZV_AL_SERVER_PROTOCOL,
+    ZV_AL_STATUS,
+    ZV_AL_BODY_BYTES_SENT,
+    ZV_AL_REQUEST_TIME,
+    ZV_AL_PID,
+    ZV_AL_WORKER
+};
+
+static const struct {
+    const char *name;
+    int op;
+} g_vars[] = {
+    {"remote_addr", ZV_AL_REMOTE_ADDR},
+    {"time_local", ZV_AL_TIME_LOCAL},
+    {"time_iso8601", ZV_AL_TIME_ISO8601},
+    {"msec", ZV_AL_MSEC},
+    {"request", ZV_AL_REQUEST},
+    {"request_method", ZV_AL_REQUEST_METHOD},
+    {"request_uri", ZV_AL_REQUEST_URI},
+    {"server_protocol", ZV_AL_SERVER_PROTOCOL},
+    {"status", ZV_AL_STATUS},
+    {"body_bytes_sent", ZV_AL_BODY_BYTES_SENT},
+    {"request_time", ZV_AL_REQUEST_TIME},
+    {"pid", ZV_AL_PID},
+    {"worker", ZV_AL_WORKER},
+};
+
+typedef struct {
+    int op;
+    const char *text;   /* ZV_AL_LITERAL: points into the format string */
+    size_t len;
+} zv_al_item_t;
+
+/*
+ * 单生产者单消费者环：reactor 只推进 head，写线程只推进 tail，
+ * 两个下标各占一个缓存行；条目是整行文本，可能跨过环尾分成两段
+ */
+typedef struct {
+    struct {
+        size_t head;
+    } __attribute__((aligned(64))) p;
+    struct {
+        size_t tail;
+    } __attribute__((aligned(64))) c;
+    char *data;
+    size_t mask;
+} zv_al_ring_t;
+
+static int g_fd = -1;
+static int g_wake_fd = -1;      // 环过半时叫醒写线程
+static zv_al_item_t *g_items;
+static int g_nitems;
+static zv_al_ring_t *g_rings;
+static int g_nrings;
+static int g_worker_id;
+static pthread_t g_writer;
+static int g_writer_started;
+static volatile int g_writer_stop;
+
+static __thread zv_al_ring_t *g_ring;
+// $time_local / $time_iso8601 每秒只格式化一次
+static __thread time_t g_time_sec = -1;
+static __thread char g_time_local[40];
+static __thread char g_time_iso[40];
+
+static int compile_format(const char *fmt) {
+    size_t cap = 8, i;
+    const char *p = fmt;
+    g_items = (zv_al_item_t *)malloc(sizeof(zv_al_item_t) * cap);
+    if (!g_items) {
+        return -1;
+    }
+    g_nitems = 0;
+    while (*p) {
+        if ((size_t)g_nitems == cap) {
+            cap *= 2;
+            zv_al_item_t *n = (zv_al_item_t *)realloc(g_items, sizeof(zv_al_item_t) * cap);
+            if (!n) {
+                return -1;
+            }
+            g_items = n;
+        }
+        zv_al_item_t *it = &g_items[g_nitems++];
+        const char *name = p + 1;
+        size_t nlen = 0;
+        while (*p == '$' && ((name[nlen] >= 'a' && name[nlen] <= 'z') || (name[nlen] >= '0' && name[nlen] <= '9') || name[nlen] == '_')) {
+            nlen++;
+        }
+        if (*p != '$' || nlen == 0) {
+            // 字面量一直到下一个 $
+            const char *q = strchr(p + 1, '$');
+            it->op = ZV_AL_LITERAL;
+            it->text = p;
+            it->len = q ? (size_t)(q - p) : strlen(p);
+            p += it->len;
+            continue;
+        }
+        it->op = -1;
+        for (i = 0; i < sizeof(g_vars) / sizeof(g_vars[0]); i++) {
+            if (strlen(g_vars[i].name) == nlen && strncmp(g_vars[i].name, name, nlen) == 0) {
+                it->op = g_vars[i].op;
+                break;
+            }
+        }
+        if (it->op < 0) {
+            log_err("access_log_format: unknown variable $%.*s", (int)nlen, name);
+            return -1;
+        }
+        it->text = NULL;
+        it->len = 0;
+        p = name + nlen;
+    }
+    return 0;
+}
+
+static void put(char *line, size_t *len, const char *s, size_t n) {
+    if (n > ZV_ACCESS_LOG_LINE_MAX - 1 - *len) {
+        n = ZV_ACCESS_LOG_LINE_MAX - 1 - *len;
+    }
+    memcpy(line + *len, s, n);
+    *len += n;
+}
+
+static void putf(char *line, size_t *len, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+static void putf(char *line, size_t *len, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line + *len, ZV_ACCESS_LOG_LINE_MAX - *len, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        *len += ((size_t)n < ZV_ACCESS_LOG_LINE_MAX - 1 - *len) ? (size_t)n : ZV_ACCESS_LOG_LINE_MAX - 1 - *len;
+    }
+}
+
+// 请求里的原始字节：引号、反斜杠和不可打印字符写成 \xHH，日志行不会被客户端拆开或伪造
+static void put_escaped(char *line, size_t *len, const char *s, const char *e) {
+    static const char hex[] = "0123456789ABCDEF";
+    if (!s || !e || e <= s) {
+        put(line, len, "-", 1);
+        return;
+    }
+    for (; s < e && *len < ZV_ACCESS_LOG_LINE_MAX - 5; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch < 0x20 || ch >= 0x7f || ch == '"' || ch == '\\') {
+            line[(*len)++] = '\\';
+            line[(*len)++] = 'x';
+            line[(*len)++] = hex[ch >> 4];
+            line[(*len)++] = hex[ch & 0xf];
+        } else {
+            line[(*len)++] = (char)ch;
+        }
+    }
+}
+
+static void refresh_time(time_t now) {
+    struct tm tm;
+    if (now == g_time_sec) {
+        return;
+    }
+    g_time_sec = now;
+    localtime_r(&now, &tm);
+    strftime(g_time_local, sizeof(g_time_local), "%d/%b/%Y:%H:%M:%S %z", &tm);
+    strftime(g_time_iso, sizeof(g_time_iso), "%Y-%m-%dT%H:%M:%S%z", &tm);
+}
+
+static size_t format_entry(char *line, const zv_http_request_t *r, const zv_access_log_entry_t *e) {
+    size_t len = 0;
+    int i;
+    struct timespec ts;
+    char addr[INET_ADDRSTRLEN];
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    for (i = 0; i < g_nitems; i++) {
+        const zv_al_item_t *it = &g_items[i];
+        switch (it->op) {
+        case ZV_AL_LITERAL:
+            put(line, &len, it->text, it->len);
+            break;
+        case ZV_AL_REMOTE_ADDR:
+            if (!inet_ntop(AF_INET, &r->remote_addr, addr, sizeof(addr))) {
+                strcpy(addr, "-");
+            }
+            put(line, &len, addr, strlen(addr));
+            break;
+        case ZV_AL_TIME_LOCAL:
+            refresh_time(ts.tv_sec);
+            put(line, &len, g_time_local, strlen(g_time_local));
+            break;
+        case ZV_AL_TIME_ISO8601:
+            refresh_time(ts.tv_sec);
+            put(line, &len, g_time_iso, strlen(g_time_iso));
+            break;
+        case ZV_AL_MSEC:
+            putf(line, &len, "%lld.%03ld", (long long)ts.tv_sec, ts.tv_nsec / 1000000);
+            break;
+        case ZV_AL_REQUEST:
+            if (!e->method) {
+                put(line, &len, "-", 1);
+                break;
+            }
+            put_escaped(line, &len, e->method, e->method + e->method_len);
+            put(line, &len, " ", 1);
+            put_escaped(line, &len, e->uri, e->uri ? e->uri + e->uri_len : NULL);
+            putf(line, &len, " HTTP/%d.%d", e->http_major, e->http_minor);
+            break;
+        case ZV_AL_REQUEST_METHOD:
+            put_escaped(line, &len, e->method, e->method ? e->method + e->method_len : NULL);
+            break;
+        case ZV_AL_REQUEST_URI:
+            put_escaped(line, &len, e->uri, e->uri ? e->uri + e->uri_len : NULL);
+            break;
+        case ZV_AL_SERVER_PROTOCOL:
+            putf(line, &len, "HTTP/%d.%d", e->http_major, e->http_minor);
+            break;
+        case ZV_AL_STATUS:
+            putf(line, &len, "%d", e->status);
+            break;
+        case ZV_AL_BODY_BYTES_SENT:
+            if (e->body_bytes < 0) {
+                put(line, &len, "-", 1);
+            } else {
+                putf(line, &len, "%lld", e->body_bytes);
+            }
+            break;
+        case ZV_AL_REQUEST_TIME:
+            if (e->request_ns >= 0) {
+                unsigned long long ms = (unsigned long long)e->request_ns / 1000000;
+                putf(line, &len, "%llu.%03llu", ms / 1000, ms % 1000);
+            } else {
+                put(line, &len, "-", 1);
+            }
+            break;
+        case ZV_AL_PID:
+            putf(line, &len, "%d", (int)getpid());
+            break;
+        case ZV_AL_WORKER:
+            putf(line, &len, "%d", g_worker_id);
+            break;
+        }
+    }
+    line[len++] = '\n';
+    return len;
+}
+
+int zv_access_log_enabled(void) {
+    return g_ring != NULL;
+}
+
+void zv_access_log_write(const zv_http_request_t *r, const zv_access_log_entry_t *e) {
+    zv_al_ring_t *ring = g_ring;
+    char line[ZV_ACCESS_LOG_LINE_MAX];
+    if (!ring) {
+        return;
+    }
+    size_t len = format_entry(line, r, e);
+    size_t head = ring->p.head;
+    size_t tail = __atomic_load_n(&ring->c.tail, __ATOMIC_ACQUIRE);
+    size_t used = head - tail;
+    size_t half = (ring->mask + 1) / 2;
+    // 写线程跟不上：丢掉这一条并计数，绝不阻塞事件循环
+    if (ring->mask + 1 - used < len) {
+        ZV_STAT_INC(access_log_dropped);
+        return;
+    }
+    size_t off = head & ring->mask;
+    size_t first = ring->mask + 1 - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(ring->data + off, line, first);
+    memcpy(ring->data, line + first, len - first);
+    __atomic_store_n(&ring->p.head, head + len, __ATOMIC_RELEASE);
+    ZV_STAT_INC(access_log_lines);
+    // 只在越过一半的那一条上叫醒，平时靠写线程的定时批量写
+    if (used < half && used + len >= half) {
+        uint64_t one = 1;
+        (void)write(g_wake_fd, &one, sizeof(one));
+    }
+}
+
+// 一次 writev 写出所有环里已提交的条目；返回写出的字节数
+static size_t drain(void) {
+    struct iovec iov[2 * ZV_ACCESS_LOG_MAX_RINGS];
+    size_t heads[ZV_ACCESS_LOG_MAX_RINGS];
+    size_t total = 0;
+    int i, n = 0;
+    for (i = 0; i < g_nrings; i++) {
+        zv_al_ring_t *ring = &g_rings[i];
+        size_t tail = ring->c.tail;
+        size_t head = __atomic_load_n(&ring->p.head, __ATOMIC_ACQUIRE);
+        heads[i] = head;
+        if (head == tail) {
+            continue;
+        }
+        size_t off = tail & ring->mask;
+        size_t len = head - tail;
+        size_t first = ring->mask + 1 - off;
+        if (first > len) {
+            first = len;
+        }
+        iov[n].iov_base = ring->data + off;
+        iov[n++].iov_len = first;
+        if (len > first) {
+            iov[n].iov_base = ring->data;
+            iov[n++].iov_len = len - first;
+        }
+        total += len;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    // O_APPEND 下一次 writev 整体追加，几个 worker 写同一个文件也不会把行交错
+    ssize_t w = writev(g_fd, iov, n);
+    if (w < 0 || (size_t)w < total) {
+        // 磁盘满之类：这一批丢掉，不重试（重试只会让环更快写满）
+        log_err("access log write failed (%zd of %zu bytes), errno=%d", w, total, errno);
+    }
+    for (i = 0; i < g_nrings; i++) {
+        __atomic_store_n(&g_rings[i].c.tail, heads[i], __ATOMIC_RELEASE);
+    }
+    return total;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    struct pollfd pfd;
+    uint64_t v;
+    pfd.fd = g_wake_fd;
+    pfd.events = POLLIN;
+    while (!g_writer_stop) {
+        (void)drain();
+        if (poll(&pfd, 1, ZV_ACCESS_LOG_FLUSH_MS) > 0) {
+            (void)read(g_wake_fd, &v, sizeof(v));
+        }
+    }
+    return NULL;
+}
+
+int zv_access_log_start(zv_conf_t *cf, int worker_id, int nreactors) {
+    int i;
+    if (!cf->access_log) {
+        return 0;
+    }
+    g_worker_id = worker_id;
+    if (nreactors > ZV_ACCESS_LOG_MAX_RINGS) {
+        log_err("access log: at most %d reactors per worker", ZV_ACCESS_LOG_MAX_RINGS);
+        return -1;
+    }
+    if (compile_format(cf->access_log_format ? cf->access_log_format : ZV_ACCESS_LOG_DEFAULT_FORMAT) < 0) {
+        goto fail;
+    }
+    // 环大小取 2 的幂，下标用掩码回绕
+    size_t size = 4096;
+    size_t want = (size_t)(cf->access_log_buffer_kb > 0 ? cf->access_log_buffer_kb : ZV_DEFAULT_ACCESS_LOG_BUFFER_KB) * 1024;
+    while (size < want) {
+        size <<= 1;
+    }
+    g_rings = (zv_al_ring_t *)calloc((size_t)nreactors, sizeof(zv_al_ring_t));
+    if (!g_rings) {
+        goto fail;
+    }
+    g_nrings = nreactors;
+    for (i = 0; i < nreactors; i++) {
+        g_rings[i].data = (char *)malloc(size);
+        if (!g_rings[i].data) {
+            goto fail;
+        }
+        g_rings[i].mask = size - 1;
+    }
+    g_fd = open(cf->access_log, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (g_fd < 0) {
+        log_err("cannot open access log %s", cf->access_log);
+        goto fail;
+    }
+    g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_wake_fd < 0) {
+        log_err("eventfd(access log) failed");
+        goto fail;
+    }
+    // 写线程不接收停止信号，信号总是打断 reactor 的等待
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    g_writer_stop = 0;
+    int rc = pthread_create(&g_writer, NULL, writer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        log_err("pthread_create(access log writer) failed");
+        goto fail;
+    }
+    g_writer_started = 1;
+    return 0;
+
+fail:
+    zv_access_log_stop();
+    return -1;
+}
+
+void zv_access_log_stop(void) {
+    int i;
+    if (g_writer_started) {
+        uint64_t one = 1;
+        g_writer_stop = 1;
+        (void)write(g_wake_fd, &one, sizeof(one));
+        pthread_join(g_writer, NULL);
+        g_writer_started = 0;
+    }
+    if (g_wake_fd >= 0) {
+        close(g_wake_fd);
+        g_wake_fd = -1;
+    }
+    if (g_fd >= 0) {
+        (void)drain();
+        close(g_fd);
+        g_fd = -1;
+    }
+    for (i = 0; i < g_nrings; i++) {
+        free(g_rings[i].data);
+    }
+    free(g_rings);
+    g_rings = NULL;
+    g_nrings = 0;
+    free(g_items);
+    g_items = NULL;
+    g_nitems = 0;
+}
+
+void zv_access_log_attach(int reactor_id) {
+    g_ring = (g_writer_started && reactor_id < g_nrings) ? &g_rings[reactor_id] : NULL;
+}
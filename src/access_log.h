@@ -0,0 +1,46 @@
+/*
+ * Asynchronous access log: every reactor formats its entries into its own
+ * single-producer ring; a writer thread per worker drains all rings with
+ * one O_APPEND writev, on a timer or as soon as a ring is half full. A full
+ * ring drops the entry (counted in stats) instead of stalling the event loop.
+ */
+
+#ifndef ZV_ACCESS_LOG_H
+#define ZV_ACCESS_LOG_H
+
+#include "util.h"
+#include "http_request.h"
+
+#define ZV_ACCESS_LOG_DEFAULT_FORMAT "$remote_addr - - [$time_local] \"$request\" $status $body_bytes_sent $request_time"
+#define ZV_ACCESS_LOG_LINE_MAX   2048   /* longer entries are truncated */
+#define ZV_ACCESS_LOG_FLUSH_MS   100    /* writer thread period while no ring is half full */
+#define ZV_ACCESS_LOG_MAX_RINGS  64     /* reactors per worker */
+
+/*
+ * Worker: open cf->access_log, compile the format and start the writer
+ * thread with one ring per reactor. return: 0 ok (also when disabled), -1 error
+ */
+int zv_access_log_start(zv_conf_t *cf, int worker_id, int nreactors);
+/* Worker, after every reactor returned: write what is left, stop the thread, close the file. */
+void zv_access_log_stop(void);
+/* Reactor thread: entries go to ring reactor_id from now on. */
+void zv_access_log_attach(int reactor_id);
+/* One finished (or abandoned) response. */
+typedef struct {
+    const char *method;         /* copied request line parts, NULL: not parsed */
+    size_t method_len;
+    const char *uri;
+    size_t uri_len;
+    int http_major;
+    int http_minor;
+    int status;
+    long long body_bytes;       /* body bytes that reached the socket, < 0: unknown (chunked) */
+    long long request_ns;       /* first request byte -> last response byte, < 0: unknown */
+} zv_access_log_entry_t;
+
+/* Reactor: whether entries go anywhere (callers skip copying the request line otherwise). */
+int zv_access_log_enabled(void);
+/* Reactor: log one response of connection r. No-op when disabled. */
+void zv_access_log_write(const zv_http_request_t *r, const zv_access_log_entry_t *e);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Blocking work offloaded to the worker's helper threads, completed back on
+ * the event loop through an eventfd.
+ */
+
+#include "aio.h"
+#include "dbg.h"
+#include "epoll.h"
+#include "ep_item.h"
+#include "threadpool.h"
+
+/* 每个 reactor 线程一份：线程池 + 它的完成 eventfd，完成回调回到发起的 reactor */
+static __thread zv_threadpool_t *g_pool;
+static __thread zv_ep_item_t g_efd_item;
+
+// 线程池里执行阻塞工作
+static void aio_work(void *arg) {
+    zv_aio_task_t *t = (zv_aio_task_t *)arg;
+    t->work(t);
+}
+
+// 回到事件循环后执行
+static void aio_done(void *arg) {
+    zv_aio_task_t *t = (zv_aio_task_t *)arg;
+    t->done(t);
+}
+
+int zv_aio_init(int epfd, int thread_num) {
+    g_pool = threadpool_init(thread_num);
+    if (g_pool == NULL) {
+        return -1;
+    }
+
+    int efd = threadpool_completion_fd(g_pool);
+    g_efd_item.kind = ZV_EP_KIND_AIO;
+    g_efd_item.fd = efd;
+    g_efd_item.r = NULL;
+    struct epoll_event ev;
+    ev.data.ptr = (void *)&g_efd_item;
+    ev.events = EPOLLIN | EPOLLET;
+    zv_epoll_add(epfd, efd, &ev);
+    return 0;
+}
+
+void zv_aio_shutdown(void) {
+    if (g_pool) {
+        (void)threadpool_destroy(g_pool, 0);
+        g_pool = NULL;
+    }
+}
+
+int zv_aio_post(zv_aio_task_t *t) {
+    if (g_pool == NULL || t == NULL || t->work == NULL || t->done == NULL) {
+        return -1;
+    }
+    return threadpool_add_done(g_pool, aio_work, aio_done, t) == 0 ? 0 : -1;
+}
+
+void zv_aio_on_event(void) {
+    (void)threadpool_run_completions(g_pool);
+}
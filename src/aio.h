@@ -0,0 +1,47 @@
+/*
+ * Blocking work offloaded to the worker's helper threads, completed back on
+ * the event loop through an eventfd.
+ */
+
+#ifndef ZV_AIO_H
+#define ZV_AIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct zv_aio_task_s;
+
+typedef void (*zv_aio_pt)(struct zv_aio_task_s *t);
+
+typedef struct zv_aio_task_s {
+    zv_aio_pt work;     /* runs on a helper thread; must not touch loop state */
+    zv_aio_pt done;     /* runs on the event loop once work has returned */
+    /*
+     * Owner the completion is delivered to (usually a zv_http_request_t).
+     * zv_aio_orphan() clears it when the owner goes away first; done must
+     * then only release what the task itself holds.
+     */
+    void *data;
+} zv_aio_task_t;
+
+/* Start thread_num helper threads and register the completion eventfd on epfd. */
+int zv_aio_init(int epfd, int thread_num);
+void zv_aio_shutdown(void);
+
+/* Hand t to a helper thread; t->done runs later from zv_aio_on_event(). */
+int zv_aio_post(zv_aio_task_t *t);
+/* The completion eventfd became readable: run every pending done callback. */
+void zv_aio_on_event(void);
+
+static inline void zv_aio_orphan(zv_aio_task_t *t) {
+    if (t) {
+        t->data = 0;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
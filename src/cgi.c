@@ -1,3 +1,7 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "cgi.h"
 #include <errno.h>
 #include <fcntl.h>
@@ -8,12 +12,12 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
-#include <sys/uio.h>
 #include "dbg.h"
 #include "epoll.h"
 #include "timer.h"
 #include "util.h"
 #include "ep_item.h"
+#include "stats.h"
 
 // 设置文件描述符为非阻塞且关闭时关闭（cloexec）
 //FD_CLOEXEC标志 ：当进程调用 execve()（或其他 exec 族函数）替换为新程序时，带有该标志的文件描述符会被内核自动关闭；
@@ -64,7 +68,7 @@ static int parse_content_type(const char *line, char *out, size_t out_cap) {
     out[n] = '\0';
     return 1;
 }
-// 构建 CGI 响应的 HTTP 头（chunked）
+// 构建 CGI 响应的 HTTP 头（chunked）并放入输出链
 /*
 "HTTP/1.1 %d %s\r\n"
 "Server: Zaver\r\n"
@@ -86,8 +90,10 @@ static int build_http_header(zv_http_request_t *r, int status, const char *conte
     if (!content_type || content_type[0] == '\0') {
         content_type = "text/plain";
     }
-    // 构建 HTTP 响应头
-    int n = snprintf(r->cgi_http_header, sizeof(r->cgi_http_header),
+    // 构建 HTTP 响应头（写进 r->out 的 arena）
+    size_t cap = 0;
+    char *hdr = zv_out_chain_buf_reserve(&r->out, &cap);
+    int n = snprintf(hdr, cap,
                      "HTTP/1.1 %d %s\r\n"
                      "Server: Zaver\r\n"
                      "Connection: close\r\n"
@@ -95,16 +101,9 @@ static int build_http_header(zv_http_request_t *r, int status, const char *conte
                      "Transfer-Encoding: chunked\r\n"
                      "\r\n",
                      status, reason, content_type);
-    if (n < 0 || (size_t)n >= sizeof(r->cgi_http_header)) return -1;
-    r->cgi_http_header_len = (size_t)n;
-    r->cgi_http_header_sent = 0;
-
-    r->cgi_chunk_prefix_len = 0;
-    r->cgi_chunk_prefix_sent = 0;
-    r->cgi_chunk_suffix_sent = 0;
-    r->cgi_final_chunk_len = 0;
-    r->cgi_final_chunk_sent = 0;
-    return 0;
+    if (n < 0 || (size_t)n >= cap) return -1;
+    zv_http_note_response(r, status, -1);
+    return zv_out_chain_buf_commit(&r->out, (size_t)n);
 }
 
 //Content-Length（内存开销大，延迟高），要么就没发 Content-Length 导致客户端报错。
@@ -115,30 +114,37 @@ static int build_http_header(zv_http_request_t *r, int status, const char *conte
 End Chunk（结束块）:
 必须发送一个长度为 0 的块来表示传输结束。
 格式：0\r\n\r\n。*/
-static int prepare_chunk_prefix(zv_http_request_t *r, size_t chunk_len) {
+// 正文段发完（或连接关闭被丢弃）后，cgi_body_buf 可以再次读入
+static void body_chunk_released(void *data) {
+    zv_http_request_t *r = (zv_http_request_t *)data;
+    r->cgi_body_len = 0;
+}
+// 把 cgi_body_buf 中的数据作为一个 chunk 入队：前缀 + 正文 + 后缀
+static int queue_body_chunk(zv_http_request_t *r) {
     if (!r) return -1;
-    if (chunk_len == 0) {
-        r->cgi_chunk_prefix_len = 0;
-        r->cgi_chunk_prefix_sent = 0;
-        r->cgi_chunk_suffix_sent = 0;
+    if (r->cgi_body_len == 0) {
         return 0;
     }
+    static const char crlf[] = "\r\n";
     // 构建块前缀（长度行）
-    int n = snprintf(r->cgi_chunk_prefix, sizeof(r->cgi_chunk_prefix), "%zx\r\n", chunk_len);
-    if (n < 0 || (size_t)n >= sizeof(r->cgi_chunk_prefix)) return -1;
-    r->cgi_chunk_prefix_len = (size_t)n;
-    r->cgi_chunk_prefix_sent = 0;
-    r->cgi_chunk_suffix_sent = 0;
-    return 0;
+    size_t cap = 0;
+    char *prefix = zv_out_chain_buf_reserve(&r->out, &cap);
+    int n = snprintf(prefix, cap, "%zx\r\n", r->cgi_body_len);
+    if (n < 0 || (size_t)n >= cap) return -1;
+    if (zv_out_chain_buf_commit(&r->out, (size_t)n) != 0) return -1;
+    // 正文直接引用 cgi_body_buf，发完之前不再读 CGI 输出（反压）
+    if (zv_out_chain_append_mem(&r->out, r->cgi_body_buf, r->cgi_body_len, body_chunk_released, r) != 0) return -1;
+    return zv_out_chain_append_mem(&r->out, crlf, 2, NULL, NULL);
 }
-// 准备结束块数据
-static void ensure_final_chunk(zv_http_request_t *r) {
-    if (!r) return;
-    if (r->cgi_final_chunk_len == 0) {
-        memcpy(r->cgi_final_chunk, "0\r\n\r\n", 5);
-        r->cgi_final_chunk_len = 5;
-        r->cgi_final_chunk_sent = 0;
+// 结束块入队（只入队一次）
+static int queue_final_chunk(zv_http_request_t *r) {
+    if (!r) return -1;
+    if (!r->cgi_final_queued) {
+        static const char final_chunk[] = "0\r\n\r\n";
+        if (zv_out_chain_append_mem(&r->out, final_chunk, 5, NULL, NULL) != 0) return -1;
+        r->cgi_final_queued = 1;
     }
+    return 0;
 }
 // 确保 CGI 输出事件的 epoll item 已分配并正确初始化
 static void ensure_cgi_items(zv_http_request_t *r) {
@@ -165,8 +171,9 @@ int zv_cgi_start(zv_http_request_t *r, const char *script_filename, const char *
     MVP 里只支持 GET，所以不会给 CGI stdin 写请求体，但仍然建了 in_pipe，原因是代码结构上最通用：之后要支持 POST，直接复用即可。*/
     int in_pipe[2];
     int out_pipe[2];
-    if (pipe(in_pipe) != 0) return -1;
-    if (pipe(out_pipe) != 0) {
+    // O_CLOEXEC：别的 reactor 线程同时 fork 的子进程不能继承这些管道（否则 EOF 会被拖住），dup2 到 0/1 后会清掉该标志
+    if (pipe2(in_pipe, O_CLOEXEC) != 0) return -1;
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) {
         close(in_pipe[0]);
         close(in_pipe[1]);
         return -1;
@@ -257,11 +264,8 @@ int zv_cgi_start(zv_http_request_t *r, const char *script_filename, const char *
     r->cgi_out_total = 0;
     r->cgi_headers_done = 0;
     r->cgi_hdr_len = 0;
-    r->cgi_http_header_len = 0;
-    r->cgi_http_header_sent = 0;
-
+    r->cgi_final_queued = 0;
     r->cgi_body_len = 0;
-    r->cgi_body_sent = 0;
     //准备 epoll data.ptr 的 “item” 结构
     ensure_cgi_items(r);
     //把 CGI stdout fd 加入 epoll 监听读事件（pipe 用 LT + ONESHOT，配合“读一块就回写”的反压模型）
@@ -286,13 +290,10 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
     zv_del_timer(r);
 
     for (;;) {
-        //反压：如果我们还有未发送的数据，则停止读取。
-        if (r->cgi_body_len > 0 &&
-            (r->cgi_chunk_prefix_sent < r->cgi_chunk_prefix_len ||
-             r->cgi_body_sent < r->cgi_body_len ||
-             r->cgi_chunk_suffix_sent < 2)) 
-        {
-            break;
+        //反压：正文缓冲区还在输出链上没发完，则停止读取（由 zv_cgi_on_client_writable 发完后重新启用）。
+        if (r->cgi_body_len > 0) {
+            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
+            return;
         }
         // 读取 CGI 输出 读到的数据放在 r->cgi_body_buf 里
         ssize_t n = read(r->cgi_out_fd, r->cgi_body_buf, sizeof(r->cgi_body_buf));
@@ -380,15 +381,12 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
                         if (remain > sizeof(r->cgi_body_buf)) remain = sizeof(r->cgi_body_buf);
                         memmove(r->cgi_body_buf, hdr + body_off, remain);
                         r->cgi_body_len = remain;
-                        r->cgi_body_sent = 0;
-                        if (prepare_chunk_prefix(r, r->cgi_body_len) != 0) {
+                        if (queue_body_chunk(r) != 0) {
                             zv_http_close_conn(r);
                             return;
                         }
                     } else {
                         r->cgi_body_len = 0;
-                        r->cgi_body_sent = 0;
-                        (void)prepare_chunk_prefix(r, 0);
                     }
                     // 重置 header buffer 长度
                     r->cgi_hdr_len = 0;
@@ -403,8 +401,7 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
                 }
             } else {
                 r->cgi_body_len = (size_t)n;
-                r->cgi_body_sent = 0;
-                if (prepare_chunk_prefix(r, r->cgi_body_len) != 0) {
+                if (queue_body_chunk(r) != 0) {
                     zv_http_close_conn(r);
                     return;
                 }
@@ -422,7 +419,7 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
         /* EOF */
         if (n == 0) {
             r->cgi_eof = 1;//给“写回客户端”的那侧 (zv_cgi_on_client_writable) 一个信号：后面不会再有新的 body 数据块了，应该在合适的时候发送 final chunk（0\r\n\r\n）。
-            close(r->cgi_out_fd);//关闭 pipe fd
+            zv_epoll_close(r->epfd, r->cgi_out_fd);//关闭 pipe fd
             r->cgi_out_fd = -1;
             //有的 CGI 脚本可能 没按 CGI 规范输出头部结束符（也就是没输出 \r\n\r\n 或 \n\n），导致你一直处于“还在等 CGI headers 完整”的状态。
             //EOF 时还没解析出 CGI 头
@@ -448,8 +445,7 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
                         memcpy(r->cgi_body_buf, r->cgi_hdr_buf, remain);
                         r->cgi_body_len = remain;
                     }
-                    r->cgi_body_sent = 0;
-                    if (prepare_chunk_prefix(r, r->cgi_body_len) != 0) {
+                    if (queue_body_chunk(r) != 0) {
                         zv_http_close_conn(r);
                         return;
                     }
@@ -465,13 +461,17 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
                     if (msg_len > sizeof(r->cgi_body_buf)) msg_len = sizeof(r->cgi_body_buf);
                     memcpy(r->cgi_body_buf, msg, msg_len);
                     r->cgi_body_len = msg_len;
-                    r->cgi_body_sent = 0;
-                    if (prepare_chunk_prefix(r, r->cgi_body_len) != 0) {
+                    if (queue_body_chunk(r) != 0) {
                         zv_http_close_conn(r);
                         return;
                     }
                     r->cgi_headers_done = 1;
                 }
+                // 没有更多输出了，结束块紧跟在正文后面
+                if (queue_final_chunk(r) != 0) {
+                    zv_http_close_conn(r);
+                    return;
+                }
 
                 struct epoll_event e;
                 e.data.ptr = (void *)r->conn_item;
@@ -482,7 +482,10 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
             }
             //正常 EOF 路径（已经解析过 CGI headers）应该发送 final chunk 来终止 chunked body。
             /* Normal case: headers already parsed. EOF => send final chunk to terminate body. */
-            ensure_final_chunk(r);
+            if (queue_final_chunk(r) != 0) {
+                zv_http_close_conn(r);
+                return;
+            }
             struct epoll_event e;
             e.data.ptr = (void *)r->conn_item;
             e.events = EPOLLOUT | EPOLLET | EPOLLONESHOT;
@@ -517,130 +520,23 @@ void zv_cgi_on_stdout_ready(zv_http_request_t *r) {
 //-1: error  0: finished  1: would block  2: need more reading
 int zv_cgi_on_client_writable(zv_http_request_t *r) {
     if (!r || !r->cgi_active) return -1;
-    /* Send HTTP header once, then stream body using chunked transfer encoding. */
-    for (;;) {
-        struct iovec iov[4];
-        int iovcnt = 0;
-        // 先发送 HTTP 头
-        if (r->cgi_http_header_sent < r->cgi_http_header_len) {
-            iov[iovcnt].iov_base = r->cgi_http_header + r->cgi_http_header_sent;
-            iov[iovcnt].iov_len = r->cgi_http_header_len - r->cgi_http_header_sent;
-            iovcnt++;
-        }
-        // 然后发送 body chunks
-        if (r->cgi_body_len > 0) {
-            //块前缀
-            if (r->cgi_chunk_prefix_sent < r->cgi_chunk_prefix_len) {
-                iov[iovcnt].iov_base = r->cgi_chunk_prefix + r->cgi_chunk_prefix_sent;
-                iov[iovcnt].iov_len = r->cgi_chunk_prefix_len - r->cgi_chunk_prefix_sent;
-                iovcnt++;
-            }
-            //块数据
-            if (r->cgi_body_sent < r->cgi_body_len) {
-                iov[iovcnt].iov_base = r->cgi_body_buf + r->cgi_body_sent;
-                iov[iovcnt].iov_len = r->cgi_body_len - r->cgi_body_sent;
-                iovcnt++;
-            }
-            //块后缀 \r\n
-            if (r->cgi_chunk_suffix_sent < 2) {
-                static const char crlf[] = "\r\n";
-                iov[iovcnt].iov_base = (void *)(crlf + r->cgi_chunk_suffix_sent);
-                iov[iovcnt].iov_len = 2 - r->cgi_chunk_suffix_sent;
-                iovcnt++;
-            }
-        } else if (r->cgi_eof) {
-            ensure_final_chunk(r);
-            if (r->cgi_final_chunk_sent < r->cgi_final_chunk_len) {
-                iov[iovcnt].iov_base = r->cgi_final_chunk + r->cgi_final_chunk_sent;
-                iov[iovcnt].iov_len = r->cgi_final_chunk_len - r->cgi_final_chunk_sent;
-                iovcnt++;
-            }
-        } else {
-            /* nothing to send right now */
-            break;
-        }
-
-        if (iovcnt == 0) {
-            break;
-        }
-        // 发送数据
-        ssize_t n = writev(r->fd, iov, iovcnt);
-        if (n > 0) {
-            ssize_t left = n;
-            if (r->cgi_http_header_sent < r->cgi_http_header_len) {
-                size_t rem = r->cgi_http_header_len - r->cgi_http_header_sent;
-                size_t cons = (left >= (ssize_t)rem) ? rem : (size_t)left;
-                r->cgi_http_header_sent += cons;
-                left -= (ssize_t)cons;
-            }
-
-            if (left > 0 && r->cgi_body_len > 0) {
-                if (r->cgi_chunk_prefix_sent < r->cgi_chunk_prefix_len) {
-                    size_t rem = r->cgi_chunk_prefix_len - r->cgi_chunk_prefix_sent;
-                    size_t cons = (left >= (ssize_t)rem) ? rem : (size_t)left;
-                    r->cgi_chunk_prefix_sent += cons;
-                    left -= (ssize_t)cons;
-                }
-                if (left > 0 && r->cgi_body_sent < r->cgi_body_len) {
-                    size_t rem = r->cgi_body_len - r->cgi_body_sent;
-                    size_t cons = (left >= (ssize_t)rem) ? rem : (size_t)left;
-                    r->cgi_body_sent += cons;
-                    left -= (ssize_t)cons;
-                }
-                if (left > 0 && r->cgi_chunk_suffix_sent < 2) {
-                    size_t rem = 2 - r->cgi_chunk_suffix_sent;
-                    size_t cons = (left >= (ssize_t)rem) ? rem : (size_t)left;
-                    r->cgi_chunk_suffix_sent += cons;
-                    left -= (ssize_t)cons;
-                }
-
-                if (r->cgi_chunk_prefix_sent == r->cgi_chunk_prefix_len &&
-                    r->cgi_body_sent == r->cgi_body_len &&
-                    r->cgi_chunk_suffix_sent == 2) {
-                    r->cgi_body_len = 0;
-                    r->cgi_body_sent = 0;
-                    r->cgi_chunk_prefix_len = 0;
-                    r->cgi_chunk_prefix_sent = 0;
-                    r->cgi_chunk_suffix_sent = 0;
-                }
-            }
-
-            if (left > 0 && r->cgi_eof && r->cgi_body_len == 0 && r->cgi_final_chunk_len > 0 &&
-                r->cgi_final_chunk_sent < r->cgi_final_chunk_len) {
-                size_t rem = r->cgi_final_chunk_len - r->cgi_final_chunk_sent;
-                size_t cons = (left >= (ssize_t)rem) ? rem : (size_t)left;
-                r->cgi_final_chunk_sent += cons;
-                left -= (ssize_t)cons;
-            }
-
-            continue;
-        }
-
-        if (n == 0) {
-            errno = EPIPE;
-            return -1;
-        }
-
-        if (errno == EINTR) continue;
-        if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
-        return -1;
-    }
+    /* header / chunks are already queued on r->out; drain them with the shared sender */
+    int rc = zv_out_chain_send(r->fd, &r->out, 0);
+    if (rc < 0) return -1;
+    zv_http_record_sent(r, rc == 0);
+    if (rc == 1) return 1;
     //全部数据都发送完了 回收子进程
-    if (r->cgi_eof) {
-        ensure_final_chunk(r);
-        if (r->cgi_final_chunk_sent >= r->cgi_final_chunk_len) {
-            if (r->cgi_pid > 0) {
-                (void)waitpid(r->cgi_pid, NULL, WNOHANG);
-            }
-            return 0;
+    if (r->cgi_eof && r->cgi_final_queued) {
+        if (r->cgi_pid > 0) {
+            (void)waitpid(r->cgi_pid, NULL, WNOHANG);
         }
-        return 1;
+        return 0;
     }
     //还有更多数据要读 回调 zv_cgi_on_stdout_ready 继续读
     if (r->cgi_out_fd >= 0) {
         struct epoll_event ev;
         ev.data.ptr = (void *)r->cgi_out_item;
-          ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.events = EPOLLIN | EPOLLONESHOT;
         zv_epoll_mod(r->epfd, r->cgi_out_fd, &ev);
     }
 
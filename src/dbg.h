@@ -11,20 +11,22 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include "zv_log.h"
 
+/* Release builds compile debug/log_info out entirely; the rest obey log_level and log_rate_limit. */
 #ifdef NDEBUG
 #define debug(M, ...)
 #define log_info(M, ...) 
 #else
-#define debug(M, ...) fprintf(stderr, "DEBUG %s:%d: " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
-#define log_info(M, ...) fprintf(stderr, "[INFO] (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define debug(M, ...) zv_log_at(ZV_LOG_DEBUG, M, ##__VA_ARGS__)
+#define log_info(M, ...) zv_log_at(ZV_LOG_INFO, M, ##__VA_ARGS__)
 #endif
 
-#define log_status(M, ...) fprintf(stderr, "[STATUS] (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define log_status(M, ...) zv_log_at(ZV_LOG_NOTICE, M, ##__VA_ARGS__)
 
 #define clean_errno() (errno == 0 ? "None" : strerror(errno))
-#define log_err(M, ...) fprintf(stderr, "[ERROR] (%s:%d: errno: %s) " M "\n", __FILE__, __LINE__, clean_errno(), ##__VA_ARGS__)
-#define log_warn(M, ...) fprintf(stderr, "[WARN] (%s:%d: errno: %s) " M "\n", __FILE__, __LINE__, clean_errno(), ##__VA_ARGS__)
+#define log_err(M, ...) zv_log_at(ZV_LOG_ERR, M, ##__VA_ARGS__)
+#define log_warn(M, ...) zv_log_at(ZV_LOG_WARN, M, ##__VA_ARGS__)
 
 #define check(A, M, ...) if(!(A)) { log_err(M "\n", ##__VA_ARGS__); /* exit(1); */ }
 
@@ -12,7 +12,9 @@ typedef enum {
     ZV_EP_KIND_LISTEN = 1,//
     ZV_EP_KIND_CONN = 2,
     ZV_EP_KIND_CGI_OUT = 3,
-    ZV_EP_KIND_CGI_IN = 4
+    ZV_EP_KIND_CGI_IN = 4,
+    ZV_EP_KIND_AIO = 5,     // 辅助线程完成通知（eventfd）
+    ZV_EP_KIND_WAKE = 6     // 叫醒 reactor 重新检查退出标志（eventfd）
 } zv_ep_kind_t;
 
 typedef struct zv_ep_item_s {
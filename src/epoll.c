@@ -4,14 +4,110 @@
  * Copyright (C) Zaver
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
 #include "epoll.h"
 #include "dbg.h"
 
-struct epoll_event *events;
+/* 每个 reactor 线程一个事件实例和事件数组 */
+__thread struct epoll_event *events;
+
+static int epoll_backend_create(int flags) {
+    return epoll_create1(flags);
+}
+
+// 注册提示位是给其他后端的，epoll 不认识（EPOLLEXCLUSIVE 下还会报 EINVAL）
+static int epoll_backend_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    struct epoll_event ev;
+    if (!event) {
+        return epoll_ctl(epfd, op, fd, event);
+    }
+    ev = *event;
+    ev.events &= ~(uint32_t)ZV_EPOLL_HINTS;
+    return epoll_ctl(epfd, op, fd, &ev);
+}
+
+static int epoll_backend_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    return epoll_wait(epfd, events, maxevents, timeout);
+}
+
+// close 会自动把 fd 从所有 epoll 集合中移除
+static int epoll_backend_close(int epfd, int fd) {
+    (void)epfd;
+    return close(fd);
+}
+
+static void epoll_backend_destroy(int epfd) {
+    close(epfd);
+}
+
+/* struct epoll_params / EPIOCSPARAMS (linux/eventpoll.h, 6.9+); older headers lack them */
+typedef struct {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t pad;
+} zv_epoll_params_t;
+
+#define ZV_EPIOCSPARAMS         _IOW(0x8A, 0x01, zv_epoll_params_t)
+#define ZV_BUSY_POLL_BUDGET     8       /* kernel default; more than 64 needs CAP_NET_ADMIN */
+
+static int epoll_backend_busy_poll(int epfd, int usecs) {
+    zv_epoll_params_t p;
+    p.busy_poll_usecs = (uint32_t)usecs;
+    p.busy_poll_budget = ZV_BUSY_POLL_BUDGET;
+    p.prefer_busy_poll = 1;
+    p.pad = 0;
+    return ioctl(epfd, ZV_EPIOCSPARAMS, &p);
+}
+
+static int epoll_backend_accept(int epfd, int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    (void)epfd;
+    return accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+static ssize_t epoll_backend_read(int epfd, int fd, void *buf, size_t len) {
+    (void)epfd;
+    return read(fd, buf, len);
+}
+
+const zv_event_backend_t zv_event_epoll = {
+    "epoll",
+    epoll_backend_create,
+    epoll_backend_ctl,
+    epoll_backend_wait,
+    epoll_backend_close,
+    epoll_backend_destroy,
+    epoll_backend_busy_poll,
+    epoll_backend_accept,
+    epoll_backend_read,
+};
+
+/* 后端在创建前选定；回退只影响当前 reactor */
+static __thread const zv_event_backend_t *g_backend = &zv_event_epoll;
+
+void zv_event_backend_select(const zv_event_backend_t *backend) {
+    g_backend = backend ? backend : &zv_event_epoll;
+}
+
+const char *zv_event_backend_name(void) {
+    return g_backend->name;
+}
 
 int zv_epoll_create(int flags) {
-    int fd = epoll_create1(flags);
-    check(fd > 0, "zv_epoll_create: epoll_create1");
+    int fd = g_backend->create(flags);
+    // 选中的后端不可用（内核太旧、被 seccomp 禁用等）时退回 epoll
+    if (fd < 0 && g_backend != &zv_event_epoll) {
+        log_warn("event backend %s unavailable, falling back to epoll", g_backend->name);
+        g_backend = &zv_event_epoll;
+        fd = g_backend->create(flags);
+    }
+    check(fd > 0, "zv_epoll_create: %s", g_backend->name);
 
     events = (struct epoll_event *)malloc(sizeof(struct epoll_event) * MAXEVENTS);
     check(events != NULL, "zv_epoll_create: malloc");
@@ -19,25 +115,25 @@ int zv_epoll_create(int flags) {
 }
 // 添加监听事件
 void zv_epoll_add(int epfd, int fd, struct epoll_event *event) {
-    int rc = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, event);
+    int rc = g_backend->ctl(epfd, EPOLL_CTL_ADD, fd, event);
     check(rc == 0, "zv_epoll_add: epoll_ctl");
     return;
 }
 // 修改监听事件
 void zv_epoll_mod(int epfd, int fd, struct epoll_event *event) {
-    int rc = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, event);
+    int rc = g_backend->ctl(epfd, EPOLL_CTL_MOD, fd, event);
     check(rc == 0, "zv_epoll_mod: epoll_ctl");
     return;
 }
 // 删除监听事件
 void zv_epoll_del(int epfd, int fd, struct epoll_event *event) {
-    int rc = epoll_ctl(epfd, EPOLL_CTL_DEL, fd, event);
+    int rc = g_backend->ctl(epfd, EPOLL_CTL_DEL, fd, event);
     check(rc == 0, "zv_epoll_del: epoll_ctl");
     return;
 }
 // 等待事件发生
 int zv_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
-    int n = epoll_wait(epfd, events, maxevents, timeout);
+    int n = g_backend->wait(epfd, events, maxevents, timeout);
     if (n < 0) {
         // 被信号中断的情况下，直接返回0
         if (errno == EINTR) {
@@ -50,3 +146,25 @@ int zv_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeo
 
     return n;
 }
+// 停止监听并关闭 fd
+int zv_epoll_close(int epfd, int fd) {
+    return g_backend->close_fd(epfd, fd);
+}
+// 接受一个新连接（非阻塞、close-on-exec）
+int zv_epoll_accept(int epfd, int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    return g_backend->accept(epfd, fd, addr, addrlen);
+}
+// 从连接读数据
+ssize_t zv_epoll_read(int epfd, int fd, void *buf, size_t len) {
+    return g_backend->read(epfd, fd, buf, len);
+}
+// 内核侧忙轮询：等待时先轮询网卡队列，没有数据再睡眠
+int zv_epoll_busy_poll(int epfd, int usecs) {
+    return g_backend->busy_poll(epfd, usecs);
+}
+// 释放事件实例和事件数组
+void zv_epoll_destroy(int epfd) {
+    g_backend->destroy(epfd);
+    free(events);
+    events = NULL;
+}
@@ -8,13 +8,70 @@
 #define EPOLL_H
 
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
 
 #define MAXEVENTS 1024
 
+/*
+ * Registration hints, ignored by epoll: the listen socket's EPOLLIN is served
+ * by accepting connections ahead of zv_epoll_accept(), a connection's EPOLLIN
+ * by receiving data ahead of zv_epoll_read(). Set them on EPOLL_CTL_ADD; they
+ * hold until the fd is deleted or closed.
+ */
+#define ZV_EPOLLACCEPT  (1u << 26)
+#define ZV_EPOLLRECV    (1u << 27)
+#define ZV_EPOLL_HINTS  (ZV_EPOLLACCEPT | ZV_EPOLLRECV)
+
+/*
+ * Event backend. The zv_epoll_* calls keep epoll's contract (event masks,
+ * EPOLLET / EPOLLONESHOT, data handed back with each event) and dispatch to
+ * the backend chosen at startup; other backends emulate that contract.
+ */
+typedef struct {
+    const char *name;
+    int (*create)(int flags);       /* -1 when the backend is unavailable */
+    int (*ctl)(int epfd, int op, int fd, struct epoll_event *event);
+    int (*wait)(int epfd, struct epoll_event *events, int maxevents, int timeout);
+    int (*close_fd)(int epfd, int fd);
+    void (*destroy)(int epfd);
+    int (*busy_poll)(int epfd, int usecs);  /* -1 when the kernel refuses */
+    int (*accept)(int epfd, int fd, struct sockaddr *addr, socklen_t *addrlen);
+    ssize_t (*read)(int epfd, int fd, void *buf, size_t len);
+} zv_event_backend_t;
+
+extern const zv_event_backend_t zv_event_epoll;
+extern const zv_event_backend_t zv_event_uring;     /* io_uring (experimental) */
+
+/* Pick the backend for the next zv_epoll_create(); it falls back to epoll. */
+void zv_event_backend_select(const zv_event_backend_t *backend);
+const char *zv_event_backend_name(void);
+
 int zv_epoll_create(int flags);
 void zv_epoll_add(int epfd, int fs, struct epoll_event *event);
 void zv_epoll_mod(int epfd, int fs, struct epoll_event *event);
 void zv_epoll_del(int epfd, int fs, struct epoll_event *event);
 int zv_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+/*
+ * Stop watching fd and close it. epoll forgets closed fds on its own, but a
+ * pending io_uring poll pins the file (no FIN) until it is cancelled.
+ */
+int zv_epoll_close(int epfd, int fd);
+/*
+ * accept4(SOCK_NONBLOCK | SOCK_CLOEXEC) on a listen socket. A backend that
+ * accepted ahead hands out its queued connections first and may leave the
+ * address unknown (*addrlen set to 0).
+ */
+int zv_epoll_accept(int epfd, int fd, struct sockaddr *addr, socklen_t *addrlen);
+/* read() on a connection socket, served from data the backend already received. */
+ssize_t zv_epoll_read(int epfd, int fd, void *buf, size_t len);
+/*
+ * Let the kernel busy-poll the NIC queues of the watched sockets for up to
+ * usecs inside each wait (epoll EPIOCSPARAMS / io_uring NAPI registration).
+ * return: 0 ok, -1 unsupported
+ */
+int zv_epoll_busy_poll(int epfd, int usecs);
+/* Release the event instance and the events array of the calling reactor. */
+void zv_epoll_destroy(int epfd);
 
 #endif
@@ -0,0 +1,920 @@
+/*
+ * io_uring event backend (experimental) behind epoll's contract.
+ * Readiness is emulated with poll requests: EPOLLONESHOT registrations become
+ * single-shot IORING_OP_POLL_ADD, the others multishot polls. Two
+ * registration hints let the ring do the I/O itself:
+ *  - ZV_EPOLLACCEPT (listen socket): a multishot IORING_OP_ACCEPT queues new
+ *    connections, which zv_epoll_accept() hands out without a syscall;
+ *  - ZV_EPOLLRECV (connection): arming EPOLLIN submits an IORING_OP_RECV that
+ *    takes a buffer from a registered provided-buffer ring, so the event
+ *    arrives with the data and zv_epoll_read() only copies it out.
+ * Completions are folded into per-fd state first and reported as epoll events
+ * from there; ctl changes only queue SQEs, which go to the kernel together
+ * with the wait in one io_uring_enter().
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "epoll.h"
+#include "dbg.h"
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#if defined(IORING_FEAT_EXT_ARG) && defined(IORING_POLL_ADD_MULTI)
+
+#ifndef IORING_ACCEPT_MULTISHOT
+#define IORING_ACCEPT_MULTISHOT (1U << 0)   /* 5.19; older kernels fail the request */
+#endif
+
+#define ZV_URING_ENTRIES    4096
+/* user_data = op << 62 | seq << 32 | fd; a seq that no longer matches marks a stale completion */
+#define ZV_URING_OP_POLL    0ULL
+#define ZV_URING_OP_RECV    1ULL
+#define ZV_URING_OP_ACCEPT  2ULL
+#define ZV_URING_SEQ_MASK   0x3fffffffu
+#define ZV_URING_IGNORE     UINT64_MAX      /* user_data of cancel requests */
+/* only the readiness bits go to the kernel; the flags are emulated here */
+#define ZV_URING_FLAGS      (EPOLLET | EPOLLONESHOT | EPOLLEXCLUSIVE | EPOLLWAKEUP | ZV_EPOLL_HINTS)
+/* provided buffers for recv: a connection holds at most one, 2MB per reactor */
+#define ZV_URING_BUFS       512
+#define ZV_URING_BUF_SIZE   4096
+#define ZV_URING_BGID       0
+
+/* provided-buffer ring (IORING_REGISTER_PBUF_RING, 5.19+): the register opcodes are enum values */
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t bid;
+    uint16_t resv;      /* bufs[0].resv is the ring tail */
+} zv_uring_buf_t;
+
+typedef struct {
+    uint64_t ring_addr;
+    uint32_t ring_entries;
+    uint16_t bgid;
+    uint16_t flags;
+    uint64_t resv[3];
+} zv_uring_buf_reg_t;
+
+#define ZV_IORING_REGISTER_PBUF_RING    22
+#define ZV_IORING_UNREGISTER_PBUF_RING  23
+#define ZV_IORING_CQE_BUFFER_SHIFT      16
+/* waits for a cancelled multishot accept to finish: 100 x 10ms at most */
+#define ZV_URING_CANCEL_TRIES   100
+#define ZV_URING_CANCEL_MS      10
+
+/* 每个 fd 的注册状态 */
+typedef struct {
+    epoll_data_t data;
+    uint32_t events;    /* registered mask, hints included */
+    uint32_t revents;   /* waiting on the ready list */
+    uint32_t poll_seq;  /* seq of the current poll request */
+    uint32_t epoch;     /* bumped when the registration ends; seq of recv / accept requests */
+    uint32_t boff;      /* received data: bytes [boff, blen) of buffer bid */
+    uint32_t blen;
+    uint16_t bid;
+    uint8_t used;
+    uint8_t fired;      /* ONESHOT registration already reported */
+    uint8_t queued;     /* on the ready list */
+    uint8_t polling;    /* the current poll request is pending */
+    uint8_t recv;       /* ZV_EPOLLRECV: EPOLLIN comes from a recv request */
+    uint8_t recving;
+    uint8_t nobuf;      /* buffer ring ran dry: this round uses poll + read() */
+    uint8_t has_buf;
+    uint8_t eof;
+    uint8_t accept;     /* ZV_EPOLLACCEPT: EPOLLIN comes from a multishot accept */
+    uint8_t accepting;
+    int rerr;           /* errno of a failed recv, returned by the next read */
+} zv_uring_fd_t;
+
+/* fd 队列：待报告的事件、提前接受的连接 */
+typedef struct {
+    int *v;
+    int head;
+    int n;
+    int cap;
+} zv_uring_fdq_t;
+
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail;     /* SQEs filled in locally */
+    unsigned sq_pending;        /* filled in but not yet submitted */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_sz;
+    void *cq_ring;
+    size_t cq_ring_sz;
+} zv_uring_t;
+
+/* 每个 reactor 线程一个 ring（SINGLE_ISSUER：只由创建它的线程提交） */
+static __thread zv_uring_t g_ring = { .fd = -1 };
+static __thread zv_uring_fd_t *g_fds;
+static __thread int g_nfds;
+static __thread zv_uring_fdq_t g_ready;
+/* 一个 reactor 只有一个监听套接字，提前接受的连接都排在这里 */
+static __thread zv_uring_fdq_t g_acceptq;
+static __thread int g_accept_ok = 1;    /* 0 once the kernel rejected multishot accept */
+static __thread zv_uring_buf_t *g_br;  /* NULL: recv requests off */
+static __thread char *g_bufs;
+static __thread unsigned g_br_tail;
+
+static int fdq_push(zv_uring_fdq_t *q, int fd) {
+    if (q->n == q->cap) {
+        if (q->head > 0) {
+            memmove(q->v, q->v + q->head, sizeof(int) * (size_t)(q->n - q->head));
+            q->n -= q->head;
+            q->head = 0;
+        } else {
+            int cap = q->cap ? q->cap * 2 : 256;
+            int *p = (int *)realloc(q->v, sizeof(int) * (size_t)cap);
+            if (!p) {
+                return -1;
+            }
+            q->v = p;
+            q->cap = cap;
+        }
+    }
+    q->v[q->n++] = fd;
+    return 0;
+}
+
+static int fdq_pop(zv_uring_fdq_t *q) {
+    if (q->head == q->n) {
+        return -1;
+    }
+    int fd = q->v[q->head++];
+    if (q->head == q->n) {
+        q->head = q->n = 0;
+    }
+    return fd;
+}
+
+static void fdq_free(zv_uring_fdq_t *q) {
+    free(q->v);
+    memset(q, 0, sizeof(*q));
+}
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, g_ring.fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+// 内核（非 SQPOLL）在 io_uring_enter 里消费 SQE 并推进 head
+static void uring_sync_pending(void) {
+    zv_uring_t *q = &g_ring;
+    q->sq_pending = q->sq_local_tail - __atomic_load_n(q->sq_head, __ATOMIC_ACQUIRE);
+}
+
+// 把本地已填好的 SQE 交给内核（不等待）
+static int uring_submit(void) {
+    zv_uring_t *q = &g_ring;
+    if (q->sq_pending == 0) {
+        return 0;
+    }
+    int n = uring_enter(q->sq_pending, 0, 0, NULL, 0);
+    uring_sync_pending();
+    return (n < 0) ? -1 : 0;
+}
+
+// 提交积攒的 SQE，同时等待 wait_nr 个完成事件（timeout_ms < 0 不限时），只用一次系统调用
+static int uring_submit_and_wait(unsigned wait_nr, int timeout_ms) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    int n = uring_enter(g_ring.sq_pending, wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    uring_sync_pending();
+    return n;
+}
+
+static struct io_uring_sqe *uring_get_sqe(void) {
+    zv_uring_t *q = &g_ring;
+    unsigned head = __atomic_load_n(q->sq_head, __ATOMIC_ACQUIRE);
+    if (q->sq_local_tail - head >= q->sq_entries) {
+        // SQ 满了：先提交一批再拿
+        if (uring_submit() < 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(q->sq_head, __ATOMIC_ACQUIRE);
+        if (q->sq_local_tail - head >= q->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &q->sqes[q->sq_local_tail & q->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void uring_push_sqe(void) {
+    zv_uring_t *q = &g_ring;
+    q->sq_local_tail++;
+    q->sq_pending++;
+    __atomic_store_n(q->sq_tail, q->sq_local_tail, __ATOMIC_RELEASE);
+}
+
+static zv_uring_fd_t *uring_fd_slot(int fd) {
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fd >= g_nfds) {
+        int n = g_nfds ? g_nfds : 1024;
+        while (n <= fd) n *= 2;
+        zv_uring_fd_t *p = (zv_uring_fd_t *)realloc(g_fds, sizeof(zv_uring_fd_t) * (size_t)n);
+        if (!p) {
+            return NULL;
+        }
+        memset(p + g_nfds, 0, sizeof(zv_uring_fd_t) * (size_t)(n - g_nfds));
+        g_fds = p;
+        g_nfds = n;
+    }
+    return &g_fds[fd];
+}
+
+static uint64_t uring_user_data(uint64_t op, uint32_t seq, int fd) {
+    return (op << 62) | ((uint64_t)(seq & ZV_URING_SEQ_MASK) << 32) | (uint32_t)fd;
+}
+
+// 把缓冲区还给内核
+static void uring_buf_put(unsigned bid) {
+    zv_uring_buf_t *b = &g_br[g_br_tail & (ZV_URING_BUFS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(g_bufs + (size_t)bid * ZV_URING_BUF_SIZE);
+    b->len = ZV_URING_BUF_SIZE;
+    b->bid = (uint16_t)bid;
+    g_br_tail++;
+    __atomic_store_n(&g_br[0].resv, (uint16_t)g_br_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_cancel_request(uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = user_data;
+        sqe->user_data = ZV_URING_IGNORE;
+        uring_push_sqe();
+    }
+}
+
+static void uring_cancel_poll(int fd, zv_uring_fd_t *f) {
+    if (f->polling) {
+        uring_cancel_request(uring_user_data(ZV_URING_OP_POLL, f->poll_seq, fd));
+        f->polling = 0;
+    }
+}
+
+// 记下事件等 wait 报告；ONESHOT 的注册报告过一次就不再报，直到重新挂上
+static void uring_queue(int fd, zv_uring_fd_t *f, uint32_t ev) {
+    if (!f->used || f->fired) {
+        return;
+    }
+    if (f->events & EPOLLONESHOT) {
+        f->fired = 1;
+    }
+    f->revents |= ev;
+    if (!f->queued) {
+        if (fdq_push(&g_ready, fd) < 0) {
+            log_err("io_uring ready list alloc failed, fd=%d", fd);
+            return;
+        }
+        f->queued = 1;
+    }
+}
+
+static int uring_start_recv(int fd, zv_uring_fd_t *f) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (!sqe) {
+        errno = EBUSY;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = ZV_URING_BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = ZV_URING_BGID;
+    sqe->user_data = uring_user_data(ZV_URING_OP_RECV, f->epoch, fd);
+    uring_push_sqe();
+    f->recving = 1;
+    return 0;
+}
+
+static int uring_start_accept(int fd, zv_uring_fd_t *f) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (!sqe) {
+        errno = EBUSY;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = uring_user_data(ZV_URING_OP_ACCEPT, f->epoch, fd);
+    uring_push_sqe();
+    f->accepting = 1;
+    return 0;
+}
+
+// 按注册挂上请求：EPOLLIN 由 recv / accept 代劳时 poll 只管剩下的位，已经缓存了结果就直接就绪
+static int uring_arm(int fd, zv_uring_fd_t *f) {
+    uint32_t mask = f->events & ~(uint32_t)ZV_URING_FLAGS;
+    int served = 0;
+
+    if ((mask & EPOLLIN) && f->recv && !f->nobuf) {
+        mask &= ~(uint32_t)EPOLLIN;
+        served = 1;
+        if (f->has_buf || f->eof || f->rerr) {
+            uring_queue(fd, f, f->rerr ? (EPOLLIN | EPOLLERR) : EPOLLIN);
+        } else if (!f->recving && uring_start_recv(fd, f) < 0) {
+            return -1;
+        }
+    }
+    if ((mask & EPOLLIN) && f->accept) {
+        mask &= ~(uint32_t)EPOLLIN;
+        served = 1;
+        if (!f->accepting && uring_start_accept(fd, f) < 0) {
+            return -1;
+        }
+        if (g_acceptq.head != g_acceptq.n) {
+            uring_queue(fd, f, EPOLLIN);
+        }
+    }
+    if ((served && !mask) || f->fired || f->polling) {
+        return 0;
+    }
+
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (!sqe) {
+        errno = EBUSY;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    // 非 ONESHOT 的注册（eventfd 等，都是 ET）用 multishot，每次唤醒产生一个完成事件
+    if (!(f->events & EPOLLONESHOT)) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    f->poll_seq++;
+    sqe->user_data = uring_user_data(ZV_URING_OP_POLL, f->poll_seq, fd);
+    uring_push_sqe();
+    f->polling = 1;
+    return 0;
+}
+
+static void uring_reap(void);
+
+/*
+ * 同步停掉 multishot accept：返回时已经接受的连接都进了队列，io_uring 也不再
+ * 引用监听套接字，之后的 accept4 和 close 与 epoll 下一样（排空时靠这个把排队的连接接走而不是重置）
+ */
+static void uring_stop_accept(int fd, zv_uring_fd_t *f) {
+    int i;
+    f->accept = 0;
+    uring_cancel_request(uring_user_data(ZV_URING_OP_ACCEPT, f->epoch, fd));
+    for (i = 0; f->accepting && i < ZV_URING_CANCEL_TRIES; i++) {
+        if (uring_submit_and_wait(1, ZV_URING_CANCEL_MS) < 0 && errno != ETIME && errno != EINTR &&
+            errno != EBUSY && errno != EAGAIN) {
+            break;
+        }
+        uring_reap();
+    }
+    if (f->accepting) {
+        log_warn("io_uring accept on fd %d not cancelled, errno=%d", fd, errno);
+        f->accepting = 0;
+    }
+}
+
+// 注册结束：取消挂着的请求，没读走的数据作废；换代后迟到的完成事件会被丢弃
+static void uring_release(int fd, zv_uring_fd_t *f) {
+    uring_cancel_poll(fd, f);
+    if (f->recving) {
+        uring_cancel_request(uring_user_data(ZV_URING_OP_RECV, f->epoch, fd));
+    }
+    if (f->accepting) {
+        uring_stop_accept(fd, f);
+    }
+    if (f->has_buf) {
+        uring_buf_put(f->bid);
+    }
+    f->epoch++;
+    f->used = 0;
+    f->revents = 0;     /* a ready list entry, if any, is skipped */
+    f->fired = 0;
+    f->recv = 0;
+    f->recving = 0;
+    f->nobuf = 0;
+    f->has_buf = 0;
+    f->eof = 0;
+    f->rerr = 0;
+    f->accept = 0;
+}
+
+static void uring_poll_done(int fd, zv_uring_fd_t *f, uint32_t seq, int32_t res, uint32_t cflags) {
+    if (!f->used || !f->polling || seq != (f->poll_seq & ZV_URING_SEQ_MASK)) {
+        return;     /* completion of a cancelled / replaced poll */
+    }
+    if (!(cflags & IORING_CQE_F_MORE)) {
+        f->polling = 0;
+        // multishot 被内核终止（例如 CQ 溢出）：非 ONESHOT 的注册要重新挂上
+        if (!(f->events & EPOLLONESHOT)) {
+            (void)uring_arm(fd, f);
+        }
+    }
+    if (res == -ECANCELED) {
+        return;
+    }
+    uring_queue(fd, f, (res < 0) ? EPOLLERR : (uint32_t)res);
+}
+
+static void uring_recv_done(int fd, zv_uring_fd_t *f, uint32_t seq, int32_t res, uint32_t cflags) {
+    int bid = (cflags & IORING_CQE_F_BUFFER) ? (int)(cflags >> ZV_IORING_CQE_BUFFER_SHIFT) : -1;
+    if (!f->used || !f->recving || seq != (f->epoch & ZV_URING_SEQ_MASK)) {
+        if (bid >= 0) {
+            uring_buf_put((unsigned)bid);
+        }
+        return;
+    }
+    f->recving = 0;
+    if (res > 0 && bid >= 0) {
+        f->has_buf = 1;
+        f->bid = (uint16_t)bid;
+        f->boff = 0;
+        f->blen = (uint32_t)res;
+    } else {
+        if (bid >= 0) {
+            uring_buf_put((unsigned)bid);
+        }
+        if (res == -ENOBUFS) {
+            // 缓冲区都借出去了：这一轮退回 poll + read()
+            f->nobuf = 1;
+            if ((f->events & EPOLLIN) && !f->fired) {
+                uring_cancel_poll(fd, f);
+                (void)uring_arm(fd, f);
+            }
+            return;
+        }
+        if (res == -ECANCELED) {
+            return;
+        }
+        if (res == 0) {
+            f->eof = 1;
+        } else {
+            f->rerr = -res;
+        }
+    }
+    // 注册当前不要 EPOLLIN（例如在等 EPOLLOUT）时先存着，重新为 EPOLLIN 挂上时再报告
+    if (f->events & EPOLLIN) {
+        uring_queue(fd, f, f->rerr ? (EPOLLIN | EPOLLERR) : EPOLLIN);
+    }
+}
+
+static void uring_accept_done(int fd, zv_uring_fd_t *f, uint32_t seq, int32_t res, uint32_t cflags) {
+    if (res >= 0) {
+        // 注册已经撤掉的也照样排队：调用方随后的 zv_epoll_accept 会把它接走
+        if (fdq_push(&g_acceptq, res) < 0) {
+            log_err("io_uring accept queue alloc failed");
+            close(res);
+        } else if (f->used && f->accept) {
+            uring_queue(fd, f, EPOLLIN);
+        }
+    }
+    if ((cflags & IORING_CQE_F_MORE) || !f->accepting || seq != (f->epoch & ZV_URING_SEQ_MASK)) {
+        return;
+    }
+    f->accepting = 0;
+    if (!f->accept) {
+        return;     /* stopped by uring_stop_accept */
+    }
+    if (res < 0 && res != -ECANCELED) {
+        // 5.19 之前的内核不认 multishot accept（EINVAL），其他错误只让这个注册退回 poll + accept4
+        log_warn("io_uring multishot accept ended, errno=%d; falling back to poll + accept4", -res);
+        if (res == -EINVAL) {
+            g_accept_ok = 0;
+        }
+        f->accept = 0;
+    }
+    if (f->used) {
+        (void)uring_arm(fd, f);
+    }
+}
+
+// 把完成事件折算进各 fd 的状态，需要报告的进就绪队列
+static void uring_reap(void) {
+    zv_uring_t *q = &g_ring;
+    unsigned head = *q->cq_head;
+    unsigned tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &q->cqes[head & q->cq_mask];
+        uint64_t ud = cqe->user_data;
+        int32_t res = cqe->res;
+        uint32_t cflags = cqe->flags;
+        head++;
+
+        if (ud == ZV_URING_IGNORE) {
+            continue;
+        }
+        int fd = (int)(uint32_t)ud;
+        uint32_t seq = (uint32_t)(ud >> 32) & ZV_URING_SEQ_MASK;
+        uint64_t op = ud >> 62;
+        if (fd < 0 || fd >= g_nfds) {
+            continue;
+        }
+        zv_uring_fd_t *f = &g_fds[fd];
+        if (op == ZV_URING_OP_RECV) {
+            uring_recv_done(fd, f, seq, res, cflags);
+        } else if (op == ZV_URING_OP_ACCEPT) {
+            uring_accept_done(fd, f, seq, res, cflags);
+        } else {
+            uring_poll_done(fd, f, seq, res, cflags);
+        }
+    }
+    __atomic_store_n(q->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void uring_unmap(void) {
+    zv_uring_t *q = &g_ring;
+    if (q->sqes && q->sqes != MAP_FAILED) {
+        munmap(q->sqes, q->sq_entries * sizeof(struct io_uring_sqe));
+    }
+    if (q->cq_ring && q->cq_ring != MAP_FAILED && q->cq_ring != q->sq_ring) {
+        munmap(q->cq_ring, q->cq_ring_sz);
+    }
+    if (q->sq_ring && q->sq_ring != MAP_FAILED) {
+        munmap(q->sq_ring, q->sq_ring_sz);
+    }
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+}
+
+// 注册 recv 用的缓冲区环；内核太旧（5.19 之前）时连接照旧用 poll + read()
+static void uring_setup_bufs(int fd) {
+    size_t ring_sz = ZV_URING_BUFS * sizeof(zv_uring_buf_t);
+    size_t bufs_sz = (size_t)ZV_URING_BUFS * ZV_URING_BUF_SIZE;
+    void *br = mmap(NULL, ring_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *bufs = mmap(NULL, bufs_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    zv_uring_buf_reg_t reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)br;
+    reg.ring_entries = ZV_URING_BUFS;
+    reg.bgid = ZV_URING_BGID;
+    if (br == MAP_FAILED || bufs == MAP_FAILED ||
+        syscall(__NR_io_uring_register, fd, ZV_IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        log_warn("io_uring provided buffers unavailable, errno=%d; connections use poll + read()", errno);
+        if (br != MAP_FAILED) munmap(br, ring_sz);
+        if (bufs != MAP_FAILED) munmap(bufs, bufs_sz);
+        return;
+    }
+    g_br = (zv_uring_buf_t *)br;
+    g_bufs = (char *)bufs;
+    g_br_tail = 0;
+    unsigned i;
+    for (i = 0; i < ZV_URING_BUFS; i++) {
+        uring_buf_put(i);
+    }
+}
+
+// 先注销缓冲区环（之后内核不会再往里写），再释放内存
+static void uring_free_bufs(int fd) {
+    if (!g_br) {
+        return;
+    }
+    zv_uring_buf_reg_t reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = ZV_URING_BGID;
+    (void)syscall(__NR_io_uring_register, fd, ZV_IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(g_br, ZV_URING_BUFS * sizeof(zv_uring_buf_t));
+    munmap(g_bufs, (size_t)ZV_URING_BUFS * ZV_URING_BUF_SIZE);
+    g_br = NULL;
+    g_bufs = NULL;
+}
+
+static int uring_backend_create(int flags) {
+    (void)flags;    /* the ring fd is always close-on-exec */
+    zv_uring_t *q = &g_ring;
+    struct io_uring_params p;
+
+    // 单线程提交 + 只在 io_uring_enter 里跑完成回调，失败时（旧内核）退回默认参数
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_CQSIZE;
+    p.cq_entries = ZV_URING_ENTRIES * 4;
+    int fd = (int)syscall(__NR_io_uring_setup, ZV_URING_ENTRIES, &p);
+    if (fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = ZV_URING_ENTRIES * 4;
+        fd = (int)syscall(__NR_io_uring_setup, ZV_URING_ENTRIES, &p);
+    }
+    if (fd < 0) {
+        log_warn("io_uring_setup failed, errno=%d", errno);
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        log_warn("io_uring lacks EXT_ARG/NODROP (features=0x%x)", p.features);
+        close(fd);
+        return -1;
+    }
+    q->fd = fd;
+
+    q->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    q->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (q->cq_ring_sz > q->sq_ring_sz) q->sq_ring_sz = q->cq_ring_sz;
+        q->cq_ring_sz = q->sq_ring_sz;
+    }
+    q->sq_ring = mmap(NULL, q->sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (q->sq_ring == MAP_FAILED) {
+        goto err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        q->cq_ring = q->sq_ring;
+    } else {
+        q->cq_ring = mmap(NULL, q->cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (q->cq_ring == MAP_FAILED) {
+            goto err;
+        }
+    }
+    q->sqes = (struct io_uring_sqe *)mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (q->sqes == MAP_FAILED) {
+        goto err;
+    }
+
+    char *sq = (char *)q->sq_ring;
+    char *cq = (char *)q->cq_ring;
+    q->sq_head = (unsigned *)(sq + p.sq_off.head);
+    q->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    q->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    q->sq_entries = p.sq_entries;
+    q->sq_array = (unsigned *)(sq + p.sq_off.array);
+    q->cq_head = (unsigned *)(cq + p.cq_off.head);
+    q->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    q->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    q->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    q->sq_local_tail = *q->sq_tail;
+    q->sq_pending = 0;
+
+    // SQ 下标数组固定为恒等映射，之后只需推进 tail
+    unsigned i;
+    for (i = 0; i < q->sq_entries; i++) {
+        q->sq_array[i] = i;
+    }
+    uring_setup_bufs(fd);
+    return fd;
+
+err:
+    log_warn("io_uring ring mmap failed, errno=%d", errno);
+    uring_unmap();
+    close(fd);
+    return -1;
+}
+
+static int uring_backend_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    (void)epfd;
+    zv_uring_fd_t *f = uring_fd_slot(fd);
+    if (!f) {
+        errno = (fd < 0) ? EBADF : ENOMEM;
+        return -1;
+    }
+
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        if (f->used) {
+            uring_release(fd, f);   /* fd number reused without a close through us */
+        }
+        f->recv = (event->events & ZV_EPOLLRECV) && g_br != NULL;
+        f->accept = (event->events & ZV_EPOLLACCEPT) && g_accept_ok;
+        /* fall through */
+    case EPOLL_CTL_MOD:
+        // 旧的 poll 还挂着就先取消，换代后它的完成事件会被丢弃；recv / accept 请求跨 MOD 保留
+        uring_cancel_poll(fd, f);
+        f->used = 1;
+        f->fired = 0;
+        f->nobuf = 0;
+        f->events = event->events;
+        f->data = event->data;
+        return uring_arm(fd, f);
+    case EPOLL_CTL_DEL:
+        if (f->used) {
+            uring_release(fd, f);
+        }
+        return 0;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+static int uring_backend_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    (void)epfd;
+    zv_uring_t *q = &g_ring;
+
+    int ready = (g_ready.head != g_ready.n) ||
+                (*q->cq_head != __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE));
+    // 提交积攒的 SQE，同时（没有现成事件时）等待，只用一次系统调用
+    if (!ready || q->sq_pending > 0) {
+        int n = uring_submit_and_wait((!ready && timeout != 0) ? 1 : 0, timeout);
+        // ETIME 是超时，EBUSY/EAGAIN 是 CQ 暂满，都照常收割；EINTR 交给调用方
+        if (n < 0 && errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+            return -1;
+        }
+    }
+    uring_reap();
+
+    int nev = 0;
+    while (nev < maxevents) {
+        int fd = fdq_pop(&g_ready);
+        if (fd < 0) {
+            break;
+        }
+        zv_uring_fd_t *f = &g_fds[fd];
+        f->queued = 0;
+        if (!f->used || !f->revents) {
+            continue;
+        }
+        events[nev].events = f->revents;
+        events[nev].data = f->data;
+        f->revents = 0;
+        nev++;
+    }
+    return nev;
+}
+
+// 先排队取消挂着的请求（下次 io_uring_enter 时生效），再关闭
+static int uring_backend_close(int epfd, int fd) {
+    (void)epfd;
+    if (fd >= 0 && fd < g_nfds && g_fds[fd].used) {
+        uring_release(fd, &g_fds[fd]);
+    }
+    return close(fd);
+}
+
+// 先交出提前接受的连接；multishot accept 还挂着时队列空就是 EAGAIN，否则（被撤掉或退回了 poll）直接 accept4
+static int uring_backend_accept(int epfd, int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    (void)epfd;
+    int infd = fdq_pop(&g_acceptq);
+    if (infd >= 0) {
+        if (addrlen) {
+            *addrlen = 0;   /* multishot accept does not report the peer address */
+        }
+        return infd;
+    }
+    if (fd >= 0 && fd < g_nfds && g_fds[fd].used && g_fds[fd].accepting) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+// 从 recv 收到的缓冲区里拷出数据；没有数据就是 EAGAIN，下次为 EPOLLIN 挂上注册时再发 recv
+static ssize_t uring_backend_read(int epfd, int fd, void *buf, size_t len) {
+    (void)epfd;
+    zv_uring_fd_t *f = (fd >= 0 && fd < g_nfds) ? &g_fds[fd] : NULL;
+    if (!f || !f->used || !f->recv) {
+        return read(fd, buf, len);
+    }
+    if (f->has_buf) {
+        size_t n = f->blen - f->boff;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(buf, g_bufs + (size_t)f->bid * ZV_URING_BUF_SIZE + f->boff, n);
+        f->boff += (uint32_t)n;
+        if (f->boff == f->blen) {
+            f->has_buf = 0;
+            uring_buf_put(f->bid);
+        }
+        return (ssize_t)n;
+    }
+    if (f->nobuf) {
+        return read(fd, buf, len);
+    }
+    if (f->eof) {
+        return 0;
+    }
+    if (f->rerr) {
+        errno = f->rerr;
+        return -1;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+/* struct io_uring_napi / IORING_REGISTER_NAPI (6.9+); older headers lack them */
+typedef struct {
+    uint32_t busy_poll_to;
+    uint8_t prefer_busy_poll;
+    uint8_t pad[3];
+    uint64_t resv;
+} zv_uring_napi_t;
+
+#define ZV_IORING_REGISTER_NAPI 27
+
+// 注册 NAPI 忙轮询：等待完成事件时先轮询这些套接字所在的网卡队列
+static int uring_backend_busy_poll(int epfd, int usecs) {
+    zv_uring_napi_t napi;
+    memset(&napi, 0, sizeof(napi));
+    napi.busy_poll_to = (uint32_t)usecs;
+    napi.prefer_busy_poll = 1;
+    return (int)syscall(__NR_io_uring_register, epfd, ZV_IORING_REGISTER_NAPI, &napi, 1);
+}
+
+static void uring_backend_destroy(int epfd) {
+    int fd;
+    // 提前接受、还没交出去的连接
+    while ((fd = fdq_pop(&g_acceptq)) >= 0) {
+        close(fd);
+    }
+    fdq_free(&g_acceptq);
+    fdq_free(&g_ready);
+    uring_free_bufs(epfd);
+    uring_unmap();
+    close(epfd);
+    free(g_fds);
+    g_fds = NULL;
+    g_nfds = 0;
+}
+
+#else   /* headers too old for this backend */
+
+static int uring_backend_create(int flags) {
+    (void)flags;
+    log_warn("io_uring backend not compiled in (kernel headers too old)");
+    return -1;
+}
+
+static int uring_backend_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    (void)epfd; (void)op; (void)fd; (void)event;
+    errno = ENOSYS;
+    return -1;
+}
+
+static int uring_backend_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    (void)epfd; (void)events; (void)maxevents; (void)timeout;
+    errno = ENOSYS;
+    return -1;
+}
+
+static int uring_backend_close(int epfd, int fd) {
+    (void)epfd;
+    return close(fd);
+}
+
+static void uring_backend_destroy(int epfd) {
+    close(epfd);
+}
+
+static int uring_backend_busy_poll(int epfd, int usecs) {
+    (void)epfd; (void)usecs;
+    errno = ENOSYS;
+    return -1;
+}
+
+static int uring_backend_accept(int epfd, int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    (void)epfd;
+    return accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+static ssize_t uring_backend_read(int epfd, int fd, void *buf, size_t len) {
+    (void)epfd;
+    return read(fd, buf, len);
+}
+
+#endif
+
+const zv_event_backend_t zv_event_uring = {
+    "io_uring",
+    uring_backend_create,
+    uring_backend_ctl,
+    uring_backend_wait,
+    uring_backend_close,
+    uring_backend_destroy,
+    uring_backend_busy_poll,
+    uring_backend_accept,
+    uring_backend_read,
+};
@@ -0,0 +1,172 @@
+/*
+ * Static file lookup (stat + docroot check) and a small per-process cache
+ * of its results, so hot files skip the lookup on the event loop.
+ */
+
+#include "file_cache.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "timer.h"
+#include "stats.h"
+
+#ifndef ZV_FILE_CACHE_SLOTS
+#define ZV_FILE_CACHE_SLOTS 512     /* power of two, direct-mapped */
+#endif
+#define ZV_FILE_CACHE_PATH_MAX 256  /* longer paths are simply not cached */
+
+typedef struct {
+    uint32_t hash;
+    size_t expire_msec;             /* 0 = empty slot */
+    zv_file_meta_t meta;
+    char path[ZV_FILE_CACHE_PATH_MAX];
+} zv_file_cache_slot_t;
+
+/* 每个 reactor 线程一份，只在它自己的事件循环里访问，不需要加锁 */
+static __thread zv_file_cache_slot_t *g_slots;
+static __thread size_t g_ttl_ms;
+
+// FNV-1a
+static uint32_t path_hash(const char *s, size_t *len) {
+    uint32_t h = 2166136261u;
+    const char *p = s;
+    for (; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    *len = (size_t)(p - s);
+    return h;
+}
+
+// 检查路径 path 是否在根目录 root 下（防止目录遍历攻击）
+int zv_path_under_root(const char *root, const char *path) {
+    char root_real[PATH_MAX];
+    char path_real[PATH_MAX];
+
+    if (!root || !path) return 0;
+    //realpath它把混乱的、带欺骗性的路径，转换成唯一的、绝对的物理路径。
+    //如果 path 是 /var/www/html/../../etc/passwd，realpath 会把它变成 /etc/passwd。
+    //如果 path 是 /var/www/html/link_to_secret（一个指向外部的软链接），realpath 会直接解析出它指向的真实地址。
+    if (!realpath(root, root_real)) return 0;
+    if (!realpath(path, path_real)) return 0;
+
+    size_t rlen = strlen(root_real);
+    //拿到两个真实路径后，检查 path_real 是否以 root_real 开头。
+    if (strncmp(path_real, root_real, rlen) != 0) return 0;
+    //边界检查（防止“前缀伪造”攻击）防止strncmp 会比较前 9 个字符（/data/web），发现两者完全一样！于是函数可能错误地返回 1。
+    if (path_real[rlen] == '\0' || path_real[rlen] == '/') return 1;
+    return 0;
+}
+
+// 可能阻塞（NFS / 繁忙磁盘）：在辅助线程或缓存未命中时调用
+void zv_file_lookup(const char *root, const char *filename, zv_file_meta_t *meta) {
+    struct stat sbuf;
+    memset(meta, 0, sizeof(*meta));
+    //获取文件状态
+    if (stat(filename, &sbuf) < 0) {
+        meta->status = ZV_FILE_NOT_FOUND;
+        return;
+    }
+    //检查文件路径是否在根目录下
+    if (!zv_path_under_root(root, filename)) {
+        meta->status = ZV_FILE_OUTSIDE_ROOT;
+        return;
+    }
+    //判断是否为普通文件  并且当前用户是否有读取权限
+    if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) {
+        meta->status = ZV_FILE_NOT_READABLE;
+        return;
+    }
+    meta->status = ZV_FILE_OK;
+    meta->size = sbuf.st_size;
+    meta->mtime = sbuf.st_mtime;
+    meta->dev = sbuf.st_dev;
+    meta->ino = sbuf.st_ino;
+}
+
+// stat 和 open 之间（或缓存的 TTL 内）文件可能被截断、改写或替换：以打开的 fd 为准
+int zv_file_open(const char *filename, zv_file_meta_t *meta, int *changed) {
+    struct stat sbuf;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    if (changed) {
+        *changed = (sbuf.st_size != meta->size || sbuf.st_mtime != meta->mtime ||
+                    sbuf.st_dev != meta->dev || sbuf.st_ino != meta->ino);
+    }
+    meta->size = sbuf.st_size;
+    meta->mtime = sbuf.st_mtime;
+    meta->dev = sbuf.st_dev;
+    meta->ino = sbuf.st_ino;
+    return fd;
+}
+
+void zv_file_cache_init(size_t ttl_ms) {
+    g_ttl_ms = ttl_ms;
+    if (ttl_ms == 0 || g_slots) {
+        return;
+    }
+    g_slots = (zv_file_cache_slot_t *)calloc(ZV_FILE_CACHE_SLOTS, sizeof(zv_file_cache_slot_t));
+}
+
+int zv_file_cache_get(const char *filename, zv_file_meta_t *meta) {
+    if (!g_slots) {
+        return -1;
+    }
+    ZV_STAT_INC(file_cache_get);
+    size_t len;
+    uint32_t h = path_hash(filename, &len);
+    zv_file_cache_slot_t *s = &g_slots[h & (ZV_FILE_CACHE_SLOTS - 1)];
+    if (s->expire_msec == 0 || s->hash != h || zv_current_msec >= s->expire_msec) {
+        return -1;
+    }
+    if (len >= sizeof(s->path) || memcmp(s->path, filename, len + 1) != 0) {
+        return -1;
+    }
+    ZV_STAT_INC(file_cache_hit);
+    *meta = s->meta;
+    return 0;
+}
+
+void zv_file_cache_put(const char *filename, const zv_file_meta_t *meta) {
+    if (!g_slots) {
+        return;
+    }
+    size_t len;
+    uint32_t h = path_hash(filename, &len);
+    if (len >= ZV_FILE_CACHE_PATH_MAX) {
+        return;
+    }
+    // 直接映射：冲突时新结果覆盖旧结果
+    zv_file_cache_slot_t *s = &g_slots[h & (ZV_FILE_CACHE_SLOTS - 1)];
+    s->hash = h;
+    s->meta = *meta;
+    memcpy(s->path, filename, len + 1);
+    s->expire_msec = zv_current_msec + g_ttl_ms;
+}
+
+void zv_file_cache_drop(const char *filename) {
+    if (!g_slots) {
+        return;
+    }
+    size_t len;
+    uint32_t h = path_hash(filename, &len);
+    zv_file_cache_slot_t *s = &g_slots[h & (ZV_FILE_CACHE_SLOTS - 1)];
+    if (s->hash == h && len < sizeof(s->path) && memcmp(s->path, filename, len + 1) == 0) {
+        s->expire_msec = 0;
+    }
+}
+
+void zv_file_cache_release(void) {
+    free(g_slots);
+    g_slots = NULL;
+}
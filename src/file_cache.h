@@ -0,0 +1,47 @@
+/*
+ * Static file lookup (stat + docroot check) and a small per-reactor cache
+ * of its results, so hot files skip the lookup on the event loop.
+ */
+
+#ifndef ZV_FILE_CACHE_H
+#define ZV_FILE_CACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* zv_file_meta_t.status */
+#define ZV_FILE_OK               0
+#define ZV_FILE_NOT_FOUND        1  /* stat() failed */
+#define ZV_FILE_OUTSIDE_ROOT     2  /* resolves outside the docroot */
+#define ZV_FILE_NOT_READABLE     3  /* not a regular file readable by the owner */
+
+typedef struct {
+    int status;
+    off_t size;
+    time_t mtime;
+    dev_t dev;                      /* identify the file, so a replaced one is noticed */
+    ino_t ino;
+} zv_file_meta_t;
+
+/* Blocking: stat filename and check it stays under root (realpath). */
+void zv_file_lookup(const char *root, const char *filename, zv_file_meta_t *meta);
+/* 1 when path resolves to root or below it */
+int zv_path_under_root(const char *root, const char *path);
+/*
+ * Open a file zv_file_lookup found and fstat the fd; meta is refreshed from
+ * the opened file, *changed (if not NULL) is set when that differed from
+ * what meta said. return: fd, -1 if it cannot be opened as a regular file
+ */
+int zv_file_open(const char *filename, zv_file_meta_t *meta, int *changed);
+
+/* Results are kept for ttl_ms (0 disables the cache). */
+void zv_file_cache_init(size_t ttl_ms);
+/* 0 hit (meta filled), -1 miss or expired */
+int zv_file_cache_get(const char *filename, zv_file_meta_t *meta);
+void zv_file_cache_put(const char *filename, const zv_file_meta_t *meta);
+/* Forget filename (its entry turned out to be stale). */
+void zv_file_cache_drop(const char *filename);
+void zv_file_cache_release(void);
+
+#endif
@@ -13,17 +13,25 @@
 #include <limits.h>
 #include <stdarg.h>
 #include <errno.h>
-#include <sys/uio.h>
-#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include "http.h"
 #include "http_parse.h"
 #include "http_request.h"
 #include "epoll.h"
+#include "aio.h"
+#include "file_cache.h"
 #include "error.h"
 #include "timer.h"
 #include "cgi.h"
+#include "stats.h"
+#include "metrics.h"
+#include "zv_probes.h"
+#include "zv_signal.h"
 /**
  * buf: 目标缓冲区（例如 header 或 body）
  * cap: 缓冲区总容量（通常是 sizeof(header)）
@@ -69,115 +77,236 @@ static void log_send_failed(const char *where, int fd) {
 // 复位记录输出相关状态的字段
 static void reset_output(zv_http_request_t *r) {
     r->writing = 0;
-
-    r->out_header_len = 0;
-    r->out_header_sent = 0;
-    r->out_header[0] = '\0';
-    // 因为body是动态分配的，所以需要释放输出 body 相关资源
-    if (r->out_body) {
-        free(r->out_body);
-        r->out_body = NULL;
-    }
-    r->out_body_len = 0;
-    r->out_body_sent = 0;
-    // 关闭文件描述符并复位相关字段
-    if (r->out_file_fd >= 0) {
-        close(r->out_file_fd);
-        r->out_file_fd = -1;
-    }
-    r->out_file_offset = 0;
-    r->out_file_size = 0;
+    // 丢弃输出链上未发送的段（文件段会关闭自己的 fd）
+    zv_out_chain_reset(&r->out);
 }
-//发送响应 尝试发送所有数据
-// 返回值: 0表示发送完成，1表示未完成需继续发送，-1表示发送出错
+//发送响应 尝试发送输出链上的所有数据
+// 返回值: 0表示发送完成，1表示未完成需继续发送（EAGAIN），
+//        2表示本轮发送配额用完需让出，-1表示发送出错
 static int try_send(zv_http_request_t *r) {
-    /* header + optional in-memory body using writev */
-    // 发送头部 如果要发body也一并发送
-    while (r->out_header_sent < r->out_header_len || (r->out_body && r->out_body_sent < r->out_body_len)) 
-    {
-        struct iovec iov[2];
-        int iovcnt = 0;
-        // 发送头部
-        if (r->out_header_sent < r->out_header_len) {
-            iov[iovcnt].iov_base = r->out_header + r->out_header_sent;
-            iov[iovcnt].iov_len = r->out_header_len - r->out_header_sent;
-            iovcnt++;
-        }
-        // 如果body不为空 则发送 body
-        if (r->out_body && r->out_body_sent < r->out_body_len) {
-            iov[iovcnt].iov_base = r->out_body + r->out_body_sent;
-            iov[iovcnt].iov_len = r->out_body_len - r->out_body_sent;
-            iovcnt++;
-        }
-        // 使用 writev 发送多个缓冲区
-        // n 表示实际发送的字节数
-        ssize_t n = writev(r->fd, iov, iovcnt);
-        if (n > 0) {
-            ssize_t left = n;
-            //writev 可能没有发送完所有数据，所以需要更新已发送的长度
-            if (r->out_header_sent < r->out_header_len) {
-                size_t hrem = r->out_header_len - r->out_header_sent;// 还剩多少没发送
-                size_t hcons = (left >= (ssize_t)hrem) ? hrem : (size_t)left;// 实际发送了多少
-                r->out_header_sent += hcons;// 更新已发送长度
-                left -= (ssize_t)hcons;
-            }
-            if (left > 0 && r->out_body && r->out_body_sent < r->out_body_len) {
-                size_t brem = r->out_body_len - r->out_body_sent;// 还剩多少没发送
-                size_t bcons = (left >= (ssize_t)brem) ? brem : (size_t)left;// 实际发送了多少
-                r->out_body_sent += bcons;
-                left -= (ssize_t)bcons;
-            }
-            continue;
-        }
-        //？？？？？？？？？？？？？？？？？？？？？？？？？？？？？？
-        if (n == 0) {
-            errno = EPIPE;
-            return -1;
-        }
-
-        if (errno == EINTR) {
-            continue;
+    int rc = zv_out_chain_send(r->fd, &r->out, r->send_quantum);
+    if (rc >= 0) {
+        zv_http_record_sent(r, rc == 0);
+    }
+    return rc;
+}
+/*
+ * Flush everything queued on r->out. Within one response the chain already
+ * sends the header with MSG_MORE ahead of its file body; when several
+ * pipelined responses with file bodies are batched, cork the socket so the
+ * tail of one sendfile and the next header also share segments; uncorking
+ * pushes out the remainder.
+ */
+static int flush_output(zv_http_request_t *r, int queued) {
+    int cork = (queued > 1 && zv_out_chain_has_file(&r->out));
+    int on = 1, off = 0;
+    if (cork && setsockopt(r->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) < 0) {
+        cork = 0;
+    }
+    int rc = try_send(r);
+    if (cork) {
+        (void)setsockopt(r->fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+    return rc;
+}
+/*
+ * Large file bodies get their own send-queue limits; switch back to the
+ * connection values when a later keep-alive response is small again.
+ * SO_SNDBUF cannot be handed back to autotuning, so it is only restored
+ * when the connection-level sndbuf is set.
+ */
+static void tune_send_buffers(zv_http_request_t *r, size_t filesize) {
+    int large = (r->large_file_bytes > 0 && filesize >= r->large_file_bytes);
+    if (large == r->large_tuned) {
+        return;
+    }
+    if (large) {
+        if (r->large_sndbuf > 0 || r->large_notsent_lowat > 0) {
+            (void)zv_set_send_buffers(r->fd, r->large_sndbuf, r->large_notsent_lowat);
+            r->large_tuned = 1;
         }
+        return;
+    }
+    // TCP_NOTSENT_LOWAT 设为 0 会回到系统默认值（net.ipv4.tcp_notsent_lowat）
+    int lowat = r->notsent_lowat;
+#ifdef TCP_NOTSENT_LOWAT
+    if (lowat == 0 && r->large_notsent_lowat > 0) {
+        (void)setsockopt(r->fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+    }
+#endif
+    (void)zv_set_send_buffers(r->fd, r->sndbuf, lowat);
+    r->large_tuned = 0;
+}
+// 修改为输入事件或者输出事件events只能二选一
+static void rearm_event(zv_http_request_t *r, uint32_t events) {
+    struct epoll_event event;
+    event.data.ptr = (void *)r->conn_item;
+    event.events = events | EPOLLET | EPOLLONESHOT;
+    zv_epoll_mod(r->epfd, r->fd, &event);
+}
+/* Cold-file read-in on a helper thread; owns a dup of the segment's fd. */
+typedef struct {
+    zv_aio_task_t task;
+    int fd;
+    off_t offset;
+    size_t len;
+    off_t ra_offset;    /* read-ahead to request once the window is in */
+    size_t ra_len;
+} zv_readin_task_t;
+
+// 辅助线程：把 [offset, offset+len) 读进 page cache，再让内核异步预读后面的窗口
+static void readin_work(zv_aio_task_t *t) {
+    zv_readin_task_t *rt = (zv_readin_task_t *)t;
+    char buf[64 * 1024];
+    off_t off = rt->offset;
+    off_t end = rt->offset + (off_t)rt->len;
+    while (off < end) {
+        size_t want = (size_t)(end - off) < sizeof(buf) ? (size_t)(end - off) : sizeof(buf);
+        ssize_t n = pread(rt->fd, buf, want, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += n;
+    }
+    if (rt->ra_len > 0) {
+        (void)posix_fadvise(rt->fd, rt->ra_offset, (off_t)rt->ra_len, POSIX_FADV_WILLNEED);
+    }
+}
 
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return 1;
-        }
+// 事件循环：读入完成，连接还在就继续发送
+static void readin_done(zv_aio_task_t *t) {
+    zv_readin_task_t *rt = (zv_readin_task_t *)t;
+    zv_http_request_t *r = (zv_http_request_t *)t->data;
+    close(rt->fd);
+    if (r) {
+        r->aio_task = NULL;
+        zv_out_chain_mark_warm(&r->out, rt->offset + (off_t)rt->len);
+        do_write(r);
+    }
+    free(rt);
+}
 
+// 返回 0 表示已交给辅助线程（或已有任务在途），-1 表示只能同步发送
+static int start_readin(zv_http_request_t *r) {
+    if (r->aio_task) {
+        return 0;
+    }
+    int fd;
+    off_t offset;
+    size_t len;
+    if (zv_out_chain_cold_range(&r->out, &fd, &offset, &len) < 0) {
         return -1;
     }
-    // 发送文件
-    while (r->out_file_fd >= 0 && (size_t)r->out_file_offset < r->out_file_size) 
-    {
-        off_t off = r->out_file_offset;
-        size_t remaining = r->out_file_size - (size_t)r->out_file_offset;
-        ssize_t n = sendfile(r->fd, r->out_file_fd, &off, remaining);
+    zv_readin_task_t *rt = (zv_readin_task_t *)malloc(sizeof(zv_readin_task_t));
+    if (!rt) {
+        return -1;
+    }
+    rt->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (rt->fd < 0) {
+        free(rt);
+        return -1;
+    }
+    rt->offset = offset;
+    rt->len = len;
+    if (zv_out_chain_readahead_range(&r->out, offset + (off_t)len, &rt->ra_offset, &rt->ra_len) < 0) {
+        rt->ra_offset = 0;
+        rt->ra_len = 0;
+    }
+    rt->task.work = readin_work;
+    rt->task.done = readin_done;
+    rt->task.data = r;
+    if (zv_aio_post(&rt->task) < 0) {
+        close(rt->fd);
+        free(rt);
+        return -1;
+    }
+    r->aio_task = &rt->task;
+    debug("cold file window fd=%d offset=%ld len=%zu, read in on helper thread", r->fd, (long)offset, len);
+    return 0;
+}
 
-        if (n > 0) {
-            r->out_file_offset = off;
-            continue;
-        }
-        if (n == 0) {
-            r->out_file_offset = off;
-            break;
-        }
-        if (errno == EINTR) {
-            continue;
-        }
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            r->out_file_offset = off;
-            return 1;
+/* Static file lookup (stat + docroot check + open) on a helper thread. */
+typedef struct {
+    zv_aio_task_t task;
+    const char *root;
+    char filename[SHORTLINE];
+    zv_file_meta_t meta;
+    int fd;
+} zv_lookup_task_t;
+
+static void lookup_work(zv_aio_task_t *t) {
+    zv_lookup_task_t *lt = (zv_lookup_task_t *)t;
+    zv_file_lookup(lt->root, lt->filename, &lt->meta);
+    lt->fd = -1;
+    if (lt->meta.status == ZV_FILE_OK) {
+        lt->fd = zv_file_open(lt->filename, &lt->meta, NULL);
+        if (lt->fd < 0) {
+            lt->meta.status = ZV_FILE_NOT_FOUND;
         }
-        return -1;
     }
+}
 
+// 事件循环：结果进缓存；连接还在就带着结果重新进入 do_request
+static void lookup_done(zv_aio_task_t *t) {
+    zv_lookup_task_t *lt = (zv_lookup_task_t *)t;
+    zv_http_request_t *r = (zv_http_request_t *)t->data;
+    zv_file_cache_put(lt->filename, &lt->meta);
+    if (!r) {
+        if (lt->fd >= 0) close(lt->fd);
+        free(lt);
+        return;
+    }
+    r->aio_task = NULL;
+    r->lookup_meta = lt->meta;
+    r->lookup_fd = lt->fd;
+    free(lt);
+    do_request(r);
+}
+
+// 返回 0 表示已交给辅助线程，-1 表示需要同步查找
+static int start_lookup(zv_http_request_t *r, const char *filename, zv_http_out_t *out) {
+    size_t len = strlen(filename);
+    if (len >= SHORTLINE) {
+        return -1;
+    }
+    zv_lookup_task_t *lt = (zv_lookup_task_t *)malloc(sizeof(zv_lookup_task_t));
+    if (!lt) {
+        return -1;
+    }
+    lt->root = (const char *)r->root;
+    memcpy(lt->filename, filename, len + 1);
+    lt->fd = -1;
+    lt->task.work = lookup_work;
+    lt->task.done = lookup_done;
+    lt->task.data = r;
+    if (zv_aio_post(&lt->task) < 0) {
+        free(lt);
+        return -1;
+    }
+    r->aio_task = &lt->task;
+    r->lookup_out = out;
     return 0;
 }
-// 修改为输入事件或者输出事件events只能二选一
-static void rearm_event(zv_http_request_t *r, uint32_t events) {
-    struct epoll_event event;
-    event.data.ptr = (void *)r->conn_item;
-    event.events = events | EPOLLET | EPOLLONESHOT;
-    zv_epoll_mod(r->epfd, r->fd, &event);
+
+/*
+ * Output is not finished: wait for EPOLLOUT (EAGAIN / quantum used up), or
+ * for the helper thread when the next file window is not in the page cache.
+ */
+static void wait_output(zv_http_request_t *r, int rc) {
+    r->writing = 1;
+    zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
+    if (rc == 3) {
+        if (start_readin(r) == 0) {
+            return;
+        }
+        // 交不出去就跳过探测，退回同步 sendfile
+        int fd;
+        off_t offset;
+        size_t len;
+        if (zv_out_chain_cold_range(&r->out, &fd, &offset, &len) == 0) {
+            zv_out_chain_mark_warm(&r->out, offset + (off_t)len);
+        }
+    }
+    rearm_event(r, EPOLLOUT);
 }
 // 计算 keep-alive 超时时间（秒）（向上取整）
 static int keep_alive_timeout_sec(const zv_http_request_t *r) {
@@ -193,17 +322,18 @@ static int keep_alive_timeout_sec(const zv_http_request_t *r) {
 static const char* get_file_type(const char *type);
 static int parse_uri(const char *uri, int length, char *filename, size_t filename_cap, char *querystring);
 static int prepare_error(zv_http_request_t *r, char *cause, char *errnum, char *shortmsg, char *longmsg, int keep_alive);
-static int prepare_static(zv_http_request_t *r, char *filename, size_t filesize, zv_http_out_t *out);
+static int prepare_static(zv_http_request_t *r, char *filename, size_t filesize, zv_http_out_t *out, int srcfd);
+static int is_metrics_uri(const zv_http_request_t *r);
+static int prepare_metrics(zv_http_request_t *r, int keep_alive);
 static int percent_decode(const char *in, size_t in_len, char *out, size_t out_cap, size_t *out_len);
 static int normalize_abs_path(const char *path, size_t path_len, char *out, size_t out_cap, int *ends_with_slash);
-static int is_path_under_root_real(const char *root, const char *path);
 static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t filename_cap);
 /* handle_cgi_mvp return codes */
 #define ZV_CGI_NOT    0// 不是 CGI，请 do_request 继续走静态文件流程
 #define ZV_CGI_RETURN 1// 这个请求已经被 CGI 分支“接管”，do_request 应该直接 return
-#define ZV_CGI_CLOSE  2// 已经回了错误页且发送完成，do_request 应该 goto close 关连接
+#define ZV_CGI_CLOSE  2// 已经把错误页排进输出链，do_request 刷出后关闭连接
 
-static char *ROOT = NULL;
+static __thread char *ROOT = NULL;
 
 // 将十六进制字符转换为对应的整数值
 static int hex_val(char c) {
@@ -301,26 +431,6 @@ static int normalize_abs_path(const char *path, size_t path_len, char *out, size
     if (ends_with_slash) *ends_with_slash = trailing_slash;
     return 0;
 }
-// 检查路径 path 是否在根目录 root 下（防止目录遍历攻击）
-static int is_path_under_root_real(const char *root, const char *path) {
-    char root_real[PATH_MAX];
-    char path_real[PATH_MAX];
-
-    if (!root || !path) return 0;
-    //realpath它把混乱的、带欺骗性的路径，转换成唯一的、绝对的物理路径。
-    //如果 path 是 /var/www/html/../../etc/passwd，realpath 会把它变成 /etc/passwd。
-    //如果 path 是 /var/www/html/link_to_secret（一个指向外部的软链接），realpath 会直接解析出它指向的真实地址。
-    if (!realpath(root, root_real)) return 0;
-    if (!realpath(path, path_real)) return 0;
-
-    size_t rlen = strlen(root_real);
-    //拿到两个真实路径后，检查 path_real 是否以 root_real 开头。
-    if (strncmp(path_real, root_real, rlen) != 0) return 0;
-    //边界检查（防止“前缀伪造”攻击）防止strncmp 会比较前 9 个字符（/data/web），发现两者完全一样！于是函数可能错误地返回 1。
-    if (path_real[rlen] == '\0' || path_real[rlen] == '/') return 1;
-    return 0;
-}
-
 mime_type_t zaver_mime[] = 
 {
     {".html", "text/html"},
@@ -344,21 +454,37 @@ mime_type_t zaver_mime[] =
     {NULL ,"text/plain"}
 };
 
+// 空闲（两个 keep-alive 请求之间）状态切换时计数，空闲连接数 = 进入 - 离开
+static void set_idle(zv_http_request_t *r, int idle) {
+    if (r->idle != idle) {
+        r->idle = idle;
+        if (idle) {
+            ZV_STAT_INC(idle_enter);
+        } else {
+            ZV_STAT_INC(idle_leave);
+        }
+    }
+}
+
 void do_request(void *ptr) {
     zv_http_request_t *r = (zv_http_request_t *)ptr;
     int fd = r->fd;
     int rc, n;
     char filename[SHORTLINE];
-    struct stat sbuf;
     ROOT = r->root;
     char *plast = NULL;
     size_t remain_size;
+    int queued = 0;         /* 本轮已排进 r->out、尚未刷出的响应数 */
+    int close_after = 0;    /* 刷出后关闭连接 */
+    int answered = 0;       /* 本轮发出过 keep-alive 响应 */
     
-    zv_del_timer(r);
+    if (r->timer) {
+        zv_del_timer(r);
+    }
     for(;;) 
     {
-        //如果缓冲区没有数据了 才能继续读取
-        if (r->parse_pos >= r->last) {
+        //如果缓冲区没有数据了 才能继续读取（异步查找完成后重入时请求已解析完，不读）
+        if (r->parse_phase != 2 && r->parse_pos >= r->last) {
             //由于零拷贝这里最多读取 MAX_BUF - 1 字节
             if (r->last >= MAX_BUF - 1) {
                 log_err("request buffer overflow!");
@@ -367,13 +493,19 @@ void do_request(void *ptr) {
 
             plast = &r->buf[r->last];
             remain_size = (size_t)(MAX_BUF - r->last - 1);
-            n = read(fd, plast, remain_size);
+            n = zv_epoll_read(r->epfd, fd, plast, remain_size);
             check(r->last < MAX_BUF, "request buffer overflow!");
 
             if (n == 0) {
                 // EOF
                 log_info("read return 0, ready to close fd %d, remain_size = %zu", fd, remain_size);
-                goto err;
+                if (zv_out_chain_empty(&r->out)) {
+                    goto err;
+                }
+                // 客户端发完流水线请求后半关闭：先把已排队的响应发出去再关
+                r->keep_alive = 0;
+                close_after = 1;
+                break;
             }
 
             if (n < 0) {
@@ -385,11 +517,15 @@ void do_request(void *ptr) {
             }
 
             r->last += n;
+            set_idle(r, 0);
             check(r->last < MAX_BUF, "request buffer overflow!");
         }
         //解析阶段的状态机
         if (r->parse_phase == 0) {
             log_info("ready to parse request line");
+            if (r->req_start_ns == 0) {
+                r->req_start_ns = zv_now_ns();
+            }
             rc = zv_http_parse_request_line(r);
             if (rc == ZV_AGAIN) {
                 continue;
@@ -398,6 +534,7 @@ void do_request(void *ptr) {
                 goto err;
             }
             r->parse_phase = 1;
+            ZV_PROBE3(request_line, fd, r->req_start_ns, zv_now_ns() - r->req_start_ns);
 
             log_info("method == %.*s", (int)(r->method_end - r->request_start), (char *)r->request_start);
             log_info("uri == %.*s", (int)(r->uri_end - r->uri_start), (char *)r->uri_start);
@@ -413,6 +550,8 @@ void do_request(void *ptr) {
                 goto err;
             }
             r->parse_phase = 2;
+            ZV_STAT_INC(requests);
+            ZV_PROBE3(headers, fd, r->req_start_ns, zv_now_ns() - r->req_start_ns);
         }
         //至此已经完整解析了一个 HTTP 请求
         // 处理 CGI 请求
@@ -421,10 +560,13 @@ void do_request(void *ptr) {
             goto err;
         }
         if (rc == ZV_CGI_RETURN) {
+            // 之前排队的响应会和 CGI 输出一起由 do_write 发送
             return;
         }
         if (rc == ZV_CGI_CLOSE) {
-            goto close;
+            queued++;
+            close_after = 1;
+            break;
         }
 
         //读取 URI 并转换成文件路径
@@ -433,118 +575,106 @@ void do_request(void *ptr) {
             if (rc < 0) {
                 goto err;
             }
-            rc = try_send(r);
-            if (rc < 0) {
-                log_send_failed("try_send 400", fd);
-                goto err;
-            }
-            if (rc == 1) {
-                r->writing = 1;
-                rearm_event(r, EPOLLOUT);
-                zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-                return;
-            }
-            reset_output(r);
-            goto close;
-        }
-        //为响应分配并初始化输出结构体
-        zv_http_out_t *out = (zv_http_out_t *)malloc(sizeof(zv_http_out_t));
-        if (out == NULL) {
-            log_err("no enough space for zv_http_out_t");
-            exit(1);
+            queued++;
+            close_after = 1;
+            break;
         }
-        rc = zv_init_out_t(out, fd);
-        check(rc == ZV_OK, "zv_init_out_t");
-        //根据请求头设置 out 结构体成员
-        zv_http_handle_header(r, out);
-        check(list_empty(&(r->list)) == 1, "header list should be empty");
-        //获取文件状态
-        if(stat(filename, &sbuf) < 0) {
-            rc = prepare_error(r, filename, "404", "Not Found", "zaver can't find the file", out->keep_alive);
-            if (rc < 0) {
-                free(out);
-                goto err;
-            }
-            rc = try_send(r);
-            if (rc < 0) {
-                log_send_failed("try_send 404", fd);
-                free(out);
-                goto err;
-            }
-            if (rc == 1) {
-                r->writing = 1;
-            } else {
-                reset_output(r);
+        zv_http_out_t *out;
+        zv_file_meta_t meta;
+        int srcfd = -1;
+        if (r->lookup_out) {
+            // 辅助线程查找完成后由 lookup_done 重入：沿用当时的 out，结果已放在 r 上
+            out = (zv_http_out_t *)r->lookup_out;
+            r->lookup_out = NULL;
+            meta = r->lookup_meta;
+            srcfd = r->lookup_fd;
+            r->lookup_fd = -1;
+        } else {
+            //为响应分配并初始化输出结构体
+            out = (zv_http_out_t *)malloc(sizeof(zv_http_out_t));
+            if (out == NULL) {
+                log_err("no enough space for zv_http_out_t");
+                exit(1);
             }
-            goto request_done;
-        }
-        //检查文件路径是否在根目录下
-        if (!is_path_under_root_real(ROOT, filename)) {
-            rc = prepare_error(r, filename, "403", "Forbidden", "path is outside docroot", out->keep_alive);
-            if (rc < 0) {
-                free(out);
-                goto err;
+            rc = zv_init_out_t(out, fd);
+            check(rc == ZV_OK, "zv_init_out_t");
+            //根据请求头设置 out 结构体成员
+            zv_http_handle_header(r, out);
+            check(list_empty(&(r->list)) == 1, "header list should be empty");
+            // 内置指标地址：在事件循环里直接作答，不碰文件系统
+            if (is_metrics_uri(r)) {
+                rc = prepare_metrics(r, out->keep_alive);
+                if (rc < 0) {
+                    free(out);
+                    goto err;
+                }
+                goto request_done;
             }
-            rc = try_send(r);
-            if (rc < 0) {
-                log_send_failed("try_send 403(root)", fd);
-                free(out);
-                goto err;
+            // 元数据缓存命中走内联快路径；未命中把 stat/realpath/open 交给辅助线程
+            int hit = (zv_file_cache_get(filename, &meta) == 0);
+            if (hit && meta.status == ZV_FILE_OK) {
+                // TTL 内文件可能被截断或替换：打开后核对，对不上就丢掉这条缓存重新查找
+                int changed = 0;
+                srcfd = zv_file_open(filename, &meta, &changed);
+                if (srcfd < 0 || changed) {
+                    if (srcfd >= 0) {
+                        close(srcfd);
+                        srcfd = -1;
+                    }
+                    zv_file_cache_drop(filename);
+                    hit = 0;
+                }
             }
-            if (rc == 1) {
-                r->writing = 1;
-            } else {
-                reset_output(r);
+            if (!hit) {
+                if (queued > 0 && flush_output(r, queued) < 0) {
+                    log_send_failed("flush before lookup", fd);
+                    free(out);
+                    goto err;
+                }
+                if (start_lookup(r, filename, out) == 0) {
+                    zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
+                    return;
+                }
+                zv_file_lookup(ROOT, filename, &meta);
+                if (meta.status == ZV_FILE_OK) {
+                    srcfd = zv_file_open(filename, &meta, NULL);
+                    if (srcfd < 0) {
+                        meta.status = ZV_FILE_NOT_FOUND;
+                    }
+                }
+                zv_file_cache_put(filename, &meta);
             }
-            goto request_done;
         }
-        //判断是否为普通文件  并且当前用户是否有读取权限
-        if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode))
-        {
-            rc = prepare_error(r, filename, "403", "Forbidden",
-                    "zaver can't read the file", out->keep_alive);
-            if (rc < 0) {
-                free(out);
-                goto err;
+        if (meta.status != ZV_FILE_OK) {
+            if (meta.status == ZV_FILE_NOT_FOUND) {
+                rc = prepare_error(r, filename, "404", "Not Found", "zaver can't find the file", out->keep_alive);
+            } else if (meta.status == ZV_FILE_OUTSIDE_ROOT) {
+                rc = prepare_error(r, filename, "403", "Forbidden", "path is outside docroot", out->keep_alive);
+            } else {
+                rc = prepare_error(r, filename, "403", "Forbidden",
+                        "zaver can't read the file", out->keep_alive);
             }
-            rc = try_send(r);
             if (rc < 0) {
-                log_send_failed("try_send 403", fd);
                 free(out);
                 goto err;
             }
-            if (rc == 1) {
-                r->writing = 1;
-            } else {
-                reset_output(r);
-            }
             goto request_done;
         }
         //初始化 out 结构体的 mtime 和 status 成员
-        out->mtime = sbuf.st_mtime;
+        out->mtime = meta.mtime;
         // 如果之前没有被设置状态码 则设置为 200 OK
         if (out->status == 0) {
             out->status = ZV_HTTP_OK;
         }
-        // 发送静态文件
-        rc = prepare_static(r, filename, sbuf.st_size, out);
-        if (rc < 0) {
-            free(out);
-            goto err;
-        }
-        rc = try_send(r);
+        // 准备静态文件响应（只入队，不立即发送）
+        rc = prepare_static(r, filename, (size_t)meta.size, out, srcfd);
         if (rc < 0) {
-            log_send_failed("try_send static", fd);
             free(out);
             goto err;
         }
-        if (rc == 1) {
-            r->writing = 1;
-        } else {
-            reset_output(r);
-        }
 
 request_done:
+        queued++;
         /*
          * Current request fully handled.
          * Compact any pipelined bytes [parse_pos, last) to the buffer head and reset parser state.
@@ -573,24 +703,57 @@ request_done:
         r->uri_end = NULL;
         r->request_end = NULL;
 
-        if (r->writing) {
-            free(out);
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return;
-        }
-
         if (!out->keep_alive) {
             log_info("no keep_alive! ready to close");
             free(out);
-            goto close;
+            close_after = 1;
+            break;
         }
         free(out);
+        answered = 1;
+
+        // 批量已满或 arena 不够放下一个响应：先刷出，发不完就等 EPOLLOUT，排空后 do_write 会继续解析
+        size_t avail = 0;
+        (void)zv_out_chain_buf_reserve(&r->out, &avail);
+        if (queued >= ZV_PIPELINE_BATCH_MAX || avail < ZV_OUT_BUF_SIZE / 2) {
+            rc = flush_output(r, queued);
+            if (rc < 0) {
+                log_send_failed("flush pipelined", fd);
+                goto err;
+            }
+            if (rc > 0) {
+                wait_output(r, rc);
+                return;
+            }
+            queued = 0;
+        }
+    }
+
+    // 缓冲区里已有的请求都处理完了：一次性刷出本轮排队的所有响应
+    rc = flush_output(r, queued);
+    if (rc < 0) {
+        log_send_failed("flush", fd);
+        goto err;
+    }
+    if (rc > 0) {
+        wait_output(r, rc);
+        return;
+    }
+    if (close_after) {
+        goto close;
     }
     
-    rearm_event(r, EPOLLIN);
     /* If we already buffered some request data (or are mid-parse), treat it as in-flight. */
-    size_t tmo = (r->last > 0 || r->parse_phase != 0) ? r->request_timeout_ms : r->keep_alive_timeout_ms;
+    int in_flight = (r->last > 0 || r->parse_phase != 0);
+    // 平滑停止中：SIGTERM 之前就排好的 keep-alive 响应已经发完，不再回到空闲等下一个请求
+    if (answered && !in_flight && zv_quit) {
+        goto close;
+    }
+    if (answered && !in_flight) {
+        set_idle(r, 1);
+    }
+    rearm_event(r, EPOLLIN);
+    size_t tmo = in_flight ? r->request_timeout_ms : r->keep_alive_timeout_ms;
     zv_add_timer(r, tmo, zv_http_close_conn);
     return;
 
@@ -604,7 +767,7 @@ close:
 //-1 表示出错 错误页
 //ZV_CGI_NOT 不是 CGI，请 do_request 继续走静态文件流程
 //ZV_CGI_RETURN 这个请求已经被 CGI 分支“接管”，do_request 应该直接 return
-//ZV_CGI_CLOSE 已经回了错误页且发送完成，do_request 应该 goto close 关连接
+//ZV_CGI_CLOSE 已经把错误页排进输出链，do_request 刷出后关闭连接
 static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t filename_cap) {
     if (!r || !r->uri_start || !r->uri_end || !filename || filename_cap == 0) {
         return ZV_CGI_NOT;//这里返回 ZV_CGI_NOT 而不是报错，是为了不改变主流程的容错：主流程后面会对 URI 做自己的检查并回 400。
@@ -629,17 +792,6 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 405", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
     // 消费并清空 header list（这里不使用但是需要消费掉清空）
@@ -657,17 +809,6 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 400(cgi)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
     // 复制脚本名
@@ -696,17 +837,6 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 400(cgi uri)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
 
@@ -716,17 +846,6 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 400(cgi norm)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
     // 确保规范化后仍在 /cgi-bin/ 下（防止编码绕过）
@@ -735,17 +854,6 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 403(cgi)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
     // 拼成磁盘路径 ？？？？？？？？？？？？？？？？？？？？？？？？？
@@ -755,17 +863,6 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 400(cgi path)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
     //必须是普通文件且可执行
@@ -775,36 +872,14 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 404(cgi)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
     // realpath 约束，防止软链接逃逸到 docroot 外
-    if (!is_path_under_root_real(ROOT, filename)) {
+    if (!zv_path_under_root(ROOT, filename)) {
         rc = prepare_error(r, filename, "403", "Forbidden", "cgi path is outside docroot", 0);
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 403(cgi root)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
     // 启动 CGI 进程
@@ -813,17 +888,6 @@ static int handle_cgi_mvp(zv_http_request_t *r, int fd, char *filename, size_t f
         if (rc < 0) {
             return -1;
         }
-        rc = try_send(r);
-        if (rc < 0) {
-            log_send_failed("try_send 500(cgi)", fd);
-            return -1;
-        }
-        if (rc == 1) {
-            r->writing = 1;
-            rearm_event(r, EPOLLOUT);
-            zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
-            return ZV_CGI_RETURN;
-        }
         return ZV_CGI_CLOSE;
     }
 
@@ -855,10 +919,8 @@ void do_write(void *ptr) {
     }
     rc = try_send(r);
 
-    if (rc == 1) {
-        r->writing = 1;
-        rearm_event(r, EPOLLOUT);
-        zv_add_timer(r, r->request_timeout_ms, zv_http_close_conn);
+    if (rc > 0) {
+        wait_output(r, rc);
         return;
     }
 
@@ -881,10 +943,59 @@ void do_write(void *ptr) {
         zv_http_close_conn(r);
         return;
     }
+    // 还有没处理的流水线请求（批量刷出时被 EAGAIN 打断）：继续解析
+    if (r->last > 0) {
+        do_request(r);
+        return;
+    }
+    // 平滑停止中：响应发完就关，不再等 keep_alive_timeout
+    if (zv_quit) {
+        zv_http_close_conn(r);
+        return;
+    }
 
+    set_idle(r, 1);
     rearm_event(r, EPOLLIN);
     zv_add_timer(r, r->keep_alive_timeout_ms, zv_http_close_conn);
 }
+/*
+ * EPOLLERR on a connection with MSG_ZEROCOPY sends in flight: completions
+ * arrive on the socket error queue, so drain them and then handle whatever
+ * readiness came with the event.
+ * return: 0 handled, -1 caller closes the connection; errno holds the
+ *         socket error (SO_ERROR is cleared by reading it), 0 for a hangup
+ */
+int zv_http_on_errqueue(zv_http_request_t *r, uint32_t events) {
+    int so_error = 0;
+    socklen_t so_error_len = sizeof(so_error);
+    if (getsockopt(r->fd, SOL_SOCKET, SO_ERROR, &so_error, &so_error_len) < 0) {
+        return -1;
+    }
+    if (so_error != 0) {
+        errno = so_error;
+        return -1;
+    }
+    if (zv_out_chain_zc_reap(r->fd, &r->out) < 0) {
+        return -1;
+    }
+    if (events & EPOLLIN) {
+        do_request(r);
+        return 0;
+    }
+    if (events & EPOLLOUT) {
+        do_write(r);
+        return 0;
+    }
+    if (events & (EPOLLHUP | EPOLLRDHUP)) {
+        errno = 0;
+        return -1;
+    }
+    // 只有完成通知：恢复原来的监听（CGI 分支、辅助线程读入各自管理客户端 fd 的注册）
+    if (!r->cgi_active && !r->aio_task) {
+        rearm_event(r, r->writing ? EPOLLOUT : EPOLLIN);
+    }
+    return 0;
+}
 //uri="/" → filename=ROOT + "/" → 末尾是 / → 最终 ROOT/index.html
 //uri="/50x.html" → 末尾段有 . → 最终 ROOT/50x.html
 //uri="/docs" → 末尾段没 . → 补 / → 补 index.html → ROOT/docs/index.html
@@ -981,7 +1092,6 @@ static int prepare_error(zv_http_request_t *r, char *cause, char *errnum, char *
     size_t header_len = 0;
     size_t body_len = 0;
 
-    reset_output(r);
     r->keep_alive = keep_alive;
 
     body_tmp[0] = '\0';
@@ -990,36 +1100,87 @@ static int prepare_error(zv_http_request_t *r, char *cause, char *errnum, char *
     (void)appendf(body_tmp, sizeof(body_tmp), &body_len, "%s: %s\n", errnum, shortmsg);
     (void)appendf(body_tmp, sizeof(body_tmp), &body_len, "<p>%s: %s\n</p>", longmsg, cause);
     (void)appendf(body_tmp, sizeof(body_tmp), &body_len, "<hr><em>Zaver web server</em>\n</body></html>");
+    zv_http_note_response(r, atoi(errnum), (long long)body_len);
 
-    r->out_body = (char *)malloc(body_len);
-    if (!r->out_body) {
+    size_t cap = 0;
+    char *hdr = zv_out_chain_buf_reserve(&r->out, &cap);
+    if (cap == 0) {
         return -1;
     }
-    memcpy(r->out_body, body_tmp, body_len);
-    r->out_body_len = body_len;
-    r->out_body_sent = 0;
-
-    r->out_header[0] = '\0';
-    (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "HTTP/1.1 %s %s\r\n", errnum, shortmsg);
-    (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Server: Zaver\r\n");
-    (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Content-type: text/html\r\n");
+    hdr[0] = '\0';
+    (void)appendf(hdr, cap, &header_len, "HTTP/1.1 %s %s\r\n", errnum, shortmsg);
+    (void)appendf(hdr, cap, &header_len, "Server: Zaver\r\n");
+    (void)appendf(hdr, cap, &header_len, "Content-type: text/html\r\n");
 
     if (keep_alive) {
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Connection: keep-alive\r\n");
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Keep-Alive: timeout=%d\r\n", keep_alive_timeout_sec(r));
+        (void)appendf(hdr, cap, &header_len, "Connection: keep-alive\r\n");
+        (void)appendf(hdr, cap, &header_len, "Keep-Alive: timeout=%d\r\n", keep_alive_timeout_sec(r));
     } else {
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Connection: close\r\n");
+        (void)appendf(hdr, cap, &header_len, "Connection: close\r\n");
     }
 
-    (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Content-length: %zu\r\n\r\n", body_len);
-    r->out_header_len = header_len;
-    r->out_header_sent = 0;
-    r->out_file_fd = -1;
+    (void)appendf(hdr, cap, &header_len, "Content-length: %zu\r\n\r\n", body_len);
+    // header 与 body 都放进 arena，合并成一个内存段
+    if (zv_out_chain_buf_commit(&r->out, header_len) < 0) {
+        return -1;
+    }
+    return zv_out_chain_append_copy(&r->out, body_tmp, body_len);
+}
+
+// 请求路径（不含查询串）正好是配置的 metrics_path
+static int is_metrics_uri(const zv_http_request_t *r) {
+    if (!r->metrics_path) {
+        return 0;
+    }
+    size_t len = (size_t)((const char *)r->uri_end - (const char *)r->uri_start);
+    size_t plen = strlen(r->metrics_path);
+    const char *uri = (const char *)r->uri_start;
+    return len >= plen && memcmp(uri, r->metrics_path, plen) == 0 && (len == plen || uri[plen] == '?');
+}
+
+// 准备指标响应：头部放 arena，正文是 zv_metrics_render 分配的内存，发完释放
+static int prepare_metrics(zv_http_request_t *r, int keep_alive) {
+    size_t body_len = 0;
+    char *body = zv_metrics_render(&body_len);
+    if (!body) {
+        return prepare_error(r, "metrics", "500", "Internal Server Error", "zaver can't render metrics", keep_alive);
+    }
+    r->keep_alive = keep_alive;
+    zv_http_note_response(r, ZV_HTTP_OK, (long long)body_len);
+
+    size_t header_len = 0;
+    size_t cap = 0;
+    char *hdr = zv_out_chain_buf_reserve(&r->out, &cap);
+    if (cap == 0) {
+        free(body);
+        return -1;
+    }
+    hdr[0] = '\0';
+    (void)appendf(hdr, cap, &header_len, "HTTP/1.1 200 OK\r\n");
+    if (keep_alive) {
+        (void)appendf(hdr, cap, &header_len, "Connection: keep-alive\r\n");
+        (void)appendf(hdr, cap, &header_len, "Keep-Alive: timeout=%d\r\n", keep_alive_timeout_sec(r));
+    } else {
+        (void)appendf(hdr, cap, &header_len, "Connection: close\r\n");
+    }
+    (void)appendf(hdr, cap, &header_len, "Content-type: text/plain; version=0.0.4; charset=utf-8\r\n");
+    (void)appendf(hdr, cap, &header_len, "Content-length: %zu\r\n", body_len);
+    (void)appendf(hdr, cap, &header_len, "Cache-Control: no-store\r\n");
+    (void)appendf(hdr, cap, &header_len, "Server: Zaver\r\n\r\n");
+    if (zv_out_chain_buf_commit(&r->out, header_len) < 0) {
+        free(body);
+        return -1;
+    }
+    if (zv_out_chain_append_mem(&r->out, body, body_len, free, body) < 0) {
+        free(body);
+        return -1;
+    }
     return 0;
 }
 
 // 准备静态文件响应（由 try_send/do_write 负责真正发送）//sprintf会带上\0
-static int prepare_static(zv_http_request_t *r, char *filename, size_t filesize, zv_http_out_t *out) {
+// srcfd: 已由辅助线程打开的文件，-1 表示在这里打开
+static int prepare_static(zv_http_request_t *r, char *filename, size_t filesize, zv_http_out_t *out, int srcfd) {
     char buf[SHORTLINE];
     size_t header_len = 0;
     struct tm tm;
@@ -1028,46 +1189,78 @@ static int prepare_static(zv_http_request_t *r, char *filename, size_t filesize,
     const char *dot_pos = strrchr(filename, '.');
     file_type = get_file_type(dot_pos);//获取文件类型
     
-    reset_output(r);
     r->keep_alive = out->keep_alive;
+    zv_http_note_response(r, out->status, out->modified ? (long long)filesize : 0);
 
-    r->out_header[0] = '\0';
-    (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "HTTP/1.1 %d %s\r\n", out->status, get_shortmsg_from_status_code(out->status));
+    size_t cap = 0;
+    char *hdr = zv_out_chain_buf_reserve(&r->out, &cap);
+    if (cap == 0) {
+        if (srcfd >= 0) close(srcfd);
+        return -1;
+    }
+    hdr[0] = '\0';
+    (void)appendf(hdr, cap, &header_len, "HTTP/1.1 %d %s\r\n", out->status, get_shortmsg_from_status_code(out->status));
    
     if (out->keep_alive) {
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Connection: keep-alive\r\n");
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Keep-Alive: timeout=%d\r\n", keep_alive_timeout_sec(r));
+        (void)appendf(hdr, cap, &header_len, "Connection: keep-alive\r\n");
+        (void)appendf(hdr, cap, &header_len, "Keep-Alive: timeout=%d\r\n", keep_alive_timeout_sec(r));
     } else {
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Connection: close\r\n");
+        (void)appendf(hdr, cap, &header_len, "Connection: close\r\n");
     }
     // 如果文件被修改过，才发送文件相关的头信息
     if (out->modified) {
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Content-type: %s\r\n", file_type);
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Content-length: %zu\r\n", filesize);
+        (void)appendf(hdr, cap, &header_len, "Content-type: %s\r\n", file_type);
+        (void)appendf(hdr, cap, &header_len, "Content-length: %zu\r\n", filesize);
         localtime_r(&(out->mtime), &tm);
         strftime(buf, SHORTLINE,  "%a, %d %b %Y %H:%M:%S GMT", &tm);
-        (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Last-Modified: %s\r\n", buf);
+        (void)appendf(hdr, cap, &header_len, "Last-Modified: %s\r\n", buf);
     }
 
-    (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "Server: Zaver\r\n");
-    (void)appendf(r->out_header, sizeof(r->out_header), &header_len, "\r\n");// 空行，结束头部
-    r->out_header_len = header_len;
-    r->out_header_sent = 0;
+    (void)appendf(hdr, cap, &header_len, "Server: Zaver\r\n");
+    (void)appendf(hdr, cap, &header_len, "\r\n");// 空行，结束头部
+    if (zv_out_chain_buf_commit(&r->out, header_len) < 0) {
+        if (srcfd >= 0) close(srcfd);
+        return -1;
+    }
 
-    if (!out->modified) {
-        r->out_file_fd = -1;
-        r->out_file_offset = 0;
-        r->out_file_size = 0;
+    if (!out->modified || filesize == 0) {
+        if (srcfd >= 0) close(srcfd);
         return 0;
     }
 
-    int srcfd = open(filename, O_RDONLY, 0);
     if (srcfd < 0) {
+        srcfd = open(filename, O_RDONLY, 0);
+    }
+    if (srcfd < 0) {
+        return -1;
+    }
+    tune_send_buffers(r, filesize);
+    // 大文件可选走内存正文：mmap 后作为内存段发送（可配合 MSG_ZEROCOPY），失败则退回 sendfile
+    if (r->mmap_threshold > 0 && filesize >= r->mmap_threshold) {
+        void *addr = mmap(NULL, filesize, PROT_READ, MAP_SHARED, srcfd, 0);
+        if (addr != MAP_FAILED) {
+            close(srcfd);
+            if (zv_out_chain_append_mmap(&r->out, addr, filesize) < 0) {
+                munmap(addr, filesize);
+                return -1;
+            }
+            return 0;
+        }
+        log_warn("mmap failed, falling back to sendfile: %s", filename);
+    }
+    // 文件正文作为文件段排在 header 之后，由 sendfile 发送，发完后关闭 fd
+    // 大文件按顺序读处理（预读跟着发送位置走），超出缓存预算的发完即丢弃
+    int seg_flags = ZV_OUT_SEG_CLOSE_FD;
+    if (r->large_file_bytes > 0 && filesize >= r->large_file_bytes) {
+        seg_flags |= ZV_OUT_SEG_SEQUENTIAL;
+        if (r->page_cache_budget > 0 && filesize > r->page_cache_budget) {
+            seg_flags |= ZV_OUT_SEG_DONTNEED;
+        }
+    }
+    if (zv_out_chain_append_file(&r->out, srcfd, 0, (off_t)filesize, seg_flags) < 0) {
+        close(srcfd);
         return -1;
     }
-    r->out_file_fd = srcfd;
-    r->out_file_offset = 0;
-    r->out_file_size = filesize;
     return 0;
 }
 // 根据文件扩展名获取对应的 MIME 类型
@@ -18,6 +18,9 @@
 #define MAXLINE     8192
 #define SHORTLINE   512
 
+/* max pipelined responses queued on one connection before a forced flush */
+#define ZV_PIPELINE_BATCH_MAX 32
+
 #define zv_str3_cmp(m, c0, c1, c2, c3)                                       \
     *(uint32_t *) m == ((c3 << 24) | (c2 << 16) | (c1 << 8) | c0)
 #define zv_str3Ocmp(m, c0, c1, c2, c3)                                       \
@@ -34,5 +37,6 @@ typedef struct mime_type_s {
 
 void do_request(void *infd);
 void do_write(void *infd);
+int zv_http_on_errqueue(zv_http_request_t *r, uint32_t events);
 
 #endif
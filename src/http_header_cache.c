@@ -11,9 +11,10 @@
 #define ZV_HEADER_FREELIST_MAX 8192
 #endif
 
-static list_head g_free_headers;
-static size_t g_free_count;
-static int g_inited;
+/* 每个 reactor 线程一份，无锁 */
+static __thread list_head g_free_headers;
+static __thread size_t g_free_count;
+static __thread int g_inited;
 
 //初始化缓存链表
 static void init_once(void) {
@@ -65,3 +66,15 @@ void zv_http_header_free(zv_http_header_t *hd) {
     list_add(&hd->list, &g_free_headers);//加入到缓存链表头部
     g_free_count++;//增加缓存数量
 }
+// reactor 退出：释放缓存链表里的所有节点
+void zv_http_header_cache_release(void) {
+    if (!g_inited) {
+        return;
+    }
+    while (!list_empty(&g_free_headers)) {
+        list_head *pos = g_free_headers.next;
+        list_del(pos);
+        free(list_entry(pos, zv_http_header_t, list));
+    }
+    g_free_count = 0;
+}
@@ -9,5 +9,7 @@
 
 zv_http_header_t *zv_http_header_alloc(void);
 void zv_http_header_free(zv_http_header_t *hd);
+/* Free every cached header node (reactor shutdown). */
+void zv_http_header_cache_release(void);
 
 #endif
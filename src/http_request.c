@@ -20,6 +20,12 @@
 #include "http_request.h"
 #include "error.h"
 #include "ep_item.h"
+#include "epoll.h"
+#include "aio.h"
+#include "zv_signal.h"
+#include "stats.h"
+#include "access_log.h"
+#include "zv_probes.h"
 
 static int zv_http_process_ignore(zv_http_request_t *r, zv_http_out_t *out, char *data, int len);
 static int zv_http_process_connection(zv_http_request_t *r, zv_http_out_t *out, char *data, int len);
@@ -62,14 +68,31 @@ int zv_init_request_t(zv_http_request_t *r, int fd, int epfd, zv_conf_t *cf) {
     r->cur_header_value_start = NULL;
     r->cur_header_value_end = NULL;
 
-    /* timeouts (ms) */
+    /* timeouts (ms), per-event send quantum and send-queue tuning */
     if (cf) {
         r->keep_alive_timeout_ms = (cf->keep_alive_timeout_ms > 0) ? (size_t)cf->keep_alive_timeout_ms : (size_t)ZV_DEFAULT_KEEP_ALIVE_TIMEOUT_MS;
         r->request_timeout_ms = (cf->request_timeout_ms > 0) ? (size_t)cf->request_timeout_ms : (size_t)ZV_DEFAULT_REQUEST_TIMEOUT_MS;
+        r->send_quantum = (cf->send_quantum_kb > 0) ? (size_t)cf->send_quantum_kb * 1024 : 0;
+        r->sndbuf = cf->sndbuf;
+        r->notsent_lowat = cf->tcp_notsent_lowat;
+        r->large_file_bytes = (cf->large_file_kb > 0) ? (size_t)cf->large_file_kb * 1024 : 0;
+        r->large_sndbuf = cf->large_sndbuf;
+        r->large_notsent_lowat = cf->large_notsent_lowat;
+        r->mmap_threshold = (cf->mmap_threshold_kb > 0) ? (size_t)cf->mmap_threshold_kb * 1024 : 0;
+        r->page_cache_budget = (cf->page_cache_budget_kb > 0) ? (size_t)cf->page_cache_budget_kb * 1024 : 0;
     } else {
         r->keep_alive_timeout_ms = (size_t)ZV_DEFAULT_KEEP_ALIVE_TIMEOUT_MS;
         r->request_timeout_ms = (size_t)ZV_DEFAULT_REQUEST_TIMEOUT_MS;
+        r->send_quantum = (size_t)ZV_DEFAULT_SEND_QUANTUM_KB * 1024;
+        r->sndbuf = 0;
+        r->notsent_lowat = 0;
+        r->large_file_bytes = (size_t)ZV_DEFAULT_LARGE_FILE_KB * 1024;
+        r->large_sndbuf = 0;
+        r->large_notsent_lowat = ZV_DEFAULT_LARGE_NOTSENT_LOWAT;
+        r->mmap_threshold = (size_t)ZV_DEFAULT_MMAP_THRESHOLD_KB * 1024;
+        r->page_cache_budget = (size_t)ZV_DEFAULT_PAGE_CACHE_BUDGET_KB * 1024;
     }
+    r->large_tuned = 0;
 
     r->timer = NULL;//初始化 timer 为 NULL
     INIT_LIST_HEAD(&(r->freelist));//初始化 freelist 链表头
@@ -101,15 +124,23 @@ int zv_init_request_t(zv_http_request_t *r, int fd, int epfd, zv_conf_t *cf) {
 
     r->keep_alive = 0;
     r->writing = 0;
-    r->out_header_len = 0;
-    r->out_header_sent = 0;
-    r->out_body = NULL;
-    r->out_body_len = 0;
-    r->out_body_sent = 0;
-    r->out_file_fd = -1;
-    r->out_file_offset = 0;
-    r->out_file_size = 0;
-    r->out_header[0] = '\0';
+    r->idle = 0;
+    r->metrics_path = cf ? cf->metrics_path : NULL;
+    r->accept_ns = 0;
+    r->req_start_ns = 0;
+    r->nsamples = 0;
+    r->nfirst = 0;
+    r->al_len = 0;
+    zv_out_chain_init(&r->out, r->out_buf, sizeof(r->out_buf));
+    {
+        int probe_kb = cf ? cf->aio_probe_kb : ZV_DEFAULT_AIO_PROBE_KB;
+        r->out.probe_window = (probe_kb > 0) ? (off_t)probe_kb * 1024 : 0;
+        int readahead_kb = cf ? cf->readahead_kb : ZV_DEFAULT_READAHEAD_KB;
+        r->out.readahead = (readahead_kb > 0) ? (off_t)readahead_kb * 1024 : 0;
+    }
+    r->aio_task = NULL;
+    r->lookup_out = NULL;
+    r->lookup_fd = -1;
 
     /* CGI state */
     r->cgi_active = 0;
@@ -121,16 +152,8 @@ int zv_init_request_t(zv_http_request_t *r, int fd, int epfd, zv_conf_t *cf) {
     r->cgi_out_limit = 1024 * 1024; /* 1 MiB default */
     r->cgi_headers_done = 0;
     r->cgi_hdr_len = 0;
-    r->cgi_http_header_len = 0;
-    r->cgi_http_header_sent = 0;
-
-    r->cgi_chunk_prefix_len = 0;
-    r->cgi_chunk_prefix_sent = 0;
-    r->cgi_chunk_suffix_sent = 0;
-    r->cgi_final_chunk_len = 0;
-    r->cgi_final_chunk_sent = 0;
+    r->cgi_final_queued = 0;
     r->cgi_body_len = 0;
-    r->cgi_body_sent = 0;
 
     return ZV_OK;
 }
@@ -146,14 +169,18 @@ int zv_free_request_t(zv_http_request_t *r) {
         zv_http_header_free(hd);
     }
     INIT_LIST_HEAD(&(r->list));
-    // 释放输出相关资源
-    if (r->out_body) {
-        free(r->out_body);
-        r->out_body = NULL;
+    // 释放输出相关资源（关闭文件段持有的 fd、解除映射，包括等待零拷贝确认的段）
+    zv_out_chain_free(&r->out);
+    // 辅助线程上还有这个连接的任务：让它完成后只释放自己的资源
+    zv_aio_orphan(r->aio_task);
+    r->aio_task = NULL;
+    if (r->lookup_out) {
+        free(r->lookup_out);
+        r->lookup_out = NULL;
     }
-    if (r->out_file_fd >= 0) {
-        close(r->out_file_fd);
-        r->out_file_fd = -1;
+    if (r->lookup_fd >= 0) {
+        close(r->lookup_fd);
+        r->lookup_fd = -1;
     }
     
     /* CGI cleanup (best-effort) */
@@ -167,7 +194,7 @@ int zv_free_request_t(zv_http_request_t *r) {
             r->cgi_in_fd = -1;
         }
         if (r->cgi_out_fd >= 0) {
-            close(r->cgi_out_fd);
+            zv_epoll_close(r->epfd, r->cgi_out_fd);
             r->cgi_out_fd = -1;
         }
         r->cgi_active = 0;
@@ -238,19 +265,189 @@ void zv_http_handle_header(zv_http_request_t *r, zv_http_out_t *o) {
         list_del(pos);
         zv_http_header_free(hd);
     }
+    // 平滑停止中：这个响应带上 Connection: close，发完就关
+    if (zv_quit) {
+        o->keep_alive = 0;
+    }
 }
+static void log_samples(zv_http_request_t *r, uint64_t now);
+
 // 关闭 HTTP 连接
 int zv_http_close_conn(zv_http_request_t *r) {
     // NOTICE: closing a file descriptor will cause it to be removed from all epoll sets automatically
     // http://stackoverflow.com/questions/8707601/is-it-necessary-to-deregister-a-socket-from-epoll-before-closing-it
+    // io_uring 后端则需要先取消挂着的 poll，统一走 zv_epoll_close
+    ZV_PROBE2(close, r->fd, r->req_start_ns);
+    // 还没发完的响应（客户端断开、排空到期、文件被截断）按实际发出的字节记访问日志
+    if (r->nsamples > 0) {
+        log_samples(r, zv_now_ns());
+        r->nsamples = 0;
+        r->nfirst = 0;
+    }
     zv_free_request_t(r);
-    close(r->fd);
+    zv_epoll_close(r->epfd, r->fd);
     r->fd = -1;
+    ZV_STAT_INC(conns_closed);
+    if (r->idle) {
+        r->idle = 0;
+        ZV_STAT_INC(idle_leave);
+    }
     zv_http_request_put_deferred(r);
 
     return ZV_OK;
 }
 
+// 上一个响应已发完、还没读到下一个请求的任何字节，也没有挂着的输出/CGI/辅助线程任务
+int zv_http_request_idle(zv_http_request_t *r) {
+    return r->idle && r->last == 0 && r->parse_phase == 0 && !r->writing &&
+           !r->cgi_active && r->aio_task == NULL && r->lookup_out == NULL &&
+           zv_out_chain_empty(&r->out);
+}
+
+// 把请求行的方法和 URI 复制到 al_buf：响应发完时 r->buf 早已让给了后面的请求
+static void copy_request_line(zv_http_request_t *r, int i) {
+    const char *m = (const char *)r->request_start, *me = (const char *)r->method_end;
+    const char *u = (const char *)r->uri_start, *ue = (const char *)r->uri_end;
+    size_t mlen = (m && me && me > m) ? (size_t)(me - m) : 0;
+    size_t ulen = (u && ue && ue > u) ? (size_t)(ue - u) : 0;
+    // 日志行本身就有长度上限，多复制也写不进去
+    if (mlen > ZV_ACCESS_LOG_LINE_MAX) mlen = ZV_ACCESS_LOG_LINE_MAX;
+    if (ulen > ZV_ACCESS_LOG_LINE_MAX) ulen = ZV_ACCESS_LOG_LINE_MAX;
+    r->samples[i].has_method = 0;
+    r->samples[i].has_uri = 0;
+    r->samples[i].http_major = r->http_major;
+    r->samples[i].http_minor = r->http_minor;
+    size_t need = r->al_len + mlen + ulen;
+    if (need > r->al_cap) {
+        size_t cap = r->al_cap ? r->al_cap : 1024;
+        while (cap < need) {
+            cap *= 2;
+        }
+        char *p = (char *)realloc(r->al_buf, cap);
+        if (!p) {
+            return;
+        }
+        r->al_buf = p;
+        r->al_cap = cap;
+    }
+    r->samples[i].req_off = (uint32_t)r->al_len;
+    r->samples[i].method_len = (uint32_t)mlen;
+    r->samples[i].uri_len = (uint32_t)ulen;
+    r->samples[i].has_method = (m != NULL && me != NULL);
+    r->samples[i].has_uri = (ulen > 0);
+    if (mlen > 0) {
+        memcpy(r->al_buf + r->al_len, m, mlen);
+    }
+    if (ulen > 0) {
+        memcpy(r->al_buf + r->al_len + mlen, u, ulen);
+    }
+    r->al_len = need;
+}
+
+/*
+ * 给每个样本记一行访问日志。响应在输出链上首尾相接，没发出的字节总在最后一个
+ * 没发完的响应的尾部，所以每个响应的正文实际发出多少可以由链的累计发送量推出来
+ */
+static void log_samples(zv_http_request_t *r, uint64_t now) {
+    int i;
+    if (!zv_access_log_enabled()) {
+        r->al_len = 0;
+        return;
+    }
+    for (i = 0; i < r->nsamples; i++) {
+        const char *text = r->al_buf + r->samples[i].req_off;
+        uint64_t start = r->samples[i].out_start;
+        uint64_t end = (i + 1 < r->nsamples) ? r->samples[i + 1].out_start : r->out.queued;
+        uint64_t sent = r->out.sent;
+        if (sent < start) sent = start;
+        if (sent > end) sent = end;
+        uint64_t unsent = end - sent;
+        long long body = r->samples[i].body_len;
+        if (body >= 0) {
+            body = (unsent >= (uint64_t)body) ? 0 : body - (long long)unsent;
+        }
+        zv_access_log_entry_t e;
+        e.method = r->samples[i].has_method ? text : NULL;
+        e.method_len = r->samples[i].method_len;
+        e.uri = r->samples[i].has_uri ? text + r->samples[i].method_len : NULL;
+        e.uri_len = r->samples[i].uri_len;
+        e.http_major = r->samples[i].http_major;
+        e.http_minor = r->samples[i].http_minor;
+        e.status = r->samples[i].status;
+        e.body_bytes = body;
+        e.request_ns = (long long)(now - r->samples[i].start_ns);
+        zv_access_log_write(r, &e);
+    }
+    r->al_len = 0;
+}
+
+// 响应入队前计数并记下请求开始时间和它在输出链上的起点，等 r->out 发完再记耗时和访问日志
+void zv_http_note_response(zv_http_request_t *r, int status, long long body_len) {
+    zv_stats_status(status);
+    ZV_PROBE4(response, r->fd, status, r->req_start_ns, r->req_start_ns ? zv_now_ns() - r->req_start_ns : 0);
+    if (r->nsamples < ZV_HTTP_SAMPLES_MAX && r->req_start_ns) {
+        int i = r->nsamples++;
+        r->samples[i].start_ns = r->req_start_ns;
+        r->samples[i].status = status;
+        r->samples[i].body_len = body_len;
+        r->samples[i].out_start = r->out.queued;
+        if (zv_access_log_enabled()) {
+            copy_request_line(r, i);
+        }
+    } else if (zv_access_log_enabled()) {
+        // 样本满了（超长的流水线批次）：按计划的长度立即记，不计耗时
+        zv_access_log_entry_t e;
+        e.method = (const char *)r->request_start;
+        e.method_len = (r->request_start && r->method_end) ? (size_t)((const char *)r->method_end - (const char *)r->request_start) : 0;
+        e.uri = (const char *)r->uri_start;
+        e.uri_len = (r->uri_start && r->uri_end) ? (size_t)((const char *)r->uri_end - (const char *)r->uri_start) : 0;
+        if (!r->method_end) {
+            e.method = NULL;
+        }
+        if (!r->uri_end) {
+            e.uri = NULL;
+        }
+        e.http_major = r->http_major;
+        e.http_minor = r->http_minor;
+        e.status = status;
+        e.body_bytes = body_len;
+        e.request_ns = -1;
+        zv_access_log_write(r, &e);
+    }
+    r->req_start_ns = 0;
+}
+
+void zv_http_record_sent(zv_http_request_t *r, int done) {
+    int i;
+    if (r->nsamples == 0) {
+        return;
+    }
+    uint64_t now = zv_now_ns();
+    // 首字节：只统计连接上的第一个响应（从 accept 算起）
+    if (r->accept_ns) {
+        zv_stats_observe(ZV_HIST_TTFB, r->samples[0].status, now - r->accept_ns);
+        r->accept_ns = 0;
+    }
+    // 探针：入队后的第一次发送算作这个响应的首字节
+    if (ZV_PROBE_ENABLED(first_byte)) {
+        for (i = r->nfirst; i < r->nsamples; i++) {
+            ZV_PROBE4(first_byte, r->fd, r->samples[i].status, r->samples[i].start_ns, now - r->samples[i].start_ns);
+        }
+    }
+    r->nfirst = r->nsamples;
+    // CGI 响应在结束块入队之前都不算发完
+    if (!done || (r->cgi_active && !r->cgi_final_queued)) {
+        return;
+    }
+    for (i = 0; i < r->nsamples; i++) {
+        zv_stats_observe(ZV_HIST_DURATION, r->samples[i].status, now - r->samples[i].start_ns);
+        ZV_PROBE4(response_done, r->fd, r->samples[i].status, r->samples[i].start_ns, now - r->samples[i].start_ns);
+    }
+    log_samples(r, now);
+    r->nsamples = 0;
+    r->nfirst = 0;
+}
+
 static int zv_http_process_ignore(zv_http_request_t *r, zv_http_out_t *out, char *data, int len) {
     (void) r;
     (void) out;
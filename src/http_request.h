@@ -9,10 +9,14 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include <sys/types.h>
+#include <netinet/in.h>
 #include "list.h"
 #include "util.h"
+#include "out_chain.h"
+#include "file_cache.h"
 
 #define ZV_AGAIN    EAGAIN
 
@@ -33,8 +37,10 @@
 
 #define MAX_BUF 8124
 
-/* output buffer sizes (avoid depending on http.h to prevent circular includes) */
-#define ZV_OUT_HEADER_SIZE 8192
+/* output arena size (avoid depending on http.h to prevent circular includes) */
+#define ZV_OUT_BUF_SIZE 8192
+/* responses timed per flush (ZV_PIPELINE_BATCH_MAX plus slack; extras are not timed) */
+#define ZV_HTTP_SAMPLES_MAX 40
 
 typedef struct zv_http_request_s {
     void *root;
@@ -74,19 +80,52 @@ typedef struct zv_http_request_s {
     /* timeouts (ms) copied from config at init */
     size_t keep_alive_timeout_ms;
     size_t request_timeout_ms;
+    /* max file bytes sent per writable event before yielding (0 = unlimited) */
+    size_t send_quantum;
+    /* send-queue tuning copied from config (0 = kernel default) */
+    int sndbuf;
+    int notsent_lowat;
+    size_t large_file_bytes;        /* 0 = never switch to the large_* values */
+    int large_sndbuf;
+    int large_notsent_lowat;
+    int large_tuned;                /* socket currently carries the large_* values */
+    size_t mmap_threshold;          /* serve files >= this from mmap (0 = always sendfile) */
+    size_t page_cache_budget;       /* drop sent pages of files larger than this (0 = never) */
+    struct zv_aio_task_s *aio_task; /* helper-thread work in flight for this connection */
+    /* async static file lookup: do_request resumes with these once it completes */
+    void *lookup_out;               /* zv_http_out_t of the request waiting for the lookup */
+    zv_file_meta_t lookup_meta;
+    int lookup_fd;                  /* opened by the helper thread, -1 if none */
 
     /* output state for non-blocking write continuation */
     int keep_alive;                 /* for current response */
     int writing;                    /* 1 when waiting EPOLLOUT to continue */
-    char out_header[ZV_OUT_HEADER_SIZE];
-    size_t out_header_len;
-    size_t out_header_sent;
-    char *out_body;                 /* optional heap buffer for error page */
-    size_t out_body_len;
-    size_t out_body_sent;
-    int out_file_fd;                /* optional file fd for sendfile */
-    off_t out_file_offset;
-    size_t out_file_size;
+    int idle;                       /* a keep-alive response went out, no new bytes since */
+    /* latency samples (monotonic ns): recorded once the responses are fully sent */
+    const char *metrics_path;       /* copied from config, NULL = no metrics endpoint */
+    struct in_addr remote_addr;     /* peer address, for the access log */
+    uint64_t accept_ns;             /* connection accepted; cleared after the first-byte sample */
+    uint64_t req_start_ns;          /* first byte of the request being parsed */
+    int nsamples;                   /* responses queued on out and not timed yet */
+    int nfirst;                     /* samples whose first_byte probe already fired */
+    struct {
+        uint64_t start_ns;
+        int status;
+        long long body_len;         /* planned body length, < 0: chunked */
+        uint64_t out_start;         /* out.queued when the response was queued */
+        uint32_t req_off;           /* request line parts copied into al_buf (access log only) */
+        uint32_t method_len;        /* method at req_off, uri right after it */
+        uint32_t uri_len;
+        int has_method;
+        int has_uri;
+        int http_major;
+        int http_minor;
+    } samples[ZV_HTTP_SAMPLES_MAX];
+    char *al_buf;                   /* request line copies of the samples (kept across reuse) */
+    size_t al_len;
+    size_t al_cap;
+    zv_out_chain_t out;             /* queued response: memory + file segments */
+    char out_buf[ZV_OUT_BUF_SIZE];  /* arena for headers / small bodies referenced by out */
 
     /* freelist link (used only when caching zv_http_request_t) */
     struct list_head freelist;
@@ -109,22 +148,11 @@ typedef struct zv_http_request_s {
     char cgi_hdr_buf[4096];// CGI 响应头缓冲区
     size_t cgi_hdr_len;// 已读到缓冲区的字节数
 
-    char cgi_http_header[4096];// CGI 生成的 HTTP 响应头发送缓冲区
-    size_t cgi_http_header_len;// CGI 生成的 HTTP 响应头长度
-    size_t cgi_http_header_sent;// CGI 生成的 HTTP 响应头已发送字节数
+    /* chunked transfer encoding: header/prefix/body/suffix are queued on r->out */
+    int cgi_final_queued;       // 结束块 "0\r\n\r\n" 是否已入队
 
-    /* chunked transfer encoding state for CGI streaming */
-    char cgi_chunk_prefix[32]; // 每个 chunk 前缀缓冲区（格式：<chunk-size>\r\n）
-    size_t cgi_chunk_prefix_len;// 前缀长度
-    size_t cgi_chunk_prefix_sent;// 已发送前缀字节数
-    size_t cgi_chunk_suffix_sent; //后缀\r\n已发送字节数
-    char cgi_final_chunk[8];      /* "0\r\n\r\n" */
-    size_t cgi_final_chunk_len;
-    size_t cgi_final_chunk_sent;
-
-    char cgi_body_buf[8192];    // CGI 输出正文缓冲区
+    char cgi_body_buf[8192];    // CGI 输出正文缓冲区（入队后直到发完前不能复用）
     size_t cgi_body_len;        // 正文字节数
-    size_t cgi_body_sent;       // 已发送正文字节数
 } zv_http_request_t;
 
 typedef struct {
@@ -151,6 +179,12 @@ typedef struct {
 
 void zv_http_handle_header(zv_http_request_t *r, zv_http_out_t *o);
 int zv_http_close_conn(zv_http_request_t *r);
+/* Parked between two keep-alive requests with nothing pending: safe to close (graceful stop). */
+int zv_http_request_idle(zv_http_request_t *r);
+/* A response is about to be queued on r->out (body_len < 0: chunked): count it and start timing it. */
+void zv_http_note_response(zv_http_request_t *r, int status, long long body_len);
+/* Some of r->out went out (done: all of it); record first-byte / duration samples and log finished responses. */
+void zv_http_record_sent(zv_http_request_t *r, int done);
 
 int zv_init_request_t(zv_http_request_t *r, int fd, int epfd, zv_conf_t *cf);
 int zv_free_request_t(zv_http_request_t *r);
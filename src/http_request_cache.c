@@ -7,27 +7,25 @@
 #include <string.h>
 #include "dbg.h"
 #include "list.h"
+#include "stats.h"
 
 #ifndef ZV_REQUEST_FREELIST_MAX
 #define ZV_REQUEST_FREELIST_MAX 65536
 #endif
 
-/* We reuse zv_http_request_t memory blocks across connections within a worker process.
- * This is intentionally process-local (no locks).
+/* We reuse zv_http_request_t memory blocks across connections within a reactor thread.
+ * This is intentionally thread-local (no locks); a connection never changes reactor.
  */
-static list_head g_free_requests;
-static size_t g_free_count;
-static int g_inited;
+static __thread list_head g_free_requests;
+static __thread size_t g_free_count;
+static __thread int g_inited;
 
-static list_head g_deferred_requests;
+static __thread list_head g_deferred_requests;
+// 借出去还没还回来的请求块数，连接数限流和 drain 退出都看它；统计里的 get/put 只做观测
+static __thread size_t g_in_use;
 
-//DBUG数据统计
-static size_t g_get_calls;
-static size_t g_get_hits;
-static size_t g_get_mallocs;
-static size_t g_put_calls;
-static size_t g_put_frees;
-static size_t g_max_free_count;
+//DBUG数据统计（get/hit/malloc/put/free 计数在共享统计 slot 里，见 stats.h）
+static __thread size_t g_max_free_count;
 
 static void init_once(void) {
     if (!g_inited) {
@@ -36,21 +34,24 @@ static void init_once(void) {
         g_free_count = 0;
         g_inited = 1;
 
-        g_get_calls = 0;
-        g_get_hits = 0;
-        g_get_mallocs = 0;
-        g_put_calls = 0;
-        g_put_frees = 0;
         g_max_free_count = 0;
     }
 }
+// 请求块连同它的 epoll item 一起释放
+static void free_request(zv_http_request_t *r) {
+    free(r->conn_item);
+    free(r->cgi_out_item);
+    free(r->cgi_in_item);
+    free(r->al_buf);
+    free(r);
+}
 //释放 zv_http_request_t 结构体到缓存空闲链表
 static void put_internal(zv_http_request_t *r) {
     if (!r) return;
     //如果缓存空闲链表已满则直接释放
     if (g_free_count >= ZV_REQUEST_FREELIST_MAX) {
-        free(r);
-        g_put_frees++;
+        free_request(r);
+        ZV_STAT_INC(req_cache_free);
         return;
     }
     //加入缓存空闲链表
@@ -66,7 +67,7 @@ static void put_internal(zv_http_request_t *r) {
 zv_http_request_t *zv_http_request_get(int fd, int epfd, zv_conf_t *cf) {
     init_once();
 
-    g_get_calls++;//DBUG 统计获取调用次数
+    ZV_STAT_INC(req_cache_get);//统计获取调用次数
 
     zv_http_request_t *r = NULL;
     //如果缓存空闲链表不为空则直接取出一个，否则新分配一个
@@ -74,7 +75,7 @@ zv_http_request_t *zv_http_request_get(int fd, int epfd, zv_conf_t *cf) {
         list_head *pos = g_free_requests.next;
         list_del(pos);
         r = list_entry(pos, zv_http_request_t, freelist);
-        g_get_hits++;
+        ZV_STAT_INC(req_cache_hit);
         if (g_free_count > 0) {
             g_free_count--;
         }
@@ -82,8 +83,9 @@ zv_http_request_t *zv_http_request_get(int fd, int epfd, zv_conf_t *cf) {
         r = (zv_http_request_t *)malloc(sizeof(zv_http_request_t));
         if (!r) return NULL;
         memset(r, 0, sizeof(*r));
-        g_get_mallocs++;
+        ZV_STAT_INC(req_cache_malloc);
     }
+    g_in_use++;
     //初始化请求结构体
     (void)zv_init_request_t(r, fd, epfd, cf);
     
@@ -94,7 +96,8 @@ void zv_http_request_put(zv_http_request_t *r) {
     if (!r) return;
     init_once();
 
-    g_put_calls++;//DBUG 统计释放调用次数
+    ZV_STAT_INC(req_cache_put);//统计释放调用次数
+    g_in_use--;
     put_internal(r);//放入缓存空闲链表
 }
 // 释放 zv_http_request_t 结构体延迟释放链表
@@ -116,18 +119,36 @@ void zv_http_request_deferred_flush(void) {
         zv_http_request_put(r);
     }
 }
+// 当前 reactor 借出去还没还回来的请求块数（包括等待 flush 的）
+size_t zv_http_request_in_use(void) {
+    return g_in_use;
+}
+// reactor 退出：释放缓存空闲链表里的所有请求块
+void zv_http_request_cache_release(void) {
+    if (!g_inited) {
+        return;
+    }
+    zv_http_request_deferred_flush();
+    while (!list_empty(&g_free_requests)) {
+        list_head *pos = g_free_requests.next;
+        list_del(pos);
+        free_request(list_entry(pos, zv_http_request_t, freelist));
+    }
+    g_free_count = 0;
+}
 //DBUG 输出缓存使用统计信息
 void zv_http_request_cache_dump_stats(void) {
     if (!g_inited) {
         return;
     }
 
-    log_status("request_cache: get=%zu hit=%zu malloc=%zu put=%zu free=%zu free_now=%zu free_max=%zu max_cap=%d",
-             g_get_calls,
-             g_get_hits,
-             g_get_mallocs,
-             g_put_calls,
-             g_put_frees,
+    const zv_stats_counters_t *c = &zv_stats->c;
+    log_status("request_cache: get=%llu hit=%llu malloc=%llu put=%llu free=%llu free_now=%zu free_max=%zu max_cap=%d",
+             (unsigned long long)c->req_cache_get,
+             (unsigned long long)c->req_cache_hit,
+             (unsigned long long)c->req_cache_malloc,
+             (unsigned long long)c->req_cache_put,
+             (unsigned long long)c->req_cache_free,
              g_free_count,
              g_max_free_count,
              (int)ZV_REQUEST_FREELIST_MAX);
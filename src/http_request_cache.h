@@ -12,7 +12,12 @@ void zv_http_request_put(zv_http_request_t *r);
 /* Defer putting requests back into the freelist until a safe point (end of epoll batch). */
 void zv_http_request_put_deferred(zv_http_request_t *r);
 void zv_http_request_deferred_flush(void);
-/* Print cache stats once (process-local). */
+/* Request blocks handed out and not yet put back (per reactor), counting
+ * deferred ones and the listener's own block. */
+size_t zv_http_request_in_use(void);
+/* Free every cached request block (reactor shutdown). */
+void zv_http_request_cache_release(void);
+/* Print cache stats once (per reactor). */
 void zv_http_request_cache_dump_stats(void);
 
 #endif
@@ -0,0 +1,161 @@
+/*
+ * Prometheus text exposition (see metrics.h).
+ */
+
+#include "metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "stats.h"
+#include "dbg.h"
+
+#define ZV_METRICS_INITIAL_SIZE 16384
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} zv_mbuf_t;
+
+static void mb_printf(zv_mbuf_t *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void mb_printf(zv_mbuf_t *b, const char *fmt, ...) {
+    va_list ap;
+    if (b->failed) {
+        return;
+    }
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            b->failed = 1;
+            return;
+        }
+        if ((size_t)n < b->cap - b->len) {
+            b->len += (size_t)n;
+            return;
+        }
+        // 放不下：翻倍后重新格式化这一行
+        size_t cap = b->cap * 2;
+        while (cap - b->len <= (size_t)n) {
+            cap *= 2;
+        }
+        char *p = (char *)realloc(b->data, cap);
+        if (!p) {
+            b->failed = 1;
+            return;
+        }
+        b->data = p;
+        b->cap = cap;
+    }
+}
+
+static unsigned long long gauge(uint64_t up, uint64_t down) {
+    return up > down ? (unsigned long long)(up - down) : 0;
+}
+
+static const char *class_name(int cls) {
+    static const char *names[6] = {"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+    return names[cls];
+}
+
+static void counter(zv_mbuf_t *b, const char *name, const char *help, uint64_t v) {
+    mb_printf(b, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)v);
+}
+
+// 累积桶：le 是桶的上界（微秒换成秒，精确到 1us），最后一个桶只出现在 +Inf 里
+static void histogram(zv_mbuf_t *b, const char *name, const char *help, const zv_hist_t *h) {
+    int cls, i;
+    mb_printf(b, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (cls = 0; cls < 6; cls++) {
+        uint64_t count = 0;
+        for (i = 0; i < ZV_HIST_BUCKETS; i++) {
+            count += h[cls].bucket[i];
+        }
+        if (count == 0) {
+            continue;
+        }
+        uint64_t cum = 0;
+        for (i = 0; i < ZV_HIST_BUCKETS - 1; i++) {
+            uint64_t le = zv_hist_bucket_limit(i);
+            cum += h[cls].bucket[i];
+            mb_printf(b, "%s_bucket{class=\"%s\",le=\"%llu.%06llu\"} %llu\n", name, class_name(cls),
+                      (unsigned long long)(le / 1000000), (unsigned long long)(le % 1000000),
+                      (unsigned long long)cum);
+        }
+        mb_printf(b, "%s_bucket{class=\"%s\",le=\"+Inf\"} %llu\n", name, class_name(cls), (unsigned long long)count);
+        mb_printf(b, "%s_sum{class=\"%s\"} %llu.%06llu\n", name, class_name(cls),
+                  (unsigned long long)(h[cls].sum_us / 1000000), (unsigned long long)(h[cls].sum_us % 1000000));
+        mb_printf(b, "%s_count{class=\"%s\"} %llu\n", name, class_name(cls), (unsigned long long)count);
+    }
+}
+
+char *zv_metrics_render(size_t *len) {
+    int i, cls;
+    zv_stats_counters_t *t = (zv_stats_counters_t *)malloc(sizeof(*t));
+    zv_mbuf_t b;
+    b.data = (char *)malloc(ZV_METRICS_INITIAL_SIZE);
+    b.len = 0;
+    b.cap = ZV_METRICS_INITIAL_SIZE;
+    b.failed = 0;
+    if (!t || !b.data) {
+        log_err("metrics: out of memory");
+        free(t);
+        free(b.data);
+        return NULL;
+    }
+    zv_stats_total(t);
+
+    counter(&b, "zaver_requests_total", "Request heads parsed.", t->requests);
+    mb_printf(&b, "# HELP zaver_responses_total Responses queued, by status class.\n# TYPE zaver_responses_total counter\n");
+    for (cls = 1; cls <= 6; cls++) {
+        // other 放最后
+        mb_printf(&b, "zaver_responses_total{class=\"%s\"} %llu\n", class_name(cls % 6), (unsigned long long)t->status[cls % 6]);
+    }
+    counter(&b, "zaver_bytes_sent_total", "Bytes written to client sockets.", t->bytes_out);
+    counter(&b, "zaver_connections_accepted_total", "Connections accepted.", t->conns_accepted);
+    mb_printf(&b, "# HELP zaver_connections Open client connections (idle: parked between keep-alive requests).\n# TYPE zaver_connections gauge\n");
+    mb_printf(&b, "zaver_connections{state=\"open\"} %llu\n", gauge(t->conns_accepted, t->conns_closed));
+    mb_printf(&b, "zaver_connections{state=\"idle\"} %llu\n", gauge(t->idle_enter, t->idle_leave));
+    counter(&b, "zaver_file_cache_lookups_total", "File metadata cache lookups.", t->file_cache_get);
+    counter(&b, "zaver_file_cache_hits_total", "File metadata cache hits.", t->file_cache_hit);
+    counter(&b, "zaver_request_cache_gets_total", "Request blocks taken.", t->req_cache_get);
+    counter(&b, "zaver_request_cache_hits_total", "Request blocks reused from the freelist.", t->req_cache_hit);
+    counter(&b, "zaver_zerocopy_sends_total", "MSG_ZEROCOPY sends.", t->zc_sends);
+    counter(&b, "zaver_zerocopy_copied_total", "MSG_ZEROCOPY sends the kernel copied anyway.", t->zc_copied);
+    counter(&b, "zaver_access_log_lines_total", "Access log entries queued for the writer thread.", t->access_log_lines);
+    counter(&b, "zaver_access_log_dropped_total", "Access log entries dropped because the ring was full.", t->access_log_dropped);
+
+    // 每个 reactor 一行（worker 内的 reactor 各有一个 slot）
+    mb_printf(&b, "# HELP zaver_worker_connections Open client connections per worker reactor.\n# TYPE zaver_worker_connections gauge\n");
+    for (i = 0; i < zv_stats_nslots(); i++) {
+        const zv_stats_slot_t *s = zv_stats_slot(i);
+        if (!s || s->reactor < 0) {
+            continue;
+        }
+        long pid = s->owner > 0 ? (long)s->owner : (long)getpid();
+        mb_printf(&b, "zaver_worker_connections{worker=\"%d\",reactor=\"%d\",pid=\"%ld\",state=\"open\"} %llu\n",
+                  s->worker, s->reactor, pid,
+                  gauge(__atomic_load_n(&s->c.conns_accepted, __ATOMIC_RELAXED), __atomic_load_n(&s->c.conns_closed, __ATOMIC_RELAXED)));
+        mb_printf(&b, "zaver_worker_connections{worker=\"%d\",reactor=\"%d\",pid=\"%ld\",state=\"idle\"} %llu\n",
+                  s->worker, s->reactor, pid,
+                  gauge(__atomic_load_n(&s->c.idle_enter, __ATOMIC_RELAXED), __atomic_load_n(&s->c.idle_leave, __ATOMIC_RELAXED)));
+    }
+
+    histogram(&b, "zaver_ttfb_seconds", "Accept to first response byte sent, first response of each connection.",
+              t->hist[ZV_HIST_TTFB]);
+    histogram(&b, "zaver_request_duration_seconds", "First request byte read to last response byte sent.",
+              t->hist[ZV_HIST_DURATION]);
+
+    free(t);
+    if (b.failed) {
+        log_err("metrics: out of memory");
+        free(b.data);
+        return NULL;
+    }
+    *len = b.len;
+    return b.data;
+}
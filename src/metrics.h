@@ -0,0 +1,17 @@
+/*
+ * Prometheus text exposition of the shared counters (stats.h), served by
+ * the workers themselves on the configured metrics_path.
+ */
+
+#ifndef ZV_METRICS_H
+#define ZV_METRICS_H
+
+#include <stddef.h>
+
+/*
+ * Render every counter, gauge and latency histogram in the text format
+ * (version 0.0.4). return: malloc'd body (caller frees), NULL on error
+ */
+char *zv_metrics_render(size_t *len);
+
+#endif
@@ -0,0 +1,632 @@
+/*
+ * Output chain: queued response bytes made of memory and file segments
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* preadv2 / RWF_NOWAIT */
+#endif
+
+#include "out_chain.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#include "dbg.h"
+#include "stats.h"
+
+#ifndef ZV_OUT_SEG_FREELIST_MAX
+#define ZV_OUT_SEG_FREELIST_MAX 4096
+#endif
+/* DONTNEED is issued once this many bytes behind the send offset have piled up */
+#define ZV_OUT_DROP_CHUNK (1024 * 1024)
+/* largest page-cache folio (PMD size); a folio is only dropped when a call covers all of it */
+#define ZV_OUT_DROP_ALIGN (2 * 1024 * 1024)
+
+/* 段节点缓存（每个 reactor 线程一份，无锁），避免每个响应都 malloc/free */
+static __thread zv_out_seg_t *g_free_segs;
+static __thread size_t g_free_count;
+
+static void advise_file(int sockfd, zv_out_chain_t *c, zv_out_seg_t *s);
+
+static zv_out_seg_t *seg_alloc(void) {
+    zv_out_seg_t *s = g_free_segs;
+    if (s) {
+        g_free_segs = s->next;
+        g_free_count--;
+    } else {
+        s = (zv_out_seg_t *)malloc(sizeof(zv_out_seg_t));
+        if (!s) return NULL;
+    }
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    return s;
+}
+
+static void seg_free(zv_out_seg_t *s) {
+    if (g_free_count >= ZV_OUT_SEG_FREELIST_MAX) {
+        free(s);
+        return;
+    }
+    s->next = g_free_segs;
+    g_free_segs = s;
+    g_free_count++;
+}
+
+// 段离开链表：执行 release 回调、关闭自有 fd 并回收节点
+static void seg_release(zv_out_seg_t *s) {
+    if (s->release) {
+        s->release(s->release_data);
+    }
+    if (s->kind == ZV_OUT_SEG_FILE && (s->flags & ZV_OUT_SEG_CLOSE_FD) && s->fd >= 0) {
+        close(s->fd);
+    }
+    if (s->kind == ZV_OUT_SEG_MEM && (s->flags & ZV_OUT_SEG_MUNMAP) && s->start) {
+        munmap((void *)s->start, (size_t)(s->last - s->start));
+    }
+    seg_free(s);
+}
+
+static void chain_link(zv_out_chain_t *c, zv_out_seg_t *s) {
+    s->next = NULL;
+    if (c->tail) {
+        c->tail->next = s;
+    } else {
+        c->head = s;
+    }
+    c->tail = s;
+}
+
+static zv_out_seg_t *chain_unlink_head(zv_out_chain_t *c) {
+    zv_out_seg_t *s = c->head;
+    c->head = s->next;
+    if (c->head == NULL) {
+        c->tail = NULL;
+    }
+    s->next = NULL;
+    return s;
+}
+
+static void chain_pop(zv_out_chain_t *c) {
+    seg_release(chain_unlink_head(c));
+}
+
+// 释放 zc 链表上已被内核确认的段（id 按发送顺序递增，完成通知也按序到达）
+static void zc_release_acked(zv_out_chain_t *c) {
+    while (c->zc_head && (int32_t)(c->zc_head->zc_seq - c->zc_acked) < 0) {
+        zv_out_seg_t *s = c->zc_head;
+        c->zc_head = s->next;
+        if (c->zc_head == NULL) {
+            c->zc_tail = NULL;
+        }
+        seg_release(s);
+    }
+}
+
+void zv_out_chain_init(zv_out_chain_t *c, char *buf, size_t buf_cap) {
+    c->head = NULL;
+    c->tail = NULL;
+    c->buf = buf;
+    c->buf_cap = buf_cap;
+    c->buf_used = 0;
+    c->zc_threshold = 0;
+    c->zc_next = 0;
+    c->zc_acked = 0;
+    c->zc_head = NULL;
+    c->zc_tail = NULL;
+    c->probe_window = 0;
+    c->readahead = 0;
+    c->queued = 0;
+    c->sent = 0;
+}
+
+void zv_out_chain_reset(zv_out_chain_t *c) {
+    while (c->head) {
+        chain_pop(c);
+    }
+    c->buf_used = 0;
+}
+
+void zv_out_chain_free(zv_out_chain_t *c) {
+    zv_out_chain_reset(c);
+    // 连接要关闭了：在途的零拷贝段只剩 mmap 的文件页，由内核持有页引用，可以直接释放
+    c->zc_acked = c->zc_next;
+    zc_release_acked(c);
+    c->zc_threshold = 0;
+}
+
+int zv_out_chain_empty(const zv_out_chain_t *c) {
+    return c->head == NULL;
+}
+
+int zv_out_chain_has_file(const zv_out_chain_t *c) {
+    for (const zv_out_seg_t *s = c->head; s; s = s->next) {
+        if (s->kind == ZV_OUT_SEG_FILE) return 1;
+    }
+    return 0;
+}
+
+char *zv_out_chain_buf_reserve(zv_out_chain_t *c, size_t *avail) {
+    *avail = c->buf_cap - c->buf_used;
+    return c->buf + c->buf_used;
+}
+
+int zv_out_chain_buf_commit(zv_out_chain_t *c, size_t len) {
+    if (len > c->buf_cap - c->buf_used) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    const char *start = c->buf + c->buf_used;
+    c->buf_used += len;
+    // 与尾部的 arena 段相邻时直接延长，header + body 合并成一个 iovec
+    zv_out_seg_t *t = c->tail;
+    if (t && t->kind == ZV_OUT_SEG_MEM && t->flags == 0 && t->release == NULL && t->last == start) {
+        t->last = start + len;
+        c->queued += len;
+        return 0;
+    }
+    return zv_out_chain_append_mem(c, start, len, NULL, NULL);
+}
+
+int zv_out_chain_append_copy(zv_out_chain_t *c, const void *data, size_t len) {
+    size_t avail;
+    char *p = zv_out_chain_buf_reserve(c, &avail);
+    if (len > avail) {
+        return -1;
+    }
+    memcpy(p, data, len);
+    return zv_out_chain_buf_commit(c, len);
+}
+
+int zv_out_chain_append_mem(zv_out_chain_t *c, const void *data, size_t len,
+                            zv_out_release_pt release, void *release_data) {
+    zv_out_seg_t *s = seg_alloc();
+    if (!s) {
+        return -1;
+    }
+    s->kind = ZV_OUT_SEG_MEM;
+    s->start = (const char *)data;
+    s->pos = (const char *)data;
+    s->last = (const char *)data + len;
+    s->release = release;
+    s->release_data = release_data;
+    chain_link(c, s);
+    c->queued += len;
+    return 0;
+}
+
+int zv_out_chain_append_file(zv_out_chain_t *c, int fd, off_t offset, off_t len, int flags) {
+    zv_out_seg_t *s = seg_alloc();
+    if (!s) {
+        return -1;
+    }
+    s->kind = ZV_OUT_SEG_FILE;
+    s->flags = flags;
+    s->fd = fd;
+    s->file_pos = offset;
+    s->file_last = offset + len;
+    s->ra_last = offset;
+    s->drop_pos = offset;
+    if (flags & ZV_OUT_SEG_SEQUENTIAL) {
+        // 加大内核预读窗口；没有辅助线程时顺便请求第一个窗口
+        (void)posix_fadvise(fd, offset, len, POSIX_FADV_SEQUENTIAL);
+        advise_file(-1, c, s);
+    }
+    chain_link(c, s);
+    c->queued += (uint64_t)len;
+    return 0;
+}
+
+int zv_out_chain_append_mmap(zv_out_chain_t *c, void *addr, size_t len) {
+    if (zv_out_chain_append_mem(c, addr, len, NULL, NULL) < 0) {
+        return -1;
+    }
+    c->tail->flags = ZV_OUT_SEG_MUNMAP;
+    if (c->zc_threshold > 0 && len >= c->zc_threshold) {
+        c->tail->flags |= ZV_OUT_SEG_ZEROCOPY;
+    }
+    return 0;
+}
+
+int zv_out_chain_enable_zerocopy(zv_out_chain_t *c, int sockfd, size_t threshold) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    int one = 1;
+    if (threshold == 0 || setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+        return -1;
+    }
+    c->zc_threshold = threshold;
+    return 0;
+#else
+    (void)c;
+    (void)sockfd;
+    (void)threshold;
+    errno = ENOPROTOOPT;
+    return -1;
+#endif
+}
+
+int zv_out_chain_zc_pending(const zv_out_chain_t *c) {
+    return c->zc_next != c->zc_acked || c->zc_head != NULL;
+}
+
+int zv_out_chain_zc_reap(int sockfd, zv_out_chain_t *c) {
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    char control[128];
+    for (;;) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // [ee_info, ee_data] 这一段 id 的发送都完成了
+            uint32_t lo = ee->ee_info;
+            uint32_t hi = ee->ee_data;
+            if ((int32_t)(hi + 1 - c->zc_acked) > 0) {
+                c->zc_acked = hi + 1;
+            }
+            // MSG_ZEROCOPY 统计：完成次数、内核退化为拷贝的次数（如 loopback）
+            ZV_STAT_ADD(zc_completed, hi - lo + 1);
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                ZV_STAT_ADD(zc_copied, hi - lo + 1);
+            }
+        }
+    }
+#else
+    (void)sockfd;
+    c->zc_acked = c->zc_next;
+#endif
+    zc_release_acked(c);
+    return 0;
+}
+
+void zv_out_chain_dump_stats(void) {
+    const zv_stats_counters_t *st = &zv_stats->c;
+    if (st->zc_sends == 0) {
+        return;
+    }
+    log_status("zerocopy: sends=%llu completed=%llu copied=%llu nobufs=%llu",
+               (unsigned long long)st->zc_sends, (unsigned long long)st->zc_completed,
+               (unsigned long long)st->zc_copied, (unsigned long long)st->zc_nobufs);
+}
+
+void zv_out_chain_release_cache(void) {
+    while (g_free_segs) {
+        zv_out_seg_t *s = g_free_segs;
+        g_free_segs = s->next;
+        free(s);
+    }
+    g_free_count = 0;
+}
+
+// sendmsg 发送了 n 字节：从头部依次消费内存段，发完的段出链
+static void consume_mem(zv_out_chain_t *c, size_t n) {
+    while (c->head && c->head->kind == ZV_OUT_SEG_MEM) {
+        zv_out_seg_t *s = c->head;
+        size_t rem = (size_t)(s->last - s->pos);
+        size_t take = (n >= rem) ? rem : n;
+        s->pos += take;
+        n -= take;
+        if (s->pos < s->last) {
+            break;
+        }
+        chain_pop(c);
+    }
+}
+
+static int send_mem_run(int sockfd, zv_out_chain_t *c) {
+    struct iovec iov[ZV_OUT_IOV_MAX];
+    int iovcnt = 0;
+    zv_out_seg_t *s = c->head;
+    // 收集连续的内存段，一次 sendmsg 发出（零拷贝段单独发）
+    for (; s && s->kind == ZV_OUT_SEG_MEM && !(s->flags & ZV_OUT_SEG_ZEROCOPY) && iovcnt < ZV_OUT_IOV_MAX; s = s->next) {
+        if (s->pos == s->last) continue;
+        iov[iovcnt].iov_base = (void *)s->pos;
+        iov[iovcnt].iov_len = (size_t)(s->last - s->pos);
+        iovcnt++;
+    }
+    if (iovcnt == 0) {
+        consume_mem(c, 0);
+        return 0;
+    }
+
+    // 后面还有段（通常是 sendfile 的文件体）：MSG_MORE 让内核先攒着，
+    // header 和文件开头合成满尺寸的报文，最后一段发出时自然推送
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+    ssize_t n = sendmsg(sockfd, &msg, s ? MSG_MORE : 0);
+    if (n > 0) {
+        ZV_STAT_ADD(bytes_out, n);
+        c->sent += (uint64_t)n;
+        consume_mem(c, (size_t)n);
+        return 0;
+    }
+    if (n == 0) {
+        errno = EPIPE;
+        return -1;
+    }
+    if (errno == EINTR) {
+        return 0;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 1;
+    }
+    return -1;
+}
+
+/*
+ * 用 RWF_NOWAIT 各读 1 字节探测窗口首尾两页是否在 page cache 中。
+ * 返回 1 在缓存中，0 不在（读会阻塞在磁盘上），-1 文件系统不支持
+ */
+static int probe_resident(int fd, off_t start, off_t end) {
+#ifdef RWF_NOWAIT
+    char b;
+    struct iovec iov = { &b, 1 };
+    off_t at[2] = { start, end - 1 };
+    int n = ((end - 1) / 4096 != start / 4096) ? 2 : 1;
+    for (int i = 0; i < n; i++) {
+        ssize_t r = preadv2(fd, &iov, 1, at[i], RWF_NOWAIT);
+        if (r >= 0) continue;
+        if (errno == EAGAIN) return 0;
+        return -1;
+    }
+    return 1;
+#else
+    (void)fd;
+    (void)start;
+    (void)end;
+    return -1;
+#endif
+}
+
+/*
+ * 顺序读的文件段：剩余预读不足半个窗口时，再向前 WILLNEED 一个窗口。WILLNEED 会同步
+ * 提交 IO（冷文件上每次可达数百微秒），开了探测时改由辅助线程在读入冷窗口后发出
+ * （见 zv_out_chain_readahead_range），这里只在没有辅助线程时兜底；
+ * DONTNEED 段：对端已确认的部分每攒够 ZV_OUT_DROP_CHUNK 就从 page cache 丢弃，
+ * 一次性的超大下载不会把热的小文件挤出缓存
+ */
+static void advise_file(int sockfd, zv_out_chain_t *c, zv_out_seg_t *s) {
+    if ((s->flags & ZV_OUT_SEG_SEQUENTIAL) && c->readahead > 0 && c->probe_window <= 0
+        && s->ra_last < s->file_last
+        && s->ra_last - s->file_pos < c->readahead / 2) {
+        off_t start = s->ra_last > s->file_pos ? s->ra_last : s->file_pos;
+        off_t end = s->file_pos + c->readahead;
+        if (end > s->file_last) end = s->file_last;
+        (void)posix_fadvise(s->fd, start, end - start, POSIX_FADV_WILLNEED);
+        s->ra_last = end;
+    }
+    if ((s->flags & ZV_OUT_SEG_DONTNEED) && sockfd >= 0
+        && s->file_pos - s->drop_pos >= ZV_OUT_DROP_CHUNK) {
+        // 发送队列里还没被确认的数据仍引用着这些页（内核会跳过它们），只丢已确认的整页
+        int outq = 0;
+        if (ioctl(sockfd, SIOCOUTQ, &outq) < 0) {
+            outq = 0;
+        }
+        off_t end = (s->file_pos - outq) & ~(off_t)4095;
+        if (end > s->drop_pos) {
+            // 从对齐边界重新开始，补上上次跨过 end 而没丢掉的大 folio（已丢的部分是空洞，很便宜）
+            off_t start = s->drop_pos & ~(off_t)(ZV_OUT_DROP_ALIGN - 1);
+            (void)posix_fadvise(s->fd, start, end - start, POSIX_FADV_DONTNEED);
+            s->drop_pos = end;
+        }
+    }
+}
+
+// max: 本次最多发送的字节数（发送配额剩余量）
+static int send_file_seg(int sockfd, zv_out_chain_t *c, size_t max, size_t *sent) {
+    zv_out_seg_t *s = c->head;
+    if (s->file_pos >= s->file_last) {
+        chain_pop(c);
+        return 0;
+    }
+
+    // 进入新窗口前先探测：冷数据交给辅助线程读入，避免 sendfile 卡住整个 worker
+    if (c->probe_window > 0 && s->file_pos >= s->warm_last) {
+        off_t end = s->file_pos + c->probe_window;
+        if (end > s->file_last) end = s->file_last;
+        int rc = probe_resident(s->fd, s->file_pos, end);
+        if (rc == 0) {
+            return 3;
+        }
+        if (rc < 0) {
+            c->probe_window = 0;
+        }
+        s->warm_last = end;
+    }
+
+    off_t off = s->file_pos;
+    size_t remaining = (size_t)(s->file_last - s->file_pos);
+    if (c->probe_window > 0 && s->warm_last - s->file_pos < (off_t)remaining) {
+        remaining = (size_t)(s->warm_last - s->file_pos);
+    }
+    if (remaining > max) {
+        remaining = max;
+    }
+    ssize_t n = sendfile(sockfd, s->fd, &off, remaining);
+    if (n > 0) {
+        s->file_pos = off;
+        *sent += (size_t)n;
+        ZV_STAT_ADD(bytes_out, n);
+        c->sent += (uint64_t)n;
+        if (s->flags & (ZV_OUT_SEG_SEQUENTIAL | ZV_OUT_SEG_DONTNEED)) {
+            advise_file(sockfd, c, s);
+        }
+        return 0;
+    }
+    if (n == 0) {
+        // 文件比预期短（被截断）：Content-Length 已经发出去了，连接上的帧已经对不上，只能关闭
+        errno = EIO;
+        log_warn("sendfile hit EOF early, fd=%d", s->fd);
+        return -1;
+    }
+    if (errno == EINTR) {
+        return 0;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        s->file_pos = off;
+        return 1;
+    }
+    return -1;
+}
+
+// 用 MSG_ZEROCOPY 发送头部的零拷贝段；发完的段挂到 zc 链表等内核确认
+static int send_zc_seg(int sockfd, zv_out_chain_t *c, size_t max, size_t *sent) {
+    zv_out_seg_t *s = c->head;
+    size_t remaining = (size_t)(s->last - s->pos);
+    size_t len = (remaining > max) ? max : remaining;
+    if (len == 0) {
+        chain_pop(c);
+        return 0;
+    }
+
+    struct iovec iov;
+    iov.iov_base = (void *)s->pos;
+    iov.iov_len = len;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    int more = (s->next || len < remaining) ? MSG_MORE : 0;
+
+    int zc = 0;
+    ssize_t n = -1;
+#ifdef MSG_ZEROCOPY
+    n = sendmsg(sockfd, &msg, MSG_ZEROCOPY | more);
+    zc = 1;
+    if (n < 0 && errno == ENOBUFS) {
+        // optmem 用完（在途通知太多）：这一次退回普通拷贝发送
+        ZV_STAT_INC(zc_nobufs);
+        zc = 0;
+        n = sendmsg(sockfd, &msg, more);
+    }
+#else
+    n = sendmsg(sockfd, &msg, more);
+#endif
+    if (n > 0) {
+        if (zc) {
+            s->zc_seq = c->zc_next++;
+            s->flags |= ZV_OUT_SEG_ZC_INFLIGHT;
+            ZV_STAT_INC(zc_sends);
+        }
+        s->pos += n;
+        *sent += (size_t)n;
+        ZV_STAT_ADD(bytes_out, n);
+        c->sent += (uint64_t)n;
+        if (s->pos == s->last) {
+            chain_unlink_head(c);
+            if (s->flags & ZV_OUT_SEG_ZC_INFLIGHT) {
+                if (c->zc_tail) {
+                    c->zc_tail->next = s;
+                } else {
+                    c->zc_head = s;
+                }
+                c->zc_tail = s;
+                // 完成通知可能在段发完之前就已收割
+                zc_release_acked(c);
+            } else {
+                seg_release(s);
+            }
+        }
+        return 0;
+    }
+    if (n == 0) {
+        errno = EPIPE;
+        return -1;
+    }
+    if (errno == EINTR) {
+        return 0;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 1;
+    }
+    return -1;
+}
+
+int zv_out_chain_cold_range(const zv_out_chain_t *c, int *fd, off_t *offset, size_t *len) {
+    const zv_out_seg_t *s = c->head;
+    if (!s || s->kind != ZV_OUT_SEG_FILE || s->file_pos >= s->file_last) {
+        return -1;
+    }
+    off_t end = s->file_pos + (c->probe_window > 0 ? c->probe_window : s->file_last - s->file_pos);
+    if (end > s->file_last) end = s->file_last;
+    *fd = s->fd;
+    *offset = s->file_pos;
+    *len = (size_t)(end - s->file_pos);
+    return 0;
+}
+
+int zv_out_chain_readahead_range(zv_out_chain_t *c, off_t from, off_t *offset, size_t *len) {
+    zv_out_seg_t *s = c->head;
+    if (!s || s->kind != ZV_OUT_SEG_FILE || !(s->flags & ZV_OUT_SEG_SEQUENTIAL) || c->readahead <= 0) {
+        return -1;
+    }
+    off_t start = s->ra_last > from ? s->ra_last : from;
+    off_t end = s->file_pos + c->readahead;
+    if (end > s->file_last) end = s->file_last;
+    if (start >= end) {
+        return -1;
+    }
+    s->ra_last = end;
+    *offset = start;
+    *len = (size_t)(end - start);
+    return 0;
+}
+
+void zv_out_chain_mark_warm(zv_out_chain_t *c, off_t end) {
+    zv_out_seg_t *s = c->head;
+    if (s && s->kind == ZV_OUT_SEG_FILE && end > s->warm_last) {
+        s->warm_last = end;
+    }
+}
+
+int zv_out_chain_send(int sockfd, zv_out_chain_t *c, size_t quantum) {
+    size_t body_sent = 0;
+    while (c->head) {
+        int rc;
+        zv_out_seg_t *h = c->head;
+        if (h->kind == ZV_OUT_SEG_FILE || (h->flags & ZV_OUT_SEG_ZEROCOPY)) {
+            // 大正文受配额限制：用完就让出，回到事件循环让其它连接先跑
+            if (quantum > 0 && body_sent >= quantum) {
+                return 2;
+            }
+            size_t max = quantum > 0 ? quantum - body_sent : (size_t)-1;
+            rc = (h->kind == ZV_OUT_SEG_FILE) ? send_file_seg(sockfd, c, max, &body_sent)
+                                              : send_zc_seg(sockfd, c, max, &body_sent);
+        } else {
+            rc = send_mem_run(sockfd, c);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    // 全部发完，arena 可以复用
+    c->buf_used = 0;
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Output chain: queued response bytes made of memory and file segments
+ */
+
+#ifndef ZV_OUT_CHAIN_H
+#define ZV_OUT_CHAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* max iovecs gathered for one sendmsg() over a run of memory segments */
+#define ZV_OUT_IOV_MAX 64
+
+typedef enum {
+    ZV_OUT_SEG_MEM = 1,
+    ZV_OUT_SEG_FILE = 2
+} zv_out_seg_kind_t;
+
+/* file segment owns its fd: close it once the segment is consumed or dropped */
+#define ZV_OUT_SEG_CLOSE_FD   0x01
+/* memory segment is sent with MSG_ZEROCOPY and held until the kernel acks it */
+#define ZV_OUT_SEG_ZEROCOPY   0x02
+/* memory segment is an mmap()ed file: munmap [start, last) on release */
+#define ZV_OUT_SEG_MUNMAP     0x04
+/* internal: at least one MSG_ZEROCOPY send of this segment is in flight */
+#define ZV_OUT_SEG_ZC_INFLIGHT 0x08
+/* file segment is read front to back: fadvise SEQUENTIAL, keep WILLNEED ahead of file_pos */
+#define ZV_OUT_SEG_SEQUENTIAL 0x10
+/* file segment is a one-off: fadvise DONTNEED on the pages behind file_pos */
+#define ZV_OUT_SEG_DONTNEED   0x20
+
+typedef void (*zv_out_release_pt)(void *data);
+
+typedef struct zv_out_seg_s {
+    zv_out_seg_kind_t kind;
+    int flags;
+    /* ZV_OUT_SEG_MEM: unsent bytes are [pos, last); start is the original pos */
+    const char *start;
+    const char *pos;
+    const char *last;
+    /* id of the last MSG_ZEROCOPY send that carried bytes of this segment */
+    uint32_t zc_seq;
+    /* ZV_OUT_SEG_FILE: unsent bytes are [file_pos, file_last) of fd */
+    int fd;
+    off_t file_pos;
+    off_t file_last;
+    /* [file_pos, warm_last) was last seen resident in the page cache */
+    off_t warm_last;
+    /* WILLNEED has been issued up to ra_last, DONTNEED up to drop_pos */
+    off_t ra_last;
+    off_t drop_pos;
+    /* optional hook run when the segment leaves the chain */
+    zv_out_release_pt release;
+    void *release_data;
+    struct zv_out_seg_s *next;
+} zv_out_seg_t;
+
+typedef struct {
+    zv_out_seg_t *head;
+    zv_out_seg_t *tail;
+    /*
+     * Scratch arena for headers and small bodies. Memory segments may point
+     * into it; it is rewound only when the whole chain has been drained.
+     */
+    char *buf;
+    size_t buf_cap;
+    size_t buf_used;
+    /*
+     * MSG_ZEROCOPY state. zc_threshold is 0 unless SO_ZEROCOPY is enabled on
+     * the socket. Zerocopy segments that were fully sent wait on the zc list
+     * until the kernel reports completion through the socket error queue.
+     */
+    size_t zc_threshold;
+    /*
+     * Page-cache probe window (0 = off). Before sendfile() touches a new
+     * window of a file segment, the window is probed with RWF_NOWAIT reads;
+     * if it is not resident, send returns 3 instead of blocking on disk.
+     */
+    off_t probe_window;
+    /*
+     * Read-ahead window kept requested (POSIX_FADV_WILLNEED) in front of the
+     * send offset of ZV_OUT_SEG_SEQUENTIAL file segments (0 = off). With the
+     * probe on, the advice is left to whoever reads in cold windows.
+     */
+    off_t readahead;
+    /* bytes ever appended / written to the socket since init (reset keeps them) */
+    uint64_t queued;
+    uint64_t sent;
+    uint32_t zc_next;   /* id the kernel assigns to the next zerocopy send */
+    uint32_t zc_acked;  /* every id below this has completed */
+    zv_out_seg_t *zc_head;
+    zv_out_seg_t *zc_tail;
+} zv_out_chain_t;
+
+void zv_out_chain_init(zv_out_chain_t *c, char *buf, size_t buf_cap);
+/*
+ * Drop every queued segment (closing owned fds) and rewind the arena.
+ * Zerocopy segments still waiting for completion are kept.
+ */
+void zv_out_chain_reset(zv_out_chain_t *c);
+/* Like reset, but also releases zerocopy segments; only for a closing socket. */
+void zv_out_chain_free(zv_out_chain_t *c);
+int zv_out_chain_empty(const zv_out_chain_t *c);
+int zv_out_chain_has_file(const zv_out_chain_t *c);
+
+/* Free space at the arena tail; write into it and then commit what was used. */
+char *zv_out_chain_buf_reserve(zv_out_chain_t *c, size_t *avail);
+int zv_out_chain_buf_commit(zv_out_chain_t *c, size_t len);
+int zv_out_chain_append_copy(zv_out_chain_t *c, const void *data, size_t len);
+
+/* Reference memory that stays valid until release(release_data) is called. */
+int zv_out_chain_append_mem(zv_out_chain_t *c, const void *data, size_t len,
+                            zv_out_release_pt release, void *release_data);
+int zv_out_chain_append_file(zv_out_chain_t *c, int fd, off_t offset, off_t len, int flags);
+/*
+ * Queue an mmap()ed region; it is unmapped when the segment is released.
+ * Bodies of at least zc_threshold bytes are marked ZV_OUT_SEG_ZEROCOPY.
+ */
+int zv_out_chain_append_mmap(zv_out_chain_t *c, void *addr, size_t len);
+
+/* Enable SO_ZEROCOPY on sockfd for bodies >= threshold; 0 on success. */
+int zv_out_chain_enable_zerocopy(zv_out_chain_t *c, int sockfd, size_t threshold);
+/* MSG_ZEROCOPY sends not yet acknowledged through the error queue */
+int zv_out_chain_zc_pending(const zv_out_chain_t *c);
+/*
+ * Read zerocopy completions from the socket error queue and release the
+ * segments they cover. return: 0 ok, -1 error (errno set)
+ */
+int zv_out_chain_zc_reap(int sockfd, zv_out_chain_t *c);
+void zv_out_chain_dump_stats(void);
+/* Free the cached segment nodes (reactor shutdown). */
+void zv_out_chain_release_cache(void);
+
+/*
+ * Write as much of the chain to sockfd as the socket accepts: runs of memory
+ * segments go out with one sendmsg(), file segments with sendfile(). A memory
+ * run that is not the end of the chain is sent with MSG_MORE so the header is
+ * coalesced with the body that follows instead of leaving as its own packet.
+ * Zerocopy segments go out alone with MSG_ZEROCOPY. quantum caps the file
+ * and zerocopy body bytes sent by one call (0 = no limit), so a fast client
+ * on a large body cannot monopolize the worker.
+ * return: 0 chain drained, 1 would block (EAGAIN), 2 quantum used up (socket
+ *         still writable, re-arm EPOLLOUT and resume later), 3 the next file
+ *         window is not in the page cache (see zv_out_chain_cold_range),
+ *         -1 error (errno set; EIO: a file ended before its segment did, the
+ *         advertised length cannot be met and the connection must close)
+ */
+int zv_out_chain_send(int sockfd, zv_out_chain_t *c, size_t quantum);
+
+/* After send returned 3: the file range that has to be read in first. */
+int zv_out_chain_cold_range(const zv_out_chain_t *c, int *fd, off_t *offset, size_t *len);
+/*
+ * Claim the part of the read-ahead window of a ZV_OUT_SEG_SEQUENTIAL head
+ * segment that lies beyond from and has not been advised yet; the caller
+ * issues POSIX_FADV_WILLNEED for it (off the event loop). -1 if nothing to do.
+ */
+int zv_out_chain_readahead_range(zv_out_chain_t *c, off_t from, off_t *offset, size_t *len);
+/* The range up to end has been read in; sendfile may go ahead without probing. */
+void zv_out_chain_mark_warm(zv_out_chain_t *c, off_t end);
+
+#endif
@@ -1,18 +1,101 @@
 /*
  * Zaver master/worker process management
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "process.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include "zv_signal.h"
 #include "worker.h"
+#include "reuseport.h"
+#include "stats.h"
 #include "dbg.h"
 
+/* crash-loop backoff: a worker that dies again within STABLE_MS of its
+ * start waits MIN_MS, doubling per crash up to MAX_MS, before it is
+ * respawned; one that ran longer is respawned at once */
+#define ZV_RESPAWN_MIN_MS       100
+#define ZV_RESPAWN_MAX_MS       30000
+#define ZV_RESPAWN_STABLE_MS    10000
+
+/* reload: how long the new generation may take to start accepting */
+#define ZV_RELOAD_READY_MS      5000
+/* stats slots per reactor: reloads in quick succession overlap up to this many generations */
+#define ZV_STATS_GENERATIONS 3
+
+/* binary upgrade: the new master gets this long (it also starts its workers);
+ * the master keeps reaping and respawning workers meanwhile */
+#define ZV_UPGRADE_READY_MS     10000
+
+/* binary upgrade hand-over: master-held listeners ("3,4,5") and the pipe
+ * the new master writes a byte to once its workers accept */
+#define ZV_ENV_LISTEN_FDS       "ZAVER_LISTEN_FDS"
+#define ZV_ENV_READY_FD         "ZAVER_READY_FD"
+
+typedef struct {
+    pid_t pid;              // 0 = 不在运行
+    size_t started_ms;
+    size_t respawn_at_ms;   // 等待重启的时刻，0 = 没有待重启
+    int crashes;            // 连续快速崩溃的次数
+} zv_worker_proc_t;
+
+// 重载后正在排空的旧一代 worker，退出时只回收不重启
+static pid_t *g_retiring;
+static int g_nretiring;
+static int g_retiring_cap;
+
+static void retiring_add(pid_t pid) {
+    if (g_nretiring == g_retiring_cap) {
+        int cap = g_retiring_cap ? g_retiring_cap * 2 : 16;
+        pid_t *p = (pid_t *)realloc(g_retiring, sizeof(pid_t) * (size_t)cap);
+        if (!p) {
+            // 记不下就不等它排空了
+            log_err("realloc(retiring) failed, stopping pid=%d", (int)pid);
+            kill(pid, SIGTERM);
+            return;
+        }
+        g_retiring = p;
+        g_retiring_cap = cap;
+    }
+    g_retiring[g_nretiring++] = pid;
+}
+
+static int retiring_remove(pid_t pid) {
+    for (int i = 0; i < g_nretiring; i++) {
+        if (g_retiring[i] == pid) {
+            g_retiring[i] = g_retiring[--g_nretiring];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static pid_t g_upgrade_pid;    // SIGUSR2 拉起的新 master
+static int g_upgrade_fd = -1;  // 新 master 就绪管道的读端，-1 = 没有在等
+static size_t g_upgrade_deadline_ms;
+
+// master 处理的信号（SIGCHLD、SIGHUP、SIGUSR1/2、SIGTERM/SIGINT）平时屏蔽，只在 ppoll 里放开：
+// 信号能打断等待，又不会落在检查标志和开始睡眠之间被晾到下一个子进程退出
+static sigset_t g_master_mask;
+static sigset_t g_wait_mask;
+
+static size_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_t)ts.tv_sec * 1000 + (size_t)ts.tv_nsec / 1000000;
+}
+
 static int cpu_count(void) {
 #ifdef _SC_NPROCESSORS_ONLN
     long n = sysconf(_SC_NPROCESSORS_ONLN);
@@ -20,8 +103,27 @@ static int cpu_count(void) {
 #endif
     return 1;
 }
-// 启动服务器 主进程创建多个worker子进程
-int zv_run_server(zv_conf_t *cf) {
+// accept_mode=shared：一个监听套接字，每个 reactor 拿一个 dup（各自关闭互不影响，EPOLLEXCLUSIVE 按 epoll 实例注册）
+static int open_shared_listener(int port, int nslots, int *fds) {
+    int fd = open_listenfd_reuseport(port);
+    if (fd < 0) {
+        return -1;
+    }
+    for (int s = 0; s < nslots; s++) {
+        fds[s] = dup(fd);
+        if (fds[s] < 0) {
+            while (--s >= 0) {
+                close(fds[s]);
+            }
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+// worker/reactor 数量规范化（启动和重载共用）
+static void normalize_conf(zv_conf_t *cf) {
     // 读取配置文件中的worker数量
     int workers = cf->workers;
     if (workers == 0) {
@@ -30,68 +132,663 @@ int zv_run_server(zv_conf_t *cf) {
     if (workers < 0) {
         workers = cpu_count();
     }
-    // 单进程模式
     if (workers <= 1) {
-        cf->workers = 1;
-        return zv_worker_run(cf, 0);
+        workers = 1;
     }
-
     cf->workers = workers;
+    if (cf->reactor_threads < 1) {
+        cf->reactor_threads = 1;
+    }
+}
+
+// fork 一个 worker：worker_id 和监听套接字的 slot 都不变，重启后绑回同一个 CPU、同一个 reuseport 组下标
+static pid_t spawn_worker(zv_conf_t *cf, int i, int *listen_fds, int nslots, int ready_fd) {
+    // 每个 reactor 一个统计 slot，worker 退出被回收时交还
+    int stats_first = zv_stats_claim(cf->reactor_threads);
+    pid_t pid = fork();
+    if (pid != 0) {
+        zv_stats_assign(stats_first, cf->reactor_threads, pid > 0 ? pid : 0);
+        return pid;
+    }
+    zv_stats_bind(stats_first, cf->reactor_threads);
+    (void)sigprocmask(SIG_UNBLOCK, &g_master_mask, NULL);
+    const int *own = NULL;
+    if (listen_fds) {
+        // 只保留自己的监听套接字（master 仍持有全部，组内下标保持不变）
+        for (int s = 0; s < nslots; s++) {
+            if (s / cf->reactor_threads != i) {
+                close(listen_fds[s]);
+            }
+        }
+        own = listen_fds + i * cf->reactor_threads;
+    }
+    int rc = zv_worker_run(cf, i, own, ready_fd);
+    _exit(rc);//子进程运行结束后退出 (这个退出不会刷新缓冲区 虽然在这里没什么影响)
+}
+
+// 记录 worker 退出，按崩溃频率安排重启时间
+static void schedule_respawn(zv_worker_proc_t *w, int i, int status) {
+    size_t now = now_ms();
+    if (WIFSIGNALED(status)) {
+        log_err("worker %d (pid=%d) killed by signal %d; respawning", i, (int)w->pid, WTERMSIG(status));
+    } else {
+        log_err("worker %d (pid=%d) exited status=%d; respawning", i, (int)w->pid, WEXITSTATUS(status));
+    }
+    if (now - w->started_ms >= ZV_RESPAWN_STABLE_MS) {
+        w->crashes = 0;
+    }
+    size_t delay = 0;
+    if (w->crashes > 0) {
+        int shift = w->crashes - 1 < 16 ? w->crashes - 1 : 16;
+        delay = (size_t)ZV_RESPAWN_MIN_MS << shift;
+        if (delay > ZV_RESPAWN_MAX_MS) {
+            delay = ZV_RESPAWN_MAX_MS;
+        }
+        log_warn("worker %d crash loop (%d quick exits), next start in %zums", i, w->crashes + 1, delay);
+    }
+    w->crashes++;
+    w->pid = 0;
+    w->respawn_at_ms = now + delay;
+}
+
+// reuseport steering：按 worker 的死活重挂 BPF 程序，等待重启的 worker 的 slot 不再分到连接
+// （它的监听套接字还在 master 手里，交给它的连接在退避期间没人 accept）
+static void update_steering(const zv_conf_t *cf, const zv_worker_proc_t *procs, int workers, int *listen_fds) {
+    if (!cf->reuseport_steering || cf->accept_mode == ZV_ACCEPT_SHARED || !listen_fds) {
+        return;
+    }
+    int nslots = workers * cf->reactor_threads;
+    unsigned char *alive = (unsigned char *)malloc((size_t)nslots);
+    if (!alive) {
+        return;
+    }
+    for (int s = 0; s < nslots; s++) {
+        alive[s] = (procs[s / cf->reactor_threads].pid > 0);
+    }
+    (void)zv_reuseport_steer(listen_fds[0], nslots, alive);
+    free(alive);
+}
+
+// 睡到收到信号或 timeout_ms 到期（-1 = 不限）；master 的信号只在这里和其他 ppoll 里放开
+static void master_sleep(int timeout_ms) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    (void)ppoll(NULL, 0, timeout_ms < 0 ? NULL : &ts, &g_wait_mask);
+}
+
+// 从就绪管道读字节，直到读满 want 个、超时、或所有写端都关闭（EOF）；返回读到的字节数
+static int wait_ready(int rfd, int want, int timeout_ms) {
+    int ready = 0;
+    size_t deadline = now_ms() + (size_t)timeout_ms;
+    while (ready < want && !zv_stop) {
+        size_t now = now_ms();
+        if (now >= deadline) {
+            break;
+        }
+        struct pollfd pf;
+        pf.fd = rfd;
+        pf.events = POLLIN;
+        struct timespec ts;
+        ts.tv_sec = (time_t)((deadline - now) / 1000);
+        ts.tv_nsec = (long)((deadline - now) % 1000) * 1000000L;
+        int rc = ppoll(&pf, 1, &ts, &g_wait_mask);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        char tmp[64];
+        ssize_t got = read(rfd, tmp, sizeof(tmp));
+        if (got <= 0) {
+            break;
+        }
+        ready += (int)got;
+    }
+    return ready;
+}
+
+static void kill_children(zv_worker_proc_t *procs, int workers, int sig) {
+    for (int i = 0; i < workers; i++) {
+        if (procs[i].pid > 0) {
+            kill(procs[i].pid, sig);
+        }
+    }
+    for (int i = 0; i < g_nretiring; i++) {
+        kill(g_retiring[i], sig);
+    }
+}
+
+/*
+ * 停止所有 worker 并等它们退出。SIGTERM 原样转发，worker 平滑停止（排空连接，
+ * 最多 drain_timeout_ms）；SIGINT 也原样转发，worker 立即退出。
+ * 等待期间再收到 SIGTERM/SIGINT 就给还没退出的 worker 补发 SIGINT。
+ */
+static void stop_children(zv_worker_proc_t *procs, int workers) {
+    int sig = (zv_stop == SIGINT) ? SIGINT : SIGTERM;
+    zv_stop = 1;
+    kill_children(procs, workers, sig);
+    for (;;) {
+        int alive = g_nretiring;
+        for (int i = 0; i < workers; i++) {
+            if (procs[i].pid > 0) alive++;
+        }
+        if (alive == 0) {
+            break;
+        }
+        if (zv_stop != 1) {
+            log_info("stop requested again, stopping %d workers now", alive);
+            zv_stop = 1;
+            kill_children(procs, workers, SIGINT);
+        }
+        pid_t pid = waitpid(-1, NULL, WNOHANG);
+        if (pid == 0) {
+            master_sleep(-1);
+            continue;
+        }
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_err("waitpid failed");
+            break;
+        }
+        zv_stats_release(pid);
+        if (retiring_remove(pid)) {
+            continue;
+        }
+        for (int i = 0; i < workers; i++) {
+            if (procs[i].pid == pid) {
+                procs[i].pid = 0;
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * SIGHUP：重读配置，用新配置拉起新一代 worker，等它们全部开始接受连接后再让旧一代排空退出，
+ * 监听端口始终有人在 accept。失败时新一代被停掉，旧一代和旧配置继续服务。
+ */
+static int reload(const char *conf_file, zv_conf_t *cf, char **conf_buf,
+                  zv_worker_proc_t **procs, int *workers, int *listen_fds) {
+    char *buf = (char *)malloc(BUFLEN);
+    if (!buf) {
+        log_err("reload: malloc failed");
+        return -1;
+    }
+    zv_conf_t ncf;
+    if (read_conf((char *)conf_file, &ncf, buf, BUFLEN) != ZV_CONF_OK) {
+        log_err("reload: read conf failed: %s; keeping the running config", conf_file);
+        free(buf);
+        return -1;
+    }
+    normalize_conf(&ncf);
+    // 监听套接字的布局（master 持有的套接字、steering 分组下标）在启动时就定下了
+    if (ncf.accept_mode != cf->accept_mode || ncf.reuseport_steering != cf->reuseport_steering ||
+        (listen_fds && (ncf.port != cf->port || ncf.workers != cf->workers || ncf.reactor_threads != cf->reactor_threads))) {
+        log_warn("reload: changing the listener layout (accept_mode, reuseport_steering, and with master-held listeners port/workers/reactor_threads) needs a restart; keeping the current values");
+        ncf.accept_mode = cf->accept_mode;
+        ncf.reuseport_steering = cf->reuseport_steering;
+        if (listen_fds) {
+            ncf.port = cf->port;
+            ncf.workers = cf->workers;
+            ncf.reactor_threads = cf->reactor_threads;
+        }
+    }
+
+    int nw = ncf.workers;
+    int nslots = nw * ncf.reactor_threads;
+    zv_worker_proc_t *np = (zv_worker_proc_t *)calloc((size_t)nw, sizeof(zv_worker_proc_t));
+    int pfd[2];
+    if (!np || pipe2(pfd, O_CLOEXEC) != 0) {
+        log_err("reload: allocating the new generation failed");
+        free(np);
+        free(buf);
+        return -1;
+    }
+    int spawned = 0;
+    for (int i = 0; i < nw; i++) {
+        pid_t pid = spawn_worker(&ncf, i, listen_fds, nslots, pfd[1]);
+        if (pid < 0) {
+            log_err("reload: fork failed");
+            break;
+        }
+        np[i].pid = pid;
+        np[i].started_ms = now_ms();
+        spawned++;
+    }
+    close(pfd[1]);
+    int ready = (spawned == nw) ? wait_ready(pfd[0], nw, ZV_RELOAD_READY_MS) : 0;
+    close(pfd[0]);
+
+    if (ready < nw) {
+        log_err("reload: only %d of %d new workers became ready; keeping the running generation", ready, nw);
+        for (int i = 0; i < nw; i++) {
+            if (np[i].pid > 0) {
+                kill(np[i].pid, SIGTERM);
+                retiring_add(np[i].pid);
+            }
+        }
+        free(np);
+        free(buf);
+        return -1;
+    }
+
+    // 新一代已经在接受连接：旧一代停止接受，处理完手上的连接再退出
+    for (int i = 0; i < *workers; i++) {
+        if ((*procs)[i].pid > 0) {
+            kill((*procs)[i].pid, SIGQUIT);
+            retiring_add((*procs)[i].pid);
+        }
+    }
+    free(*procs);
+    *procs = np;
+    *workers = nw;
+    *cf = ncf;
+    zv_log_configure(cf->log_level, cf->log_rate_limit);
+    free(*conf_buf);    // 上一次重载分配的；启动时的配置缓冲区不归这里管
+    *conf_buf = buf;
+    log_status("config reloaded. workers=%d reactor_threads=%d retiring=%d", nw, ncf.reactor_threads, g_nretiring);
+    return 0;
+}
+
+/*
+ * 上一代 master 在二进制升级时交下来的监听套接字。个数和当前配置的 slot 数一致才用，
+ * 否则关掉重新打开。读完清掉环境变量，下一次升级时重新设置。
+ * return: 1 用上了，0 没有可继承的
+ */
+static int inherit_listeners(int *fds, int nslots, int want) {
+    const char *s = getenv(ZV_ENV_LISTEN_FDS);
+    if (!s) {
+        return 0;
+    }
+    int n = 0;
+    int ok = want;
+    while (*s) {
+        char *end;
+        long fd = strtol(s, &end, 10);
+        if (end == s || fd < 0) {
+            ok = 0;
+            break;
+        }
+        if (want && n < nslots) {
+            fds[n] = (int)fd;
+        } else {
+            close((int)fd);
+        }
+        n++;
+        s = (*end == ',') ? end + 1 : end;
+    }
+    if (ok && n != nslots) {
+        ok = 0;
+    }
+    if (want && !ok) {
+        log_warn("inherited listeners do not match the config (%d, want %d); opening new ones", n, nslots);
+        for (int i = 0; i < n && i < nslots; i++) {
+            close(fds[i]);
+        }
+    }
+    unsetenv(ZV_ENV_LISTEN_FDS);
+    return ok;
+}
+
+// 二进制升级时上一代 master 等待的就绪管道写端，-1 表示不是升级启动的
+static int take_ready_fd(void) {
+    const char *s = getenv(ZV_ENV_READY_FD);
+    if (!s) {
+        return -1;
+    }
+    int fd = atoi(s);
+    unsetenv(ZV_ENV_READY_FD);
+    if (fd <= 2 || fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * SIGUSR2：fork + exec 磁盘上的新二进制（argv 原样传递），master 持有的监听套接字
+ * 通过 fd 继承交给它。新 master 的 worker 全部开始接受连接后会写就绪管道，
+ * 主循环用 upgrade_wait 等这个字节，等到了再让旧 worker 排空。
+ * return: 0 新 master 已启动，-1 失败
+ */
+static int upgrade(char *const argv[], int *listen_fds, int nslots) {
+    if (g_upgrade_pid > 0) {
+        log_warn("binary upgrade already in progress (pid=%d)", (int)g_upgrade_pid);
+        return -1;
+    }
+    // fork 之后子进程只做 exec，环境变量的内容先在这里拼好
+    size_t cap = (size_t)nslots * 12 + 1;
+    char *fds_env = (char *)malloc(cap);
+    int pfd[2];
+    if (!fds_env || pipe2(pfd, O_CLOEXEC) != 0) {
+        log_err("binary upgrade: setup failed");
+        free(fds_env);
+        return -1;
+    }
+    size_t off = 0;
+    fds_env[0] = '\0';
+    for (int s = 0; listen_fds && s < nslots; s++) {
+        off += (size_t)snprintf(fds_env + off, cap - off, s ? ",%d" : "%d", listen_fds[s]);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        log_err("binary upgrade: fork failed");
+        close(pfd[0]);
+        close(pfd[1]);
+        free(fds_env);
+        return -1;
+    }
+    if (pid == 0) {
+        char num[16];
+        close(pfd[0]);
+        (void)sigprocmask(SIG_UNBLOCK, &g_master_mask, NULL);
+        // exec 之后还要用的 fd 去掉 FD_CLOEXEC
+        (void)fcntl(pfd[1], F_SETFD, 0);
+        snprintf(num, sizeof(num), "%d", pfd[1]);
+        setenv(ZV_ENV_READY_FD, num, 1);
+        if (listen_fds) {
+            for (int s = 0; s < nslots; s++) {
+                (void)fcntl(listen_fds[s], F_SETFD, 0);
+            }
+            setenv(ZV_ENV_LISTEN_FDS, fds_env, 1);
+        }
+        execvp(argv[0], argv);
+        log_err("binary upgrade: execvp(%s) failed", argv[0]);
+        _exit(127);
+    }
+    free(fds_env);
+    close(pfd[1]);
+    g_upgrade_pid = pid;
+    g_upgrade_fd = pfd[0];
+    g_upgrade_deadline_ms = now_ms() + ZV_UPGRADE_READY_MS;
+    log_status("binary upgrade: started %s, new master pid=%d", argv[0], (int)pid);
+    return 0;
+}
+
+// 放弃等待中的升级：新 master 停掉，旧的继续服务
+static void upgrade_abort(const char *why) {
+    log_err("binary upgrade: new master pid=%d %s; keeping the running binary", (int)g_upgrade_pid, why);
+    if (g_upgrade_pid > 0) {
+        kill(g_upgrade_pid, SIGTERM);
+    }
+    close(g_upgrade_fd);
+    g_upgrade_fd = -1;
+}
+
+/*
+ * 等新 master 的就绪字节，最多 wait_ms（< 0 不限）且不超过截止时间；
+ * 子进程退出或其他信号会提前返回，由主循环回收、检查标志后再来。
+ * return: 1 就绪，0 还在等，-1 超时或新 master 没就绪就关了管道
+ */
+static int upgrade_wait(int wait_ms) {
+    size_t now = now_ms();
+    if (now >= g_upgrade_deadline_ms) {
+        upgrade_abort("did not become ready in time");
+        return -1;
+    }
+    int left = (int)(g_upgrade_deadline_ms - now);
+    if (wait_ms >= 0 && wait_ms < left) {
+        left = wait_ms;
+    }
+    struct pollfd pf;
+    pf.fd = g_upgrade_fd;
+    pf.events = POLLIN;
+    struct timespec ts;
+    ts.tv_sec = left / 1000;
+    ts.tv_nsec = (long)(left % 1000) * 1000000L;
+    if (ppoll(&pf, 1, &ts, &g_wait_mask) <= 0) {
+        return 0;
+    }
+    char c;
+    if (read(g_upgrade_fd, &c, 1) != 1) {
+        upgrade_abort("exited before becoming ready");
+        return -1;
+    }
+    close(g_upgrade_fd);
+    g_upgrade_fd = -1;
+    return 1;
+}
+
+// 启动服务器 主进程创建多个worker子进程
+int zv_run_server(zv_conf_t *cf, const char *conf_file, char *const argv[]) {
+    normalize_conf(cf);
+    int workers = cf->workers;
+    int ready_up = take_ready_fd();
+
+    // CPU 就近分发：所有 reactor 的监听套接字都在 master 里按 slot 顺序创建，worker 继承自己那几个
+    int *listen_fds = NULL;
+    int nslots = workers * cf->reactor_threads;
+    int held = (cf->accept_mode == ZV_ACCEPT_SHARED || cf->reuseport_steering);
+    if (held) {
+        listen_fds = (int *)malloc(sizeof(int) * (size_t)nslots);
+        if (!listen_fds) {
+            log_err("malloc(listen_fds) failed");
+            return 1;
+        }
+    }
+    // 二进制升级：沿用上一代的监听套接字（steering 的 BPF 程序也还挂在组上），端口始终处于监听状态
+    if (inherit_listeners(listen_fds, nslots, held)) {
+        log_info("using %d inherited listeners", nslots);
+    } else if (cf->accept_mode == ZV_ACCEPT_SHARED) {
+        if (cf->reuseport_steering) {
+            log_warn("reuseport_steering is ignored with accept_mode=shared");
+        }
+        if (open_shared_listener(cf->port, nslots, listen_fds) != 0) {
+            log_err("open shared listener failed (port=%d)", cf->port);
+            free(listen_fds);
+            return 1;
+        }
+    } else if (cf->reuseport_steering) {
+        if (!cf->cpu_affinity) {
+            log_warn("reuseport_steering without cpu_affinity: reactors are not pinned, steering only groups connections by receiving CPU");
+        }
+        if (zv_reuseport_open_steered(cf->port, nslots, listen_fds) != 0) {
+            log_err("reuseport steering: opening %d listeners failed", nslots);
+            free(listen_fds);
+            return 1;
+        }
+    }
+
+    // 单进程模式
+    if (workers == 1) {
+        if (zv_stats_init(cf->reactor_threads) == 0) {
+            zv_stats_bind(zv_stats_claim(cf->reactor_threads), cf->reactor_threads);
+        }
+        int rc = zv_worker_run(cf, 0, listen_fds, ready_up);
+        free(listen_fds);
+        return rc;
+    }
+
     // 多进程模式
     // 安装master进程信号处理函数
     if (zv_install_master_signals() != 0) {
         log_err("install master signals failed");
         return 1;
     }
-    // 分配保存子进程PID的数组
-    pid_t *pids = (pid_t *)calloc((size_t)workers, sizeof(pid_t));
-    if (!pids) {
-        log_err("calloc(pids) failed");
+    sigemptyset(&g_master_mask);
+    sigaddset(&g_master_mask, SIGCHLD);
+    sigaddset(&g_master_mask, SIGHUP);
+    sigaddset(&g_master_mask, SIGUSR1);
+    sigaddset(&g_master_mask, SIGUSR2);
+    sigaddset(&g_master_mask, SIGTERM);
+    sigaddset(&g_master_mask, SIGINT);
+    (void)sigprocmask(SIG_BLOCK, &g_master_mask, &g_wait_mask);
+    for (int s = 1; s < NSIG; s++) {
+        if (sigismember(&g_master_mask, s) == 1) {
+            sigdelset(&g_wait_mask, s);
+        }
+    }
+    // 每个 worker 的进程状态
+    zv_worker_proc_t *procs = (zv_worker_proc_t *)calloc((size_t)workers, sizeof(zv_worker_proc_t));
+    if (!procs) {
+        log_err("calloc(procs) failed");
         return 1;
     }
     log_status("zaver master starting. workers=%d pid=%d", workers, getpid());
+    // 统计区域在 fork 之前映射好，所有 worker 共享；重载后新旧两代、重启中的 worker 都要有位置
+    (void)zv_stats_init(ZV_STATS_GENERATIONS * workers * cf->reactor_threads);
+    // 升级启动时用就绪管道确认所有 worker 都在接受连接，再通知上一代 master
+    int pfd[2] = {-1, -1};
+    if (ready_up >= 0 && pipe2(pfd, O_CLOEXEC) != 0) {
+        pfd[0] = pfd[1] = -1;
+    }
     // 创建worker子进程
     for (int i = 0; i < workers; i++) {
-        pid_t pid = fork();
+        pid_t pid = spawn_worker(cf, i, listen_fds, nslots, pfd[1]);
         if (pid < 0) {
             log_err("fork failed");
             zv_stop = 1;
             break; 
         }
-        if (pid == 0) {
-            int rc = zv_worker_run(cf, i);
-            _exit(rc);//子进程运行结束后退出 (这个退出不会刷新缓冲区 虽然在这里没什么影响)
+        procs[i].pid = pid;//保存子进程PID
+        procs[i].started_ms = now_ms();
+    }
+    if (pfd[0] >= 0) {
+        close(pfd[1]);
+        if (wait_ready(pfd[0], workers, ZV_RELOAD_READY_MS) == workers) {
+            char c = 1;
+            (void)write(ready_up, &c, 1);
         }
-        pids[i] = pid;//保存子进程PID
+        close(pfd[0]);
     }
-    // master进程等待子进程退出
+    if (ready_up >= 0) {
+        close(ready_up);
+    }
+    // master进程监督子进程：某个 worker 退出只重启它自己，其他 worker 照常服务
+    char *conf_buf = NULL;  // 重载时分配的配置缓冲区（cf->root 指向其中）
+    int upgraded = 0;       // 新二进制已接手：旧 worker 排空完 master 就退出
+    int steer_dirty = 1;    // worker 死活变了，steering 程序要重挂（升级时沿用的是上一代的程序）
     while (!zv_stop) {
+        if (upgraded && g_nretiring == 0) {
+            log_status("binary upgrade done, old master exiting. new master pid=%d", (int)g_upgrade_pid);
+            break;
+        }
+        if (zv_upgrade) {
+            zv_upgrade = 0;
+            if (!upgraded) {
+                (void)upgrade(argv, listen_fds, nslots);
+            }
+            continue;
+        }
+        if (zv_report) {
+            zv_report = 0;
+            zv_stats_report();
+            continue;
+        }
+        if (zv_reload && (upgraded || g_upgrade_fd >= 0)) {
+            log_warn("reload ignored during a binary upgrade");
+            zv_reload = 0;
+        }
+        if (zv_reload) {
+            zv_reload = 0;
+            (void)reload(conf_file, cf, &conf_buf, &procs, &workers, listen_fds);
+            steer_dirty = 1;
+            continue;
+        }
+        // 先拉起到期的 worker，顺便算出下一个重启时刻还要等多久
+        int wait_ms = -1;
+        size_t now = now_ms();
+        for (int i = 0; i < workers; i++) {
+            zv_worker_proc_t *w = &procs[i];
+            if (w->pid != 0 || w->respawn_at_ms == 0) {
+                continue;
+            }
+            if (now >= w->respawn_at_ms) {
+                pid_t pid = spawn_worker(cf, i, listen_fds, nslots, -1);
+                if (pid < 0) {
+                    log_err("fork failed (worker %d), retrying", i);
+                    w->respawn_at_ms = now + ZV_RESPAWN_MIN_MS;
+                } else {
+                    log_info("worker %d respawned. pid=%d", i, (int)pid);
+                    w->pid = pid;
+                    w->started_ms = now;
+                    w->respawn_at_ms = 0;
+                    steer_dirty = 1;
+                    continue;
+                }
+            }
+            int left = (int)(w->respawn_at_ms - now);
+            if (wait_ms < 0 || left < wait_ms) {
+                wait_ms = left;
+            }
+        }
+
+        // 升级开始后监听套接字（和组上的程序）归新 master 管
+        if (steer_dirty && !upgraded && g_upgrade_fd < 0) {
+            update_steering(cf, procs, workers, listen_fds);
+        }
+        steer_dirty = 0;
+
+        // 先不阻塞地回收；没有可回收的就在 ppoll 里睡：信号、子进程退出、下一个重启时刻
+        // 或新 master 就绪都会叫醒，醒来后回到循环开头检查标志
         int status = 0;
-        pid_t pid = waitpid(-1, &status, 0);//阻塞等待任一子进程退出 所以master进程不会占用过多CPU
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid == 0 || (pid < 0 && errno == ECHILD && (wait_ms >= 0 || g_upgrade_fd >= 0))) {
+            if (g_upgrade_fd >= 0) {
+                if (upgrade_wait(wait_ms) == 1) {
+                    // 新 master 的 worker 都在接受连接了：旧 worker 停止接受，处理完手上的连接再退出
+                    upgraded = 1;
+                    for (int i = 0; i < workers; i++) {
+                        if (procs[i].pid > 0) {
+                            kill(procs[i].pid, SIGQUIT);
+                            retiring_add(procs[i].pid);
+                        }
+                        procs[i].pid = 0;
+                        procs[i].respawn_at_ms = 0;
+                    }
+                }
+            } else {
+                master_sleep(wait_ms);
+            }
+            continue;
+        }
         if (pid < 0) {
             if (errno == EINTR) continue;//被信号中断则继续等待
             log_err("waitpid failed");
             break;
         }
-        // 某个子进程退出，记录日志并准备关闭服务器
-        log_err("worker exited pid=%d status=%d; shutting down", (int)pid, status);
-        zv_stop = 1;
-        break;
-    }
-    // 终止所有子进程
-    for (int i = 0; i < workers; i++) {
-        if (pids[i] > 0) {
-            kill(pids[i], SIGTERM);//发送终止信号
+        zv_stats_release(pid);
+        if (pid == g_upgrade_pid) {
+            log_err("new master pid=%d exited status=%d", (int)pid, status);
+            g_upgrade_pid = 0;
+            continue;
         }
-    }
-    // 等待所有子进程退出
-    for (int i = 0; i < workers; i++) {
-        if (pids[i] > 0) {
-            (void)waitpid(pids[i], NULL, 0);//阻塞等待指定子进程退出
+        if (retiring_remove(pid)) {
+            log_info("retired worker exited. pid=%d status=%d", (int)pid, status);
+            continue;
+        }
+        for (int i = 0; i < workers; i++) {
+            if (procs[i].pid == pid) {
+                if (!zv_stop) {
+                    schedule_respawn(&procs[i], i, status);
+                    steer_dirty = 1;
+                } else {
+                    procs[i].pid = 0;
+                }
+                break;
+            }
         }
     }
+    if (g_upgrade_fd >= 0) {
+        upgrade_abort("was still starting when the master stopped");
+    }
+    stop_children(procs, workers);
+    free(g_retiring);
+    g_retiring = NULL;
+    g_nretiring = 0;
+    g_retiring_cap = 0;
+    free(conf_buf);
     // 释放资源并退出
-    free(pids);
+    if (listen_fds) {
+        for (int s = 0; s < nslots; s++) {
+            close(listen_fds[s]);
+        }
+        free(listen_fds);
+    }
+    free(procs);
     log_info("zaver master stopped");
     return 0;
 }
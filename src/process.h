@@ -7,6 +7,10 @@
 
 #include "util.h"
 
-int zv_run_server(zv_conf_t *cf);
+/*
+ * conf_file is re-read on SIGHUP; on SIGUSR2 argv is exec'ed as the new
+ * binary (both multi-worker mode only)
+ */
+int zv_run_server(zv_conf_t *cf, const char *conf_file, char *const argv[]);
 
 #endif
@@ -0,0 +1,166 @@
+/*
+ * CPU-local SO_REUSEPORT steering (see reuseport.h).
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "reuseport.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include "util.h"
+#include "topology.h"
+#include "dbg.h"
+
+#define ZV_STEER_MAX_INSNS 4096     /* BPF_MAXINSNS */
+
+// 在 slots[0..k) 里随机返回一个
+static int emit_pick(const int *slots, int k, struct sock_filter *p, int n, int cap) {
+    int j;
+    if (n + 2 * k + 1 > cap) return -1;
+    if (k == 1) {
+        p[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (unsigned)slots[0]);
+        return n;
+    }
+    p[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RANDOM);
+    p[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (unsigned)k);
+    for (j = 0; j < k - 1; j++) {
+        p[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)j, 0, 1);
+        p[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (unsigned)slots[j]);
+    }
+    p[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (unsigned)slots[k - 1]);
+    return n;
+}
+
+/*
+ * A = 收到 SYN 的 CPU；逐个比较，命中就返回绑在这个 CPU 上的活 slot。
+ * 一个 CPU 上绑了多个 slot（slot 数多于 CPU 数）时在它们之间随机选。
+ * 没有对应活 slot 的 CPU（worker 挂了、等着重启）在所有活 slot 里随机选：
+ * 死 slot 的监听套接字还在 master 手里，交给它的连接没人 accept。
+ * 条件跳转的偏移只有 8 位，跨块一律用 32 位的 BPF_JA。
+ */
+static int build_prog(const int *cpus, int ncpu, int nslots, const unsigned char *alive,
+                      struct sock_filter *p, int cap) {
+    int n = 0;
+    int r, s, k, nlive = 0, nany = 0;
+    int *live = (int *)malloc(sizeof(int) * (size_t)nslots);
+    int *cand = (int *)malloc(sizeof(int) * (size_t)nslots);
+    int *any = (int *)malloc(sizeof(int) * (size_t)(ncpu + 1));
+    if (!live || !cand || !any) {
+        n = -1;
+        goto out;
+    }
+    for (s = 0; s < nslots; s++) {
+        if (!alive || alive[s]) {
+            live[nlive++] = s;
+        }
+    }
+    if (nlive == 0) {
+        // 一个活的都没有：交给内核哈希，反正谁都接不了
+        p[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffffu);
+        goto out;
+    }
+    p[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (r = 0; r < ncpu && r < nslots; r++) {
+        // 绑在这个 CPU 上的 slot：r, r + ncpu, r + 2 * ncpu ...
+        k = 0;
+        for (s = r; s < nslots; s += ncpu) {
+            if (!alive || alive[s]) {
+                cand[k++] = s;
+            }
+        }
+        if (n + 3 > cap) {
+            n = -1;
+            goto out;
+        }
+        p[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)cpus[r], 1, 0);
+        int skip = n;
+        p[n++] = (struct sock_filter)BPF_STMT(BPF_JMP | BPF_JA, 0);
+        if (k == 0) {
+            any[nany++] = n;
+            p[n++] = (struct sock_filter)BPF_STMT(BPF_JMP | BPF_JA, 0);
+        } else if ((n = emit_pick(cand, k, p, n, cap)) < 0) {
+            goto out;
+        }
+        p[skip].k = (unsigned)(n - skip - 1);
+    }
+    // 没有对应 slot 的 CPU 直接落到这里
+    for (r = 0; r < nany; r++) {
+        p[any[r]].k = (unsigned)(n - any[r] - 1);
+    }
+    n = emit_pick(live, nlive, p, n, cap);
+out:
+    free(live);
+    free(cand);
+    free(any);
+    return n;
+}
+
+static int attach_prog(int fd, int nslots, const unsigned char *alive) {
+    int rc = -1;
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    int *cpus = (int *)malloc(sizeof(int) * CPU_SETSIZE);
+    struct sock_filter *insns = (struct sock_filter *)malloc(sizeof(struct sock_filter) * ZV_STEER_MAX_INSNS);
+    if (!cpus || !insns) {
+        log_warn("reuseport steering: out of memory, using the kernel's hash");
+        goto out;
+    }
+    // 和 maybe_set_cpu_affinity 用同一个顺序：slot s 绑在 cpus[s % ncpu] 上
+    int ncpu = zv_topology_order(cpus, CPU_SETSIZE);
+    if (ncpu <= 0) {
+        log_warn("reuseport steering: sched_getaffinity failed, using the kernel's hash");
+        goto out;
+    }
+    int len = build_prog(cpus, ncpu, nslots, alive, insns, ZV_STEER_MAX_INSNS);
+    if (len < 0) {
+        log_warn("reuseport steering: too many CPUs/slots for one program, using the kernel's hash");
+        goto out;
+    }
+    struct sock_fprog prog;
+    prog.len = (unsigned short)len;
+    prog.filter = insns;
+    // 程序挂在整个 reuseport 组上，挂到任意一个成员即可
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0) {
+        log_warn("SO_ATTACH_REUSEPORT_CBPF failed, errno=%d; using the kernel's hash", errno);
+        goto out;
+    }
+    log_info("reuseport steering attached. slots=%d cpus=%d insns=%d", nslots, ncpu, len);
+    rc = 0;
+out:
+    free(cpus);
+    free(insns);
+#else
+    (void)fd;
+    (void)nslots;
+    (void)alive;
+    log_warn("SO_ATTACH_REUSEPORT_CBPF not supported by these headers, using the kernel's hash");
+#endif
+    return rc;
+}
+
+int zv_reuseport_open_steered(int port, int nslots, int *fds) {
+    int i;
+    // 组内下标就是 listen() 的先后顺序，所以必须在同一个进程里按 slot 顺序依次创建
+    for (i = 0; i < nslots; i++) {
+        fds[i] = open_listenfd_reuseport(port);
+        if (fds[i] < 0) {
+            log_err("open_listenfd_reuseport failed (port=%d slot=%d)", port, i);
+            while (--i >= 0) {
+                close(fds[i]);
+                fds[i] = -1;
+            }
+            return -1;
+        }
+    }
+    (void)attach_prog(fds[0], nslots, NULL);
+    return 0;
+}
+
+int zv_reuseport_steer(int fd, int nslots, const unsigned char *alive) {
+    return attach_prog(fd, nslots, alive);
+}
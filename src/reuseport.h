@@ -0,0 +1,24 @@
+/*
+ * CPU-local SO_REUSEPORT steering: the master opens every reactor's
+ * listener in slot order and attaches a classic BPF program that hands a
+ * new connection to the listener whose reactor is pinned to the CPU that
+ * received it. While a worker is down the program is rebuilt without its
+ * slots, so its CPUs' connections go to the live listeners meanwhile.
+ */
+
+#ifndef ZV_REUSEPORT_H
+#define ZV_REUSEPORT_H
+
+/*
+ * Open nslots listeners on port (slot = worker_id * reactor_threads +
+ * reactor_id, pinned to zv_topology_order()[slot % ncpu]) and attach
+ * the steering program. return: 0 ok, -1 error (nothing left open)
+ */
+int zv_reuseport_open_steered(int port, int nslots, int *fds);
+/*
+ * Re-attach the program to the group of fd, steering only to slots with
+ * alive[slot] set (NULL: all). return: 0 ok, -1 error (old program stays)
+ */
+int zv_reuseport_steer(int fd, int nslots, const unsigned char *alive);
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Shared-memory live counters (see stats.h).
+ */
+
+#include "stats.h"
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "dbg.h"
+
+typedef struct {
+    int nslots;
+    unsigned seq;               /* odd while the master folds a slot into retired */
+    zv_stats_slot_t retired;    /* counters of workers that already exited */
+    zv_stats_slot_t slots[];
+} zv_stats_region_t;
+
+static zv_stats_region_t *g_region;
+// fork 之后这个 worker 的第一个 slot 和 slot 个数
+static int g_base = -1;
+static int g_nbound;
+
+// 没有共享 slot 的 reactor（区域已满、初始化失败）写自己的私有 slot，热路径上不用判空；
+// 还没 attach 的线程落在 g_unbound 上（正常情况下它们不计数）
+static __thread zv_stats_slot_t g_private;
+static zv_stats_slot_t g_unbound;
+__thread zv_stats_slot_t *zv_stats = &g_unbound;
+
+int zv_stats_init(int nslots) {
+    if (g_region || nslots <= 0) {
+        return g_region ? 0 : -1;
+    }
+    size_t size = sizeof(zv_stats_region_t) + sizeof(zv_stats_slot_t) * (size_t)nslots;
+    // MAP_ANONYMOUS 的页是清零的；MAP_SHARED 让 fork 出来的 worker 写的是同一份
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        log_err("mmap(stats, %zu bytes) failed", size);
+        return -1;
+    }
+    g_region = (zv_stats_region_t *)p;
+    g_region->nslots = nslots;
+    return 0;
+}
+
+int zv_stats_claim(int n) {
+    if (!g_region || n <= 0) {
+        return -1;
+    }
+    int i, run = 0;
+    for (i = 0; i < g_region->nslots; i++) {
+        run = (g_region->slots[i].owner == 0) ? run + 1 : 0;
+        if (run == n) {
+            int first = i - n + 1;
+            zv_stats_assign(first, n, -1);
+            // 标签等 reactor attach 时再写，之前报表跳过这些 slot
+            for (i = first; i < first + n; i++) {
+                g_region->slots[i].worker = -1;
+                g_region->slots[i].reactor = -1;
+            }
+            return first;
+        }
+    }
+    log_warn("stats: no %d free slots, the new worker's counters stay private", n);
+    return -1;
+}
+
+void zv_stats_assign(int first, int n, pid_t pid) {
+    int i;
+    if (!g_region || first < 0) {
+        return;
+    }
+    for (i = first; i < first + n && i < g_region->nslots; i++) {
+        g_region->slots[i].owner = pid;
+    }
+}
+
+void zv_stats_release(pid_t pid) {
+    int i;
+    size_t k;
+    if (!g_region || pid <= 0) {
+        return;
+    }
+    uint64_t *acc = (uint64_t *)&g_region->retired.c;
+    for (i = 0; i < g_region->nslots; i++) {
+        zv_stats_slot_t *s = &g_region->slots[i];
+        if (s->owner != pid) {
+            continue;
+        }
+        // 挪到 retired 的过程对读者是一步完成的：seq 为奇数期间 zv_stats_total 重读，
+        // 否则它可能两边都算上（或两边都没算上），总数一会儿多一会儿少
+        unsigned seq = g_region->seq;
+        __atomic_store_n(&g_region->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        // 进程已经没了：它的连接也都没了，差值型的计数（连接数、空闲数）先配平
+        s->c.conns_closed = s->c.conns_accepted;
+        s->c.idle_leave = s->c.idle_enter;
+        uint64_t *f = (uint64_t *)&s->c;
+        for (k = 0; k < ZV_STATS_NFIELDS; k++) {
+            zv_stats_add(&acc[k], f[k]);
+            __atomic_store_n(&f[k], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&g_region->seq, seq + 2, __ATOMIC_RELEASE);
+        s->owner = 0;
+    }
+}
+
+void zv_stats_bind(int first, int n) {
+    g_base = first;
+    g_nbound = n;
+}
+
+void zv_stats_attach(int worker_id, int reactor_id) {
+    if (g_region && g_base >= 0 && reactor_id < g_nbound && g_base + reactor_id < g_region->nslots) {
+        zv_stats = &g_region->slots[g_base + reactor_id];
+    } else {
+        zv_stats = &g_private;
+    }
+    zv_stats->worker = worker_id;
+    zv_stats->reactor = reactor_id;
+}
+
+int zv_stats_nslots(void) {
+    return g_region ? g_region->nslots : 0;
+}
+
+const zv_stats_slot_t *zv_stats_slot(int i) {
+    if (!g_region || i < 0 || i >= g_region->nslots || g_region->slots[i].owner == 0) {
+        return NULL;
+    }
+    return &g_region->slots[i];
+}
+
+void zv_stats_total(zv_stats_counters_t *out) {
+    int i;
+    size_t k;
+    memset(out, 0, sizeof(*out));
+    uint64_t *sum = (uint64_t *)out;
+    if (!g_region) {
+        // 没有共享区域（单进程且初始化失败）：只有自己这个 reactor 的
+        const uint64_t *f = (const uint64_t *)&zv_stats->c;
+        for (k = 0; k < ZV_STATS_NFIELDS; k++) {
+            sum[k] = __atomic_load_n(&f[k], __ATOMIC_RELAXED);
+        }
+        return;
+    }
+    unsigned seq;
+    do {
+        // master 正在挪某个 slot：等它挪完再读
+        while ((seq = __atomic_load_n(&g_region->seq, __ATOMIC_ACQUIRE)) & 1) {
+            sched_yield();
+        }
+        memset(out, 0, sizeof(*out));
+        for (i = -1; i < g_region->nslots; i++) {
+            const uint64_t *f = (const uint64_t *)(i < 0 ? &g_region->retired.c : &g_region->slots[i].c);
+            for (k = 0; k < ZV_STATS_NFIELDS; k++) {
+                sum[k] += __atomic_load_n(&f[k], __ATOMIC_RELAXED);
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&g_region->seq, __ATOMIC_RELAXED) != seq);
+}
+
+// 差值型计数：两个字段不是同一时刻读的，可能短暂地减出负数
+static unsigned long long gauge(uint64_t up, uint64_t down) {
+    return up > down ? (unsigned long long)(up - down) : 0;
+}
+
+// 命中率（百分比），没有访问时为 0
+static double pct(uint64_t hit, uint64_t total) {
+    return total ? 100.0 * (double)hit / (double)total : 0.0;
+}
+
+void zv_stats_report(void) {
+    zv_stats_counters_t t;
+    zv_stats_total(&t);
+    log_status("stats: requests=%llu bytes_out=%llu 1xx=%llu 2xx=%llu 3xx=%llu 4xx=%llu 5xx=%llu other=%llu",
+               (unsigned long long)t.requests, (unsigned long long)t.bytes_out,
+               (unsigned long long)t.status[1], (unsigned long long)t.status[2],
+               (unsigned long long)t.status[3], (unsigned long long)t.status[4],
+               (unsigned long long)t.status[5], (unsigned long long)t.status[0]);
+    log_status("stats: conns accepted=%llu active=%llu idle=%llu request_cache hit=%.1f%% file_cache hit=%.1f%% zerocopy sends=%llu copied=%llu access_log lines=%llu dropped=%llu",
+               (unsigned long long)t.conns_accepted,
+               gauge(t.conns_accepted, t.conns_closed), gauge(t.idle_enter, t.idle_leave),
+               pct(t.req_cache_hit, t.req_cache_get), pct(t.file_cache_hit, t.file_cache_get),
+               (unsigned long long)t.zc_sends, (unsigned long long)t.zc_copied,
+               (unsigned long long)t.access_log_lines, (unsigned long long)t.access_log_dropped);
+}
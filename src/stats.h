@@ -0,0 +1,149 @@
+/*
+ * Live counters shared between processes: the master maps one region
+ * before forking, every reactor owns one cache-line-aligned slot in it and
+ * is its only writer (no locks, no atomic read-modify-write), and anyone
+ * holding the mapping sums the slots for live totals.
+ */
+
+#ifndef ZV_STATS_H
+#define ZV_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define ZV_STATS_SLOT_ALIGN 64
+
+/*
+ * Latency histograms, HDR style: microsecond values in half-octave buckets
+ * (two linear sub-buckets per power of two, <= 50% relative error) from
+ * 1us to 2^26us (~67s); the last bucket holds anything longer.
+ */
+#define ZV_HIST_BUCKETS 53
+
+enum {
+    ZV_HIST_TTFB = 0,           /* accept -> first response byte sent (first response of a connection) */
+    ZV_HIST_DURATION,           /* request's first byte parsed -> last response byte sent */
+    ZV_HIST_KINDS
+};
+
+typedef struct {
+    uint64_t sum_us;
+    uint64_t bucket[ZV_HIST_BUCKETS];
+} zv_hist_t;
+
+/* Every field is a monotonic counter; gauges are differences of two. */
+typedef struct {
+    uint64_t requests;          /* request heads parsed */
+    uint64_t status[6];         /* responses by class: [1] 1xx ... [5] 5xx, [0] anything else */
+    uint64_t bytes_out;         /* bytes written to client sockets */
+    uint64_t conns_accepted;    /* open connections = accepted - closed */
+    uint64_t conns_closed;
+    uint64_t idle_enter;        /* idle keep-alive connections = enter - leave */
+    uint64_t idle_leave;
+    uint64_t req_cache_get;     /* request block freelist */
+    uint64_t req_cache_hit;
+    uint64_t req_cache_malloc;
+    uint64_t req_cache_put;
+    uint64_t req_cache_free;
+    uint64_t file_cache_get;    /* file metadata cache (only while enabled) */
+    uint64_t file_cache_hit;
+    uint64_t zc_sends;          /* MSG_ZEROCOPY sends, completions, kernel copies, ENOBUFS */
+    uint64_t zc_completed;
+    uint64_t zc_copied;
+    uint64_t zc_nobufs;
+    uint64_t access_log_lines;  /* access log entries queued / dropped on a full ring */
+    uint64_t access_log_dropped;
+    zv_hist_t hist[ZV_HIST_KINDS][6];   /* by status class, indexed like status[] */
+} zv_stats_counters_t;
+
+#define ZV_STATS_NFIELDS (sizeof(zv_stats_counters_t) / sizeof(uint64_t))
+
+typedef struct {
+    zv_stats_counters_t c;
+    pid_t owner;                /* written by the master only: 0 free, -1 reserved */
+    int worker;                 /* written by the reactor at attach, for per-worker reports */
+    int reactor;
+} __attribute__((aligned(ZV_STATS_SLOT_ALIGN))) zv_stats_slot_t;
+
+/* the calling reactor's slot (a private one when it has none in the region) */
+extern __thread zv_stats_slot_t *zv_stats;
+
+/* Single writer per slot: plain load + store, relaxed so readers never see a torn value. */
+static inline void zv_stats_add(uint64_t *f, uint64_t n) {
+    __atomic_store_n(f, __atomic_load_n(f, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+#define ZV_STAT_ADD(field, n) zv_stats_add(&zv_stats->c.field, (uint64_t)(n))
+#define ZV_STAT_INC(field) ZV_STAT_ADD(field, 1)
+
+static inline int zv_stats_class(int status) {
+    int cls = status / 100;
+    return (cls >= 1 && cls <= 5) ? cls : 0;
+}
+
+static inline void zv_stats_status(int status) {
+    zv_stats_add(&zv_stats->c.status[zv_stats_class(status)], 1);
+}
+
+static inline uint64_t zv_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* 0 and 1 exact, then [2^k, 1.5 * 2^k) and [1.5 * 2^k, 2^(k+1)) */
+static inline int zv_hist_bucket(uint64_t us) {
+    if (us < 2) {
+        return (int)us;
+    }
+    int k = 63 - __builtin_clzll(us);
+    int idx = 2 * k + (int)((us >> (k - 1)) & 1);
+    return idx < ZV_HIST_BUCKETS - 1 ? idx : ZV_HIST_BUCKETS - 1;
+}
+
+/* Exclusive upper bound of bucket idx in microseconds (0 for the overflow bucket). */
+static inline uint64_t zv_hist_bucket_limit(int idx) {
+    if (idx < 2) {
+        return (uint64_t)idx + 1;
+    }
+    if (idx >= ZV_HIST_BUCKETS - 1) {
+        return 0;
+    }
+    int k = idx / 2;
+    return ((uint64_t)(2 + (idx & 1)) << (k - 1)) + (1ULL << (k - 1));
+}
+
+/* Record one latency sample: a clock-free bucket lookup and two adds. */
+static inline void zv_stats_observe(int kind, int status, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    zv_hist_t *h = &zv_stats->c.hist[kind][zv_stats_class(status)];
+    zv_stats_add(&h->sum_us, us);
+    zv_stats_add(&h->bucket[zv_hist_bucket(us)], 1);
+}
+
+/*
+ * Master: map a region with nslots slots (before forking, so every child
+ * shares it). return: 0 ok, -1 error (counting then stays per reactor)
+ */
+int zv_stats_init(int nslots);
+/* Master: reserve n adjacent slots for a worker about to be forked. return: first slot, -1 if full */
+int zv_stats_claim(int n);
+/* Master: record the worker's pid on its slots (0 gives reserved slots back). */
+void zv_stats_assign(int first, int n, pid_t pid);
+/* Master: a worker was reaped; fold its slots into the retired totals and free them. */
+void zv_stats_release(pid_t pid);
+/* Worker, after fork: reactor r will use slot first + r (r < n). */
+void zv_stats_bind(int first, int n);
+/* Reactor thread: point zv_stats at its slot. */
+void zv_stats_attach(int worker_id, int reactor_id);
+/* Slots in the shared region (0 without one); slot i, NULL while it is free (reactor < 0 until attached). */
+int zv_stats_nslots(void);
+const zv_stats_slot_t *zv_stats_slot(int i);
+
+/* Sum of every slot plus what exited workers left behind; never counts a reaped worker twice. */
+void zv_stats_total(zv_stats_counters_t *out);
+/* Log the totals once (master on SIGUSR1). */
+void zv_stats_report(void);
+
+#endif
@@ -5,134 +5,460 @@
  */
 
 #include "threadpool.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/eventfd.h>
 
 typedef enum {
     immediate_shutdown = 1,
     graceful_shutdown = 2
 } zv_threadpool_sd_t;
 
-static int threadpool_free(zv_threadpool_t *pool);
+#define ZV_TP_CACHELINE 64
+#define ZV_TP_NODES     ZV_TP_INJECT_SIZE           /* preallocated task nodes */
+#define ZV_TP_ABORT     ((zv_task_t *)1)            /* lost a steal race, worth retrying */
+
+/* 有界 MPMC 队列（Vyukov）：每个槽位带序号，生产者和消费者各自 CAS 自己的位置 */
+typedef struct {
+    atomic_size_t seq;
+    void *data;
+} zv_tp_cell_t;
+
+typedef struct {
+    _Alignas(ZV_TP_CACHELINE) atomic_size_t enq;
+    _Alignas(ZV_TP_CACHELINE) atomic_size_t deq;
+    _Alignas(ZV_TP_CACHELINE) zv_tp_cell_t *cells;
+    size_t mask;
+} zv_tp_ring_t;
+
+/* Chase-Lev 双端队列：只有所属线程在 bottom 端压入/弹出，其他线程从 top 端偷 */
+typedef struct {
+    _Alignas(ZV_TP_CACHELINE) atomic_long top;
+    _Alignas(ZV_TP_CACHELINE) atomic_long bottom;
+    _Atomic(zv_task_t *) buf[ZV_TP_DEQUE_SIZE];
+    zv_threadpool_t *pool;
+    pthread_t tid;
+    uint32_t rnd;
+} zv_tp_worker_t;
+
+struct zv_threadpool_s {
+    zv_tp_ring_t inject;                /* submissions from outside the pool */
+    zv_tp_ring_t free_nodes;            /* recycled entries of nodes[] */
+    zv_task_t *nodes;
+    zv_tp_worker_t *workers;
+    int thread_count;                   /* workers[] entries, fixed before any thread starts */
+    int started;                        /* threads actually created */
+    int efd;                            /* completion eventfd */
+
+    _Alignas(ZV_TP_CACHELINE) atomic_long pending;              /* added, not yet run */
+    _Alignas(ZV_TP_CACHELINE) _Atomic(zv_task_t *) done_head;   /* completion stack */
+
+    _Alignas(ZV_TP_CACHELINE) atomic_int sleepers;
+    atomic_int waking;                  /* a signalled thread has not run yet */
+    atomic_int shutdown;
+    pthread_mutex_t lock;               /* only for sleeping and waking */
+    pthread_cond_t cond;
+};
+
+/* 当前线程所属的 worker，用来让任务里再提交的任务直接进自己的 deque */
+static __thread zv_tp_worker_t *tp_self;
+
+static void threadpool_free(zv_threadpool_t *pool);
 static void *threadpool_worker(void *arg);
 
+static int ring_init(zv_tp_ring_t *q, size_t size) {
+    q->cells = (zv_tp_cell_t *)malloc(sizeof(zv_tp_cell_t) * size);
+    if (q->cells == NULL) {
+        return -1;
+    }
+    size_t i;
+    for (i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].data = NULL;
+    }
+    q->mask = size - 1;
+    atomic_init(&q->enq, 0);
+    atomic_init(&q->deq, 0);
+    return 0;
+}
+
+static int ring_push(zv_tp_ring_t *q, void *data) {
+    zv_tp_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->enq, memory_order_relaxed);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enq, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;      /* full */
+        } else {
+            pos = atomic_load_explicit(&q->enq, memory_order_relaxed);
+        }
+    }
+
+    cell->data = data;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+static void *ring_pop(zv_tp_ring_t *q) {
+    zv_tp_cell_t *cell;
+    size_t pos = atomic_load_explicit(&q->deq, memory_order_relaxed);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->deq, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;    /* empty */
+        } else {
+            pos = atomic_load_explicit(&q->deq, memory_order_relaxed);
+        }
+    }
+
+    void *data = cell->data;
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return data;
+}
+
+static int ring_nonempty(zv_tp_ring_t *q) {
+    return atomic_load(&q->enq) != atomic_load(&q->deq);
+}
+
+// 只能由所属线程调用
+static int deque_push(zv_tp_worker_t *w, zv_task_t *t) {
+    long b = atomic_load_explicit(&w->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&w->top, memory_order_acquire);
+    if (b - top >= ZV_TP_DEQUE_SIZE) {
+        return -1;
+    }
+    atomic_store_explicit(&w->buf[b & (ZV_TP_DEQUE_SIZE - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+// 只能由所属线程调用，和 deque_steal 只在最后一个元素上竞争
+static zv_task_t *deque_take(zv_tp_worker_t *w) {
+    long b = atomic_load_explicit(&w->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&w->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&w->top, memory_order_relaxed);
+
+    zv_task_t *t = NULL;
+    if (top <= b) {
+        t = atomic_load_explicit(&w->buf[b & (ZV_TP_DEQUE_SIZE - 1)], memory_order_relaxed);
+        if (top == b) {
+            if (!atomic_compare_exchange_strong_explicit(&w->top, &top, top + 1,
+                    memory_order_seq_cst, memory_order_relaxed)) {
+                t = NULL;
+            }
+            atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+    }
+    return t;
+}
+
+static zv_task_t *deque_steal(zv_tp_worker_t *w) {
+    long top = atomic_load_explicit(&w->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&w->bottom, memory_order_acquire);
+    if (top >= b) {
+        return NULL;
+    }
+
+    zv_task_t *t = atomic_load_explicit(&w->buf[top & (ZV_TP_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&w->top, &top, top + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return ZV_TP_ABORT;
+    }
+    return t;
+}
+
+static zv_task_t *task_get(zv_threadpool_t *pool) {
+    zv_task_t *t = (zv_task_t *)ring_pop(&pool->free_nodes);
+    if (t == NULL) {
+        // 预分配的节点用完了才退回 malloc
+        t = (zv_task_t *)malloc(sizeof(zv_task_t));
+        if (t == NULL) {
+            return NULL;
+        }
+        t->pooled = 0;
+    }
+    return t;
+}
+
+static void task_put(zv_threadpool_t *pool, zv_task_t *t) {
+    if (t->pooled) {
+        (void)ring_push(&pool->free_nodes, t);  /* sized for every node, cannot fail */
+    } else {
+        free(t);
+    }
+}
+
+static void wake_one(zv_threadpool_t *pool) {
+    // 和 park() 里的 sleepers++ 配对：要么这里看到有人睡，要么睡的人看到新任务
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->sleepers, memory_order_relaxed) == 0) {
+        return;
+    }
+    // 已经叫醒了一个还没跑起来的线程就不再叫，由它拿到一批任务后再接力唤醒
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&pool->waking, &expected, 1)) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_cond_signal(&pool->cond);
+    } else {
+        atomic_store(&pool->waking, 0);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void wake_all(zv_threadpool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
 zv_threadpool_t *threadpool_init(int thread_num) {
     if (thread_num <= 0) {
         log_err("the arg of threadpool_init must greater than 0");
         return NULL;
     }
 
-    zv_threadpool_t *pool;
-    if ((pool = (zv_threadpool_t *)malloc(sizeof(zv_threadpool_t))) == NULL) {
-        goto err;
+    zv_threadpool_t *pool = NULL;
+    if (posix_memalign((void **)&pool, ZV_TP_CACHELINE, sizeof(zv_threadpool_t)) != 0) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(zv_threadpool_t));
+    pool->efd = -1;
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->done_head, NULL);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->waking, 0);
+    atomic_init(&pool->shutdown, 0);
+
+    if (pthread_mutex_init(&(pool->lock), NULL) != 0) {
+        free(pool);
+        return NULL;
     }
 
-    pool->thread_count = 0;
-    pool->queue_size = 0;
-    pool->shutdown = 0;
-    pool->started = 0;
-    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * thread_num);
-    pool->head = (zv_task_t *)malloc(sizeof(zv_task_t));    /* dummy head */
+    if (pthread_cond_init(&(pool->cond), NULL) != 0) {
+        pthread_mutex_destroy(&(pool->lock));
+        free(pool);
+        return NULL;
+    }
 
-    if ((pool->threads == NULL) || (pool->head == NULL)) {
+    if (ring_init(&pool->inject, ZV_TP_INJECT_SIZE) < 0 || ring_init(&pool->free_nodes, ZV_TP_NODES) < 0) {
         goto err;
     }
 
-    pool->head->func = NULL;
-    pool->head->arg = NULL;
-    pool->head->next = NULL;
+    pool->nodes = (zv_task_t *)calloc(ZV_TP_NODES, sizeof(zv_task_t));
+    if (pool->nodes == NULL) {
+        goto err;
+    }
+    int i;
+    for (i = 0; i < ZV_TP_NODES; i++) {
+        pool->nodes[i].pooled = 1;
+        (void)ring_push(&pool->free_nodes, &pool->nodes[i]);
+    }
 
-    if (pthread_mutex_init(&(pool->lock), NULL) != 0) {
+    if (posix_memalign((void **)&pool->workers, ZV_TP_CACHELINE, sizeof(zv_tp_worker_t) * thread_num) != 0) {
+        pool->workers = NULL;
         goto err;
     }
+    for (i = 0; i < thread_num; i++) {
+        zv_tp_worker_t *w = &pool->workers[i];
+        atomic_init(&w->top, 0);
+        atomic_init(&w->bottom, 0);
+        w->pool = pool;
+        w->rnd = 0x9e3779b9u * (uint32_t)(i + 1);
+    }
+    pool->thread_count = thread_num;
 
-    if (pthread_cond_init(&(pool->cond), NULL) != 0) {
-        pthread_mutex_destroy(&(pool->lock));
+    pool->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool->efd < 0) {
+        log_err("eventfd");
         goto err;
     }
-    
-    int i;
-    for (i=0; i<thread_num; ++i) {
-        if (pthread_create(&(pool->threads[i]), NULL, threadpool_worker, (void *)pool) != 0) {
+
+    for (i = 0; i < thread_num; ++i) {
+        if (pthread_create(&(pool->workers[i].tid), NULL, threadpool_worker, (void *)&pool->workers[i]) != 0) {
             threadpool_destroy(pool, 0);
             return NULL;
         }
-        log_info("thread: %08x started", (uint32_t) pool->threads[i]);
+        log_info("thread: %08x started", (uint32_t) pool->workers[i].tid);
 
-        pool->thread_count++;
         pool->started++;
     }
 
     return pool;
 
 err:
-    if (pool) {
-        threadpool_free(pool);
-    }
-
+    threadpool_free(pool);
     return NULL;
 }
 
-int threadpool_add(zv_threadpool_t *pool, void (*func)(void *), void *arg) {
-    int rc, err = 0;
+static int threadpool_submit(zv_threadpool_t *pool, void (*func)(void *), void (*done)(void *), void *arg) {
     if (pool == NULL || func == NULL) {
         log_err("pool == NULL or func == NULL");
         return -1;
     }
-    
-    if (pthread_mutex_lock(&(pool->lock)) != 0) {
-        log_err("pthread_mutex_lock");
-        return -1;
-    }
 
-    if (pool->shutdown) {
-        err = zv_tp_already_shutdown;
-        goto out;
+    // 平滑关闭期间，正在跑的任务仍可以继续提交后续任务（它们算在排空的工作里）
+    zv_tp_worker_t *self = tp_self;
+    int sd = atomic_load_explicit(&pool->shutdown, memory_order_relaxed);
+    if (sd == immediate_shutdown || (sd == graceful_shutdown && (self == NULL || self->pool != pool))) {
+        return zv_tp_already_shutdown;
     }
-    
-    // TODO: use a memory pool
-    zv_task_t *task = (zv_task_t *)malloc(sizeof(zv_task_t));
+
+    zv_task_t *task = task_get(pool);
     if (task == NULL) {
         log_err("malloc task fail");
-        goto out;
+        return -1;
     }
-    
-    // TODO: use a memory pool
     task->func = func;
+    task->done = done;
     task->arg = arg;
-    task->next = pool->head->next;
-    pool->head->next = task;
+    task->next = NULL;
 
-    pool->queue_size++;
-    
-    rc = pthread_cond_signal(&(pool->cond));
-    check(rc == 0, "pthread_cond_signal");
+    atomic_fetch_add_explicit(&pool->pending, 1, memory_order_relaxed);
 
-out:
-    if(pthread_mutex_unlock(&pool->lock) != 0) {
-        log_err("pthread_mutex_unlock");
-        return -1;
+    // 池内线程提交的任务留在自己的 deque 里，其余的走共享队列
+    if (self == NULL || self->pool != pool || deque_push(self, task) < 0) {
+        if (ring_push(&pool->inject, task) < 0) {
+            atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_relaxed);
+            task_put(pool, task);
+            return zv_tp_queue_full;
+        }
     }
-    
-    return err;
+
+    wake_one(pool);
+    return 0;
 }
 
-int threadpool_free(zv_threadpool_t *pool) {
-    if (pool == NULL || pool->started > 0) {
+int threadpool_add(zv_threadpool_t *pool, void (*func)(void *), void *arg) {
+    return threadpool_submit(pool, func, NULL, arg);
+}
+
+int threadpool_add_done(zv_threadpool_t *pool, void (*func)(void *),
+                        void (*done)(void *), void *arg) {
+    if (done == NULL) {
         return -1;
     }
+    return threadpool_submit(pool, func, done, arg);
+}
+
+int threadpool_completion_fd(zv_threadpool_t *pool) {
+    return pool ? pool->efd : -1;
+}
+
+// 完成队列是无锁栈：只有栈由空变非空时才写 eventfd，一批完成只唤醒事件循环一次
+static void push_completion(zv_threadpool_t *pool, zv_task_t *t) {
+    zv_task_t *head = atomic_load_explicit(&pool->done_head, memory_order_relaxed);
+    do {
+        t->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->done_head, &head, t,
+                memory_order_release, memory_order_relaxed));
+
+    if (head == NULL) {
+        uint64_t one = 1;
+        ssize_t n;
+        do {
+            n = write(pool->efd, &one, sizeof(one));
+        } while (n < 0 && errno == EINTR);
+    }
+}
 
-    if (pool->threads) {
-        free(pool->threads);
+int threadpool_run_completions(zv_threadpool_t *pool) {
+    if (pool == NULL) {
+        return 0;
     }
 
-    zv_task_t *old;
-    /* pool->head is a dummy head */
-    while (pool->head->next) {
-        old = pool->head->next;
-        pool->head->next = pool->head->next->next;
-        free(old);
+    uint64_t cnt;
+    while (read(pool->efd, &cnt, sizeof(cnt)) > 0) {
+        /* drain the counter (edge-triggered) */
     }
 
-    return 0;
+    // 一次取走整个栈，再反转成提交完成的先后顺序
+    zv_task_t *t = atomic_exchange_explicit(&pool->done_head, NULL, memory_order_acquire);
+    zv_task_t *fifo = NULL;
+    while (t) {
+        zv_task_t *next = t->next;
+        t->next = fifo;
+        fifo = t;
+        t = next;
+    }
+
+    int n = 0;
+    while (fifo) {
+        zv_task_t *next = fifo->next;
+        void (*done)(void *) = fifo->done;
+        void *arg = fifo->arg;
+        task_put(pool, fifo);
+        done(arg);
+        n++;
+        fifo = next;
+    }
+    return n;
+}
+
+static void threadpool_free(zv_threadpool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    // 只剩 malloc 出来的节点需要单独释放，预分配的随 nodes 一起释放
+    zv_task_t *t;
+    if (pool->inject.cells) {
+        while ((t = (zv_task_t *)ring_pop(&pool->inject)) != NULL) {
+            task_put(pool, t);
+        }
+    }
+    if (pool->workers) {
+        int i;
+        for (i = 0; i < pool->thread_count; i++) {
+            while ((t = deque_take(&pool->workers[i])) != NULL) {
+                task_put(pool, t);
+            }
+        }
+    }
+    t = atomic_exchange(&pool->done_head, NULL);
+    while (t) {
+        zv_task_t *next = t->next;
+        if (!t->pooled) {
+            free(t);
+        }
+        t = next;
+    }
+
+    if (pool->efd >= 0) {
+        close(pool->efd);
+    }
+    free(pool->workers);
+    free(pool->nodes);
+    free(pool->inject.cells);
+    free(pool->free_nodes.cells);
+    pthread_mutex_destroy(&(pool->lock));
+    pthread_cond_destroy(&(pool->cond));
+    free(pool);
 }
 
 int threadpool_destroy(zv_threadpool_t *pool, int graceful) {
@@ -142,91 +468,184 @@ int threadpool_destroy(zv_threadpool_t *pool, int graceful) {
         log_err("pool == NULL");
         return zv_tp_invalid;
     }
-    
+
     if (pthread_mutex_lock(&(pool->lock)) != 0) {
         return zv_tp_lock_fail;
     }
-    
-    do {
-        // set the showdown flag of pool and wake up all thread    
-        if (pool->shutdown) {
-            err = zv_tp_already_shutdown;
-            break;
+
+    // set the showdown flag of pool and wake up all thread
+    if (atomic_load(&pool->shutdown)) {
+        pthread_mutex_unlock(&(pool->lock));
+        return zv_tp_already_shutdown;
+    }
+
+    atomic_store(&pool->shutdown, (graceful)? graceful_shutdown: immediate_shutdown);
+
+    if (pthread_cond_broadcast(&(pool->cond)) != 0) {
+        err = zv_tp_cond_broadcast;
+    }
+
+    if (pthread_mutex_unlock(&(pool->lock)) != 0) {
+        return zv_tp_lock_fail;
+    }
+
+    int i;
+    for (i = 0; i < pool->started; i++) {
+        if (pthread_join(pool->workers[i].tid, NULL) != 0) {
+            err = zv_tp_thread_fail;
         }
+        log_info("thread %08x exit", (uint32_t) pool->workers[i].tid);
+    }
+
+    if (!err) {
+        threadpool_free(pool);
+    }
+
+    return err;
+}
+
+static zv_task_t *grab_injected(zv_threadpool_t *pool, zv_tp_worker_t *self) {
+    zv_task_t *first = (zv_task_t *)ring_pop(&pool->inject);
+    if (first == NULL) {
+        return NULL;
+    }
 
-        pool->shutdown = (graceful)? graceful_shutdown: immediate_shutdown;
-        
-        if (pthread_cond_broadcast(&(pool->cond)) != 0) {
-            err = zv_tp_cond_broadcast;
+    // 自己的 deque 此时是空的，多拿几个放进去，让空闲线程来偷，减少对共享队列的争用
+    int moved = 0, i;
+    for (i = 1; i < ZV_TP_BATCH; i++) {
+        zv_task_t *t = (zv_task_t *)ring_pop(&pool->inject);
+        if (t == NULL) {
             break;
         }
+        (void)deque_push(self, t);
+        moved++;
+    }
+    if (moved > 0) {
+        wake_one(pool);
+    }
+    return first;
+}
 
-        if (pthread_mutex_unlock(&(pool->lock)) != 0) {
-            err = zv_tp_lock_fail;
+static zv_task_t *steal_any(zv_threadpool_t *pool, zv_tp_worker_t *self) {
+    int n = pool->thread_count;
+    int round, i;
+
+    for (round = 0; round < 2; round++) {
+        // xorshift 随机选起点，避免所有线程同时盯着同一个 victim
+        self->rnd ^= self->rnd << 13;
+        self->rnd ^= self->rnd >> 17;
+        self->rnd ^= self->rnd << 5;
+        int start = (int)(self->rnd % (uint32_t)n);
+        int aborted = 0;
+
+        for (i = 0; i < n; i++) {
+            zv_tp_worker_t *v = &pool->workers[(start + i) % n];
+            if (v == self) {
+                continue;
+            }
+            zv_task_t *t = deque_steal(v);
+            if (t == ZV_TP_ABORT) {
+                aborted = 1;
+            } else if (t) {
+                return t;
+            }
+        }
+        if (!aborted) {
             break;
         }
-        
-        int i;
-        for (i=0; i<pool->thread_count; i++) {
-            if (pthread_join(pool->threads[i], NULL) != 0) {
-                err = zv_tp_thread_fail;
-            }
-            log_info("thread %08x exit", (uint32_t) pool->threads[i]);
+    }
+    return NULL;
+}
+
+static int has_work(zv_threadpool_t *pool) {
+    if (ring_nonempty(&pool->inject)) {
+        return 1;
+    }
+    int i;
+    for (i = 0; i < pool->thread_count; i++) {
+        zv_tp_worker_t *w = &pool->workers[i];
+        if (atomic_load(&w->bottom) > atomic_load(&w->top)) {
+            return 1;
         }
-             
-    } while(0);
+    }
+    return 0;
+}
 
-    if (!err) {
-        pthread_mutex_destroy(&(pool->lock));
-        pthread_cond_destroy(&(pool->cond));
-        threadpool_free(pool);
+static int should_exit(zv_threadpool_t *pool) {
+    int sd = atomic_load(&pool->shutdown);
+    return sd == immediate_shutdown || (sd == graceful_shutdown && atomic_load(&pool->pending) == 0);
+}
+
+// 没活干时睡眠；返回 -1 表示线程该退出了
+static int park(zv_threadpool_t *pool) {
+    int rc;
+
+    pthread_mutex_lock(&(pool->lock));
+    atomic_fetch_add(&pool->sleepers, 1);
+
+    /*  Wait on condition variable, check for spurious wakeups. */
+    while (!should_exit(pool) && !has_work(pool)) {
+        pthread_cond_wait(&(pool->cond), &(pool->lock));
+        atomic_store(&pool->waking, 0);
     }
 
-    return err;
+    atomic_fetch_sub(&pool->sleepers, 1);
+    rc = should_exit(pool) ? -1 : 0;
+    pthread_mutex_unlock(&(pool->lock));
+    return rc;
+}
+
+static void run_task(zv_threadpool_t *pool, zv_task_t *task) {
+    (*(task->func))(task->arg);
+
+    if (task->done) {
+        push_completion(pool, task);
+    } else {
+        task_put(pool, task);
+    }
+
+    // 平滑关闭时最后一个任务做完，叫醒睡着的线程让它们退出
+    if (atomic_fetch_sub(&pool->pending, 1) == 1 && atomic_load(&pool->shutdown)) {
+        wake_all(pool);
+    }
 }
 
 static void *threadpool_worker(void *arg) {
     if (arg == NULL) {
-        log_err("arg should be type zv_threadpool_t*");
+        log_err("arg should be type zv_tp_worker_t*");
         return NULL;
     }
 
-    zv_threadpool_t *pool = (zv_threadpool_t *)arg;
+    zv_tp_worker_t *self = (zv_tp_worker_t *)arg;
+    zv_threadpool_t *pool = self->pool;
     zv_task_t *task;
 
+    tp_self = self;
+
     while (1) {
-        pthread_mutex_lock(&(pool->lock));
-        
-        /*  Wait on condition variable, check for spurious wakeups. */
-        while ((pool->queue_size == 0) && !(pool->shutdown)){
-            pthread_cond_wait(&(pool->cond), &(pool->lock));
+        if (atomic_load_explicit(&pool->shutdown, memory_order_relaxed) == immediate_shutdown) {
+            break;
         }
 
-        if (pool->shutdown == immediate_shutdown) {
-            break;
-        } else if ((pool->shutdown == graceful_shutdown) && pool->queue_size == 0) {
-            break;
+        // 先自己的 deque，再共享队列，最后去别的线程那里偷
+        task = deque_take(self);
+        if (task == NULL) {
+            task = grab_injected(pool, self);
+        }
+        if (task == NULL) {
+            task = steal_any(pool, self);
         }
 
-        task = pool->head->next;
         if (task == NULL) {
-            pthread_mutex_unlock(&(pool->lock));
+            if (park(pool) < 0) {
+                break;
+            }
             continue;
         }
 
-        pool->head->next = task->next;
-        pool->queue_size--;
-
-        pthread_mutex_unlock(&(pool->lock));
-
-        (*(task->func))(task->arg);
-        /* TODO: memory pool */
-        free(task);
+        run_task(pool, task);
     }
 
-    pool->started--;
-    pthread_mutex_unlock(&(pool->lock));
-    pthread_exit(NULL);
-
+    tp_self = NULL;
     return NULL;
 }
@@ -19,22 +19,30 @@ extern "C" {
 
 #define THREAD_NUM 8
 
+/* All sizes must be powers of two. */
+#ifndef ZV_TP_DEQUE_SIZE
+#define ZV_TP_DEQUE_SIZE    256     /* per-thread work-stealing deque */
+#endif
+#ifndef ZV_TP_INJECT_SIZE
+#define ZV_TP_INJECT_SIZE   4096    /* shared submission queue */
+#endif
+#define ZV_TP_BATCH         8       /* tasks moved from the shared queue per grab */
+
 typedef struct zv_task_s {
     void (*func)(void *);
+    void (*done)(void *);           /* NULL: fire and forget */
     void *arg;
-    struct zv_task_s *next;
+    struct zv_task_s *next;         /* completion stack link */
+    int pooled;                     /* node came from the pool's preallocated array */
 } zv_task_t;
 
-typedef struct {
-    pthread_mutex_t lock;
-    pthread_cond_t cond;
-    pthread_t *threads;
-    zv_task_t *head;
-    int thread_count;
-    int queue_size;
-    int shutdown;
-    int started;
-} zv_threadpool_t;
+/*
+ * Lock-free pool: submissions go through a bounded MPMC queue, every thread
+ * keeps a Chase-Lev deque it refills in batches from that queue and that idle
+ * threads steal from. Task nodes are preallocated and recycled. The mutex and
+ * condvar are only touched by threads going to sleep and by whoever wakes them.
+ */
+typedef struct zv_threadpool_s zv_threadpool_t;
 
 typedef enum {
     zv_tp_invalid   = -1,
@@ -42,13 +50,27 @@ typedef enum {
     zv_tp_already_shutdown  = -3,
     zv_tp_cond_broadcast    = -4,
     zv_tp_thread_fail       = -5,
-    
+    zv_tp_queue_full        = -6,
 } zv_threadpool_error_t;
 
 zv_threadpool_t *threadpool_init(int thread_num);
 
 int threadpool_add(zv_threadpool_t *pool, void (*func)(void *), void *arg);
 
+/*
+ * Run func(arg) on a pool thread, then queue done(arg) for the thread that
+ * calls threadpool_run_completions() (normally the owning event loop, which
+ * polls threadpool_completion_fd()).
+ */
+int threadpool_add_done(zv_threadpool_t *pool, void (*func)(void *),
+                        void (*done)(void *), void *arg);
+
+/* eventfd, readable while completions are queued */
+int threadpool_completion_fd(zv_threadpool_t *pool);
+
+/* Run every queued done callback on the calling thread; returns how many ran. */
+int threadpool_run_completions(zv_threadpool_t *pool);
+
 int threadpool_destroy(zv_threadpool_t *pool, int gracegul);
 
 #ifdef __cplusplus
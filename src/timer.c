@@ -6,6 +6,7 @@
 
 #include <time.h>
 #include "timer.h"
+#include "zv_probes.h"
 //比较函数，key返回1表示ti在tj之前，即ti优先级更高
 static int timer_comp(void *ti, void *tj) {
     zv_timer_node *timeri = (zv_timer_node *)ti;
@@ -14,8 +15,9 @@ static int timer_comp(void *ti, void *tj) {
     return (timeri->key < timerj->key)? 1: 0;
 }
 
-zv_pq_t zv_timer;
-size_t zv_current_msec;
+/* 每个 reactor 线程一份 */
+__thread zv_pq_t zv_timer;
+__thread size_t zv_current_msec;
 
 //更新当前时间 保存在一个全局时间变量上
 static void zv_time_update() {
@@ -96,6 +98,7 @@ void zv_handle_expire_timers() {
         if (timer_node->handler) {
             if (timer_node->rq) {
                 timer_node->rq->timer = NULL;
+                ZV_PROBE2(timeout, timer_node->rq->fd, timer_node->rq->req_start_ns);
             }
             log_info("time out, closed fd %d", timer_node->rq->fd);
             timer_node->handler(timer_node->rq);
@@ -105,6 +108,44 @@ void zv_handle_expire_timers() {
         free(timer_node);
     }
 }
+//reactor 退出时：所有定时器立即到期（关闭剩下的连接），然后释放堆
+void zv_expire_all_timers() {
+    zv_timer_node *timer_node;
+    int rc;
+
+    while (!zv_pq_is_empty(&zv_timer)) {
+        timer_node = (zv_timer_node *)zv_pq_min(&zv_timer);
+        rc = zv_pq_delmin(&zv_timer);
+        check(rc == 0, "zv_expire_all_timers: zv_pq_delmin error");
+        if (!timer_node->deleted && timer_node->handler) {
+            if (timer_node->rq) {
+                timer_node->rq->timer = NULL;
+            }
+            timer_node->handler(timer_node->rq);
+        }
+        free(timer_node);
+    }
+    free(zv_timer.pq);
+    zv_timer.pq = NULL;
+}
+//提前触发满足 pred 的定时器（平滑停止时关闭空闲连接）
+//节点只标记删除，留给 zv_find_timer/zv_handle_expire_timers 从堆里摘掉，遍历期间堆不变
+int zv_expire_timers_if(int (*pred)(zv_http_request_t *rq)) {
+    size_t i;
+    int n = 0;
+
+    for (i = 1; i <= zv_timer.nalloc; i++) {
+        zv_timer_node *timer_node = (zv_timer_node *)zv_timer.pq[i];
+        if (timer_node->deleted || !timer_node->handler || !timer_node->rq || !pred(timer_node->rq)) {
+            continue;
+        }
+        timer_node->deleted = 1;
+        timer_node->rq->timer = NULL;
+        timer_node->handler(timer_node->rq);
+        n++;
+    }
+    return n;
+}
 //创建定时器节点并插入优先队列
 //让定时器节点与http_request关联
 void zv_add_timer(zv_http_request_t *rq, size_t timeout, timer_handler_pt handler) {
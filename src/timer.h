@@ -25,9 +25,14 @@ typedef struct zv_timer_node_s{
 int zv_timer_init();
 int zv_find_timer();
 void zv_handle_expire_timers();
-
-extern zv_pq_t zv_timer;
-extern size_t zv_current_msec;
+/* Fire every pending timer now and free the heap (reactor shutdown). */
+void zv_expire_all_timers();
+/* Fire now every pending timer whose request matches pred. return: how many fired */
+int zv_expire_timers_if(int (*pred)(zv_http_request_t *rq));
+
+/* per reactor thread */
+extern __thread zv_pq_t zv_timer;
+extern __thread size_t zv_current_msec;
 
 void zv_add_timer(zv_http_request_t *rq, size_t timeout, timer_handler_pt handler);
 void zv_del_timer(zv_http_request_t *rq);
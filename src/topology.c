@@ -0,0 +1,146 @@
+/*
+ * CPU topology from sysfs (see topology.h).
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "topology.h"
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "dbg.h"
+
+#define ZV_SYSFS_CPU "/sys/devices/system/cpu"
+#ifndef ZV_MPOL_PREFERRED
+#define ZV_MPOL_PREFERRED 1     /* MPOL_PREFERRED in linux/mempolicy.h */
+#endif
+
+typedef struct {
+    int cpu;
+    int node;
+    int package;
+    int core;
+    int smt;    /* 0 for the lowest-numbered thread of a core, 1 for the next ... */
+    int pos;    /* index among the CPUs of the same node and smt level */
+} zv_cpu_info_t;
+
+static int read_int(const char *path, int dflt) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return dflt;
+    }
+    int v;
+    if (fscanf(fp, "%d", &v) != 1) {
+        v = dflt;
+    }
+    fclose(fp);
+    return v;
+}
+
+// cpuN 目录下的 nodeM 链接给出所属 NUMA 节点
+int zv_topology_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), ZV_SYSFS_CPU "/cpu%d", cpu);
+    DIR *d = opendir(path);
+    if (!d) {
+        return 0;
+    }
+    int node = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        int n;
+        if (strncmp(e->d_name, "node", 4) == 0 && sscanf(e->d_name + 4, "%d", &n) == 1) {
+            node = n;
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+// 排序键：先 SMT 层级（每个物理核先占一个线程），再在各 NUMA 节点之间轮流
+static int cpu_cmp(const void *a, const void *b) {
+    const zv_cpu_info_t *x = (const zv_cpu_info_t *)a;
+    const zv_cpu_info_t *y = (const zv_cpu_info_t *)b;
+    if (x->smt != y->smt) return x->smt - y->smt;
+    if (x->pos != y->pos) return x->pos - y->pos;
+    if (x->node != y->node) return x->node - y->node;
+    return x->cpu - y->cpu;
+}
+
+int zv_topology_order(int *cpus, int cap) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return -1;
+    }
+    zv_cpu_info_t *info = (zv_cpu_info_t *)malloc(sizeof(zv_cpu_info_t) * CPU_SETSIZE);
+    if (!info) {
+        return -1;
+    }
+
+    int n = 0;
+    int cpu, i;
+    char path[128];
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        zv_cpu_info_t *c = &info[n];
+        c->cpu = cpu;
+        c->node = zv_topology_node(cpu);
+        snprintf(path, sizeof(path), ZV_SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        c->package = read_int(path, 0);
+        // 读不到拓扑时每个 CPU 当作独立的核
+        snprintf(path, sizeof(path), ZV_SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+        c->core = read_int(path, cpu);
+        c->smt = 0;
+        c->pos = 0;
+        // CPU 编号升序遍历：同一物理核里编号小的线程先被用上
+        for (i = 0; i < n; i++) {
+            if (info[i].package == c->package && info[i].core == c->core) {
+                c->smt++;
+            }
+        }
+        n++;
+    }
+    for (i = 0; i < n; i++) {
+        int j;
+        for (j = 0; j < i; j++) {
+            if (info[j].smt == info[i].smt && info[j].node == info[i].node) {
+                info[i].pos++;
+            }
+        }
+    }
+    qsort(info, (size_t)n, sizeof(zv_cpu_info_t), cpu_cmp);
+
+    if (n > cap) {
+        n = cap;
+    }
+    for (i = 0; i < n; i++) {
+        cpus[i] = info[i].cpu;
+    }
+    free(info);
+    return n;
+}
+
+// 线程级内存策略：之后的分配优先落在 node 上（之后创建的辅助线程也继承）
+int zv_topology_bind_memory(int node) {
+#ifdef __NR_set_mempolicy
+    unsigned long mask;
+    if (node < 0 || node >= (int)(sizeof(mask) * 8) - 1) {
+        return -1;
+    }
+    mask = 1UL << node;
+    return (int)syscall(__NR_set_mempolicy, ZV_MPOL_PREFERRED, &mask, (unsigned long)(sizeof(mask) * 8));
+#else
+    (void)node;
+    return -1;
+#endif
+}
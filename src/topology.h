@@ -0,0 +1,23 @@
+/*
+ * CPU topology from sysfs, used to place reactors: one hardware thread per
+ * physical core first, spread across NUMA nodes, SMT siblings only after
+ * every core has a reactor.
+ */
+
+#ifndef ZV_TOPOLOGY_H
+#define ZV_TOPOLOGY_H
+
+/*
+ * Fill cpus with the calling thread's allowed CPUs in placement order
+ * (slot s goes to cpus[s % n]). Falls back to ascending CPU numbers when
+ * sysfs is unreadable. return: n, or -1 on error
+ */
+int zv_topology_order(int *cpus, int cap);
+
+/* NUMA node of cpu, 0 when unknown */
+int zv_topology_node(int cpu);
+
+/* Prefer node for the calling thread's future allocations. return: 0 ok, -1 error */
+int zv_topology_bind_memory(int node);
+
+#endif
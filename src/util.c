@@ -7,6 +7,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -75,6 +76,46 @@ int make_socket_non_blocking(int fd) {
     return 0;
 }
 
+// 设置发送缓冲区大小和未发送数据低水位，值为 0 的项不动（保持内核默认/自动调节）
+// 低水位限制了 sendfile 能在内核里堆积的未发送字节数，EPOLLOUT 也只在低于它时触发
+int zv_set_send_buffers(int fd, int sndbuf, int notsent_lowat) {
+    int rc = 0;
+    if (sndbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) < 0) {
+        log_warn("setsockopt SO_SNDBUF failed, fd=%d", fd);
+        rc = -1;
+    }
+#ifdef TCP_NOTSENT_LOWAT
+    if (notsent_lowat > 0 && setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &notsent_lowat, sizeof(notsent_lowat)) < 0) {
+        log_warn("setsockopt TCP_NOTSENT_LOWAT failed, fd=%d", fd);
+        rc = -1;
+    }
+#endif
+    return rc;
+}
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69  /* linux 5.11+, missing from older libc headers */
+#endif
+
+// 套接字级忙轮询：阻塞读时先轮询网卡队列 usecs 微秒；accept 出来的连接继承监听套接字的设置
+int zv_set_busy_poll(int fd, int usecs) {
+#ifdef SO_BUSY_POLL
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0) {
+        return -1;
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0) {
+        return -1;
+    }
+    return 0;
+#else
+    (void)fd;
+    (void)usecs;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 /*
 * Read configuration file
 * TODO: trim input line
@@ -89,10 +130,35 @@ int read_conf(char *filename, zv_conf_t *cf, char *buf, int len) {
     cf->root = NULL;
     cf->port = 3000;
     cf->thread_num = 4;
+    cf->reactor_threads = ZV_DEFAULT_REACTOR_THREADS;
     cf->workers = 1;
     cf->cpu_affinity = 0;
+    cf->reuseport_steering = 0;
+    cf->accept_mode = ZV_ACCEPT_REUSEPORT;
+    cf->accept_max_conns = 0;
     cf->keep_alive_timeout_ms = ZV_DEFAULT_KEEP_ALIVE_TIMEOUT_MS;
     cf->request_timeout_ms = ZV_DEFAULT_REQUEST_TIMEOUT_MS;
+    cf->drain_timeout_ms = ZV_DEFAULT_DRAIN_TIMEOUT_MS;
+    cf->metrics_path = NULL;
+    cf->access_log = NULL;
+    cf->access_log_format = NULL;
+    cf->access_log_buffer_kb = ZV_DEFAULT_ACCESS_LOG_BUFFER_KB;
+    cf->log_level = ZV_LOG_DEBUG;
+    cf->log_rate_limit = ZV_LOG_DEFAULT_RATE;
+    cf->send_quantum_kb = ZV_DEFAULT_SEND_QUANTUM_KB;
+    cf->tcp_notsent_lowat = 0;
+    cf->sndbuf = 0;
+    cf->large_file_kb = ZV_DEFAULT_LARGE_FILE_KB;
+    cf->large_notsent_lowat = ZV_DEFAULT_LARGE_NOTSENT_LOWAT;
+    cf->large_sndbuf = 0;
+    cf->mmap_threshold_kb = ZV_DEFAULT_MMAP_THRESHOLD_KB;
+    cf->zerocopy_threshold_kb = ZV_DEFAULT_ZEROCOPY_THRESHOLD_KB;
+    cf->aio_probe_kb = ZV_DEFAULT_AIO_PROBE_KB;
+    cf->file_cache_ttl_ms = ZV_DEFAULT_FILE_CACHE_TTL_MS;
+    cf->readahead_kb = ZV_DEFAULT_READAHEAD_KB;
+    cf->page_cache_budget_kb = ZV_DEFAULT_PAGE_CACHE_BUDGET_KB;
+    cf->event_backend = ZV_EVENT_BACKEND_EPOLL;
+    cf->busy_poll_us = 0;
 
     int pos = 0;
     char *delim_pos;
@@ -133,6 +199,10 @@ int read_conf(char *filename, zv_conf_t *cf, char *buf, int len) {
             cf->thread_num = atoi(val);
         }
 
+        if (strncmp("reactor_threads", cur_pos, 15) == 0) {
+            cf->reactor_threads = atoi(val);
+        }
+
         if (strncmp("workers", cur_pos, 7) == 0) {
             cf->workers = atoi(val);
         }
@@ -141,6 +211,25 @@ int read_conf(char *filename, zv_conf_t *cf, char *buf, int len) {
             cf->cpu_affinity = atoi(val);
         }
 
+        if (strncmp("reuseport_steering", cur_pos, 18) == 0) {
+            cf->reuseport_steering = atoi(val);
+        }
+
+        if (strncmp("accept_mode", cur_pos, 11) == 0) {
+            if (strcmp(val, "shared") == 0) {
+                cf->accept_mode = ZV_ACCEPT_SHARED;
+            } else if (strcmp(val, "reuseport") == 0) {
+                cf->accept_mode = ZV_ACCEPT_REUSEPORT;
+            } else {
+                log_err("unknown accept_mode: %s", val);
+                return ZV_CONF_ERROR;
+            }
+        }
+
+        if (strncmp("accept_max_conns", cur_pos, 16) == 0) {
+            cf->accept_max_conns = atoi(val);
+        }
+
         if (strncmp("keep_alive_timeout_ms", cur_pos, 20) == 0) {
             cf->keep_alive_timeout_ms = atoi(val);
         }
@@ -149,6 +238,109 @@ int read_conf(char *filename, zv_conf_t *cf, char *buf, int len) {
             cf->request_timeout_ms = atoi(val);
         }
 
+        if (strncmp("send_quantum_kb", cur_pos, 15) == 0) {
+            cf->send_quantum_kb = atoi(val);
+        }
+
+        if (strncmp("tcp_notsent_lowat", cur_pos, 17) == 0) {
+            cf->tcp_notsent_lowat = atoi(val);
+        }
+
+        if (strncmp("sndbuf", cur_pos, 6) == 0) {
+            cf->sndbuf = atoi(val);
+        }
+
+        if (strncmp("large_file_kb", cur_pos, 13) == 0) {
+            cf->large_file_kb = atoi(val);
+        }
+
+        if (strncmp("large_notsent_lowat", cur_pos, 19) == 0) {
+            cf->large_notsent_lowat = atoi(val);
+        }
+
+        if (strncmp("large_sndbuf", cur_pos, 12) == 0) {
+            cf->large_sndbuf = atoi(val);
+        }
+
+        if (strncmp("mmap_threshold_kb", cur_pos, 17) == 0) {
+            cf->mmap_threshold_kb = atoi(val);
+        }
+
+        if (strncmp("zerocopy_threshold_kb", cur_pos, 21) == 0) {
+            cf->zerocopy_threshold_kb = atoi(val);
+        }
+
+        if (strncmp("aio_probe_kb", cur_pos, 12) == 0) {
+            cf->aio_probe_kb = atoi(val);
+        }
+
+        if (strncmp("file_cache_ttl_ms", cur_pos, 17) == 0) {
+            cf->file_cache_ttl_ms = atoi(val);
+        }
+
+        if (strncmp("readahead_kb", cur_pos, 12) == 0) {
+            cf->readahead_kb = atoi(val);
+        }
+
+        if (strncmp("page_cache_budget_kb", cur_pos, 20) == 0) {
+            cf->page_cache_budget_kb = atoi(val);
+        }
+
+        if (strncmp("event_backend", cur_pos, 13) == 0) {
+            if (strcmp(val, "io_uring") == 0 || strcmp(val, "uring") == 0) {
+                cf->event_backend = ZV_EVENT_BACKEND_IO_URING;
+            } else if (strcmp(val, "epoll") == 0) {
+                cf->event_backend = ZV_EVENT_BACKEND_EPOLL;
+            } else {
+                log_err("unknown event_backend: %s", val);
+                return ZV_CONF_ERROR;
+            }
+        }
+
+        if (strncmp("busy_poll_us", cur_pos, 12) == 0) {
+            cf->busy_poll_us = atoi(val);
+        }
+
+        if (strncmp("drain_timeout_ms", cur_pos, 16) == 0) {
+            cf->drain_timeout_ms = atoi(val);
+        }
+
+        // access_log 是另外两个键的前缀，要求键名到此结束
+        if (strncmp("access_log", cur_pos, 10) == 0 && (cur_pos[10] == '=' || cur_pos[10] == ' ' || cur_pos[10] == '\t')) {
+            cf->access_log = (val[0] != '\0') ? val : NULL;
+        }
+
+        if (strncmp("access_log_format", cur_pos, 17) == 0) {
+            cf->access_log_format = (val[0] != '\0') ? val : NULL;
+        }
+
+        if (strncmp("access_log_buffer_kb", cur_pos, 20) == 0) {
+            cf->access_log_buffer_kb = atoi(val);
+        }
+
+        if (strncmp("log_level", cur_pos, 9) == 0) {
+            cf->log_level = zv_log_parse_level(val);
+            if (cf->log_level < 0) {
+                log_err("unknown log_level: %s", val);
+                return ZV_CONF_ERROR;
+            }
+        }
+
+        if (strncmp("log_rate_limit", cur_pos, 14) == 0) {
+            cf->log_rate_limit = atoi(val);
+        }
+
+        if (strncmp("metrics_path", cur_pos, 12) == 0) {
+            if (val[0] == '\0') {
+                cf->metrics_path = NULL;
+            } else if (val[0] == '/') {
+                cf->metrics_path = val;
+            } else {
+                log_err("metrics_path must start with '/': %s", val);
+                return ZV_CONF_ERROR;
+            }
+        }
+
         /* alias: set both timeouts */
         if (strncmp("timeout_ms", cur_pos, 10) == 0) {
             int t = atoi(val);
@@ -14,21 +14,124 @@
 /* All timeouts use milliseconds and CLOCK_MONOTONIC internally. */
 #define ZV_DEFAULT_KEEP_ALIVE_TIMEOUT_MS 5000
 #define ZV_DEFAULT_REQUEST_TIMEOUT_MS    5000
+/* graceful stop: longest a worker waits for its open connections */
+#define ZV_DEFAULT_DRAIN_TIMEOUT_MS      10000
+#define ZV_DEFAULT_ACCESS_LOG_BUFFER_KB  256
+
+/* file bytes sent per connection per writable event before yielding (0 = unlimited) */
+#define ZV_DEFAULT_SEND_QUANTUM_KB       256
+
+/*
+ * Send-queue tuning (bytes, 0 = kernel default). The plain values apply to
+ * every accepted connection; responses with a file body of at least
+ * large_file_kb switch the socket to the large_* values.
+ */
+#define ZV_DEFAULT_LARGE_FILE_KB         1024
+#define ZV_DEFAULT_LARGE_NOTSENT_LOWAT   (128 * 1024)
+
+/*
+ * In-memory bodies (KiB, 0 = off): static files of at least mmap_threshold_kb
+ * are mmap()ed and sent from memory instead of sendfile(); memory bodies of
+ * at least zerocopy_threshold_kb go out with MSG_ZEROCOPY.
+ */
+#define ZV_DEFAULT_MMAP_THRESHOLD_KB     0
+#define ZV_DEFAULT_ZEROCOPY_THRESHOLD_KB 0
+
+/* sendfile() page-cache probe window; cold windows are read in on threadnum helper threads (0 = off) */
+#define ZV_DEFAULT_AIO_PROBE_KB          1024
+
+/*
+ * Page-cache hints for file bodies of at least large_file_kb (KiB): keep
+ * readahead_kb requested ahead of each client's send offset (0 = off), and
+ * drop already-sent pages of files larger than page_cache_budget_kb so
+ * one-off huge downloads do not evict hot small files (0 = never drop).
+ */
+#define ZV_DEFAULT_READAHEAD_KB          2048
+#define ZV_DEFAULT_PAGE_CACHE_BUDGET_KB  0
+
+/*
+ * Event loops per worker process, each a thread with its own SO_REUSEPORT
+ * listener, timers and caches; threadnum helper threads are split among them.
+ */
+#define ZV_DEFAULT_REACTOR_THREADS       1
+
+/*
+ * cpu_affinity=1: pin reactors in topology order (one thread per physical
+ * core first, alternating NUMA nodes) and prefer the local node for memory.
+ */
+
+/*
+ * reuseport_steering=1: the master opens every reactor's listener and a BPF
+ * program hands each connection to the reactor pinned (cpu_affinity) to the
+ * CPU that received it; 0 leaves the choice to the kernel's hash.
+ */
+
+/*
+ * accept_mode=reuseport: one SO_REUSEPORT listener per reactor, the kernel
+ * spreads connections. accept_mode=shared: the master opens one listener
+ * that every reactor registers with EPOLLEXCLUSIVE; a reactor holding more
+ * than accept_max_conns connections (0 = no limit) stops accepting until
+ * it drops below 7/8 of that, so new connections go to idler reactors.
+ */
+#define ZV_ACCEPT_REUSEPORT              0
+#define ZV_ACCEPT_SHARED                 1
+
+/* static file lookup results (stat + docroot check) are reused for this long; 0 = always look up */
+#define ZV_DEFAULT_FILE_CACHE_TTL_MS     1000
+
+/* event_backend=epoll|io_uring; io_uring falls back to epoll when the kernel lacks it */
+#define ZV_EVENT_BACKEND_EPOLL           0
+#define ZV_EVENT_BACKEND_IO_URING        1
+
+/*
+ * busy_poll_us>0: low-latency mode. Listeners (and the connections they
+ * accept) get SO_BUSY_POLL / SO_PREFER_BUSY_POLL, the event instance
+ * busy-polls the NIC, and a reactor re-polls with a zero timeout for up to
+ * busy_poll_us before it blocks (never past its next timer). Burns CPU
+ * while idle; 0 = off.
+ */
 
 struct zv_conf_s {
     void *root;
     int port;
     int thread_num;
+    int reactor_threads;
     int workers;
     int cpu_affinity;
+    int reuseport_steering;
+    int accept_mode;           /* ZV_ACCEPT_* */
+    int accept_max_conns;
     int keep_alive_timeout_ms; /* idle connection timeout */
     int request_timeout_ms;    /* in-flight request/response timeout */
+    int drain_timeout_ms;      /* graceful stop deadline */
+    char *metrics_path;        /* internal metrics URL answered by the workers, NULL = off */
+    char *access_log;          /* access log file, NULL = off */
+    char *access_log_format;   /* NULL = ZV_ACCESS_LOG_DEFAULT_FORMAT */
+    int access_log_buffer_kb;  /* ring size per reactor */
+    int log_level;             /* ZV_LOG_* */
+    int log_rate_limit;        /* messages per call site per second, 0 = unlimited */
+    int send_quantum_kb;       /* per-event sendfile budget, 0 = unlimited */
+    int tcp_notsent_lowat;     /* TCP_NOTSENT_LOWAT for accepted sockets */
+    int sndbuf;                /* SO_SNDBUF for accepted sockets */
+    int large_file_kb;         /* file size that selects the large_* values */
+    int large_notsent_lowat;
+    int large_sndbuf;
+    int mmap_threshold_kb;
+    int zerocopy_threshold_kb;
+    int aio_probe_kb;
+    int file_cache_ttl_ms;
+    int readahead_kb;
+    int page_cache_budget_kb;
+    int event_backend;         /* ZV_EVENT_BACKEND_* */
+    int busy_poll_us;
 };
 
 typedef struct zv_conf_s zv_conf_t;
 
 int open_listenfd_reuseport(int port);
 int make_socket_non_blocking(int fd);
+int zv_set_send_buffers(int fd, int sndbuf, int notsent_lowat);
+int zv_set_busy_poll(int fd, int usecs);
 
 int read_conf(char *filename, zv_conf_t *cf, char *buf, int len);
 #endif
@@ -11,10 +11,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #ifdef __linux__
 #include <sched.h>
 #endif
@@ -23,13 +26,20 @@
 #include "http.h"
 #include "cgi.h"
 #include "http_request_cache.h"
+#include "http_header_cache.h"
 #include "timer.h"
 #include "ep_item.h"
 #include <unistd.h>
 #include <fcntl.h>
 #include "zv_signal.h"
+#include "aio.h"
+#include "file_cache.h"
+#include "topology.h"
+#include "stats.h"
+#include "access_log.h"
+#include "zv_probes.h"
 
-extern struct epoll_event *events;
+extern __thread struct epoll_event *events;
 // 判断是否为预期的断开连接错误码
 static int is_expected_disconnect_errno(int e) {
     return (e == EPIPE || e == ECONNRESET);
@@ -44,53 +54,29 @@ static int ignore_sigpipe(void) {
     return sigaction(SIGPIPE, &sa, NULL);
 }
 
-static void maybe_set_cpu_affinity(const zv_conf_t *cf, int worker_id) {
+// slot = worker_id * reactor_threads + reactor_id，每个 reactor 线程绑一个核
+static void maybe_set_cpu_affinity(const zv_conf_t *cf, int slot) {
     if (!cf || cf->cpu_affinity == 0) {
         return;
     }
 #ifdef __linux__
-    cpu_set_t available;//  CPU 位图集合类型
-    CPU_ZERO(&available);// 初始化CPU集合，将所有位清0
-    // 获取当前进程的CPU亲和性掩码，表示允许进程运行的CPU集合
-    if (sched_getaffinity(0, sizeof(available), &available) != 0) {
-        log_warn("sched_getaffinity failed");
+    // 可用 CPU 按拓扑排好序：先每个物理核一个线程、在 NUMA 节点之间轮流，最后才用 SMT 兄弟线程
+    int *order = (int *)malloc(sizeof(int) * CPU_SETSIZE);
+    if (!order) {
+        log_warn("malloc(cpu order) failed");
         return;
     }
-
-    int cpu_count = 0;
-    int max_cpu = 0;
-#ifdef CPU_SETSIZE
-    max_cpu = CPU_SETSIZE;
-#else
-    max_cpu = (int)(8 * sizeof(cpu_set_t));
-#endif
-    // 计算可用CPU的数量
-    for (int cpu = 0; cpu < max_cpu; cpu++) {
-        if (CPU_ISSET(cpu, &available)) {
-            cpu_count++;
-        }
-    }
+    int cpu_count = zv_topology_order(order, CPU_SETSIZE);
     // 没有可用CPU
     if (cpu_count <= 0) {
         log_warn("no available CPU for affinity");
+        free(order);
         return;
     }
-    // 选择第几个可以用的CPU作为当前进程绑定的CPU
-    int pick = worker_id % cpu_count;
-    int chosen_cpu = -1;
-    for (int cpu = 0; cpu < max_cpu; cpu++) {
-        if (!CPU_ISSET(cpu, &available)) continue;
-        if (pick == 0) {
-            chosen_cpu = cpu;
-            break;
-        }
-        pick--;
-    }
-    // 未选择到CPU
-    if (chosen_cpu < 0) {
-        return;
-    }
-    // 设置当前进程的CPU亲和性掩码
+    // 选择第几个可以用的CPU作为当前线程绑定的CPU
+    int chosen_cpu = order[slot % cpu_count];
+    free(order);
+    // 设置当前线程的CPU亲和性掩码
     cpu_set_t set;
     CPU_ZERO(&set);
     CPU_SET(chosen_cpu, &set);// 将选中的CPU加入集合
@@ -98,32 +84,179 @@ static void maybe_set_cpu_affinity(const zv_conf_t *cf, int worker_id) {
         log_warn("sched_setaffinity failed (cpu=%d)", chosen_cpu);
         return;
     }
-    log_info("worker affinity set. worker_id=%d cpu=%d", worker_id, chosen_cpu);
+    // 绑核之后再分配请求池、缓存等：内存也优先放在本地节点
+    int node = zv_topology_node(chosen_cpu);
+    if (zv_topology_bind_memory(node) != 0) {
+        debug("set_mempolicy(node=%d) failed, errno=%d", node, errno);
+    }
+    log_info("reactor affinity set. slot=%d cpu=%d node=%d", slot, chosen_cpu, node);
 #else
-    (void)worker_id;
+    (void)slot;
     log_warn("cpu_affinity enabled but not supported on this platform");
 #endif
 }
 
-// worker进程的主循环
-int zv_worker_run(zv_conf_t *cf, int worker_id) {
+/*
+ * 一个 reactor：自己的 SO_REUSEPORT 监听套接字、事件实例、定时器、缓存和辅助线程池。
+ * 这些状态都是线程局部的，连接始终留在接受它的 reactor 上。
+ */
+typedef struct {
+    zv_conf_t *cf;
+    int worker_id;
+    int reactor_id;
+    int helper_threads;
+    int listenfd;       // master 按 slot 顺序创建好的监听套接字，-1 表示自己打开
+    int wake_fd;        // eventfd：主 reactor 退出时写它，叫醒阻塞在等待里的其他 reactor
+    pthread_t tid;
     int rc;
-    // 安装SIGPIPE信号忽略处理函数
-    if (ignore_sigpipe() != 0) {
-        log_err("install sigal handler for SIGPIPE failed");
-        return 1;
+} zv_reactor_t;
+
+// 忙轮询等待：先用 0 超时反复收割事件，budget_us 用完（或最近的定时器到期）仍没有事件才阻塞
+static int wait_busy_poll(int epfd, int timeout, long budget_us) {
+    struct timespec t0, now;
+    long spent_us = 0;
+    if (timeout >= 0 && (long)timeout * 1000 < budget_us) {
+        budget_us = (long)timeout * 1000;
     }
-    // 覆盖 master 进程的信号处理：保证 Ctrl+C / kill 能让 worker 退出
-    if (zv_install_worker_signals() != 0) {
-        log_err("install worker signals failed");
-        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (!zv_stop) {
+        int n = zv_epoll_wait(epfd, events, MAXEVENTS, 0);
+        if (n != 0) {
+            return n;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        spent_us = (long)(now.tv_sec - t0.tv_sec) * 1000000L + (now.tv_nsec - t0.tv_nsec) / 1000;
+        if (spent_us >= budget_us) {
+            break;
+        }
+    }
+    if (zv_stop) {
+        return 0;
     }
+    // 空转的时间从定时器超时里扣掉
+    if (timeout > 0) {
+        timeout -= (int)(spent_us / 1000);
+        if (timeout < 0) {
+            timeout = 0;
+        }
+    }
+    return zv_epoll_wait(epfd, events, MAXEVENTS, timeout);
+}
+
+// 循环接受所有到来的连接，注册到事件实例并挂上空闲超时
+static void accept_all(zv_conf_t *cf, int listenfd, int epfd) {
+    struct sockaddr_in clientaddr;
+    socklen_t inlen;
+    struct epoll_event event;
+    int infd;
+    while (1) {
+        inlen = sizeof(clientaddr);
+        // 新连接直接是非阻塞、close-on-exec 的（io_uring 后端先交出提前接受好的连接）
+        infd = zv_epoll_accept(epfd, listenfd, (struct sockaddr *)&clientaddr, &inlen);
+        if (infd < 0) {
+            //因为是非阻塞accept 所以没有连接时会返回EAGAIN或EWOULDBLOCK错误码
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                log_err("accept");
+                break;
+            }
+        }
+        // 禁用 Nagle 算法，减少延迟
+        int one = 1;
+        if (setsockopt(infd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+            log_warn("setsockopt TCP_NODELAY failed, fd=%d", infd);
+        }
+        // 限制内核发送队列：减少每连接占用的内存，EPOLLOUT 唤醒也更平滑
+        if (cf->sndbuf > 0 || cf->tcp_notsent_lowat > 0) {
+            (void)zv_set_send_buffers(infd, cf->sndbuf, cf->tcp_notsent_lowat);
+        }
+        // 为新连接分配请求结构体
+        zv_http_request_t *req = zv_http_request_get(infd, epfd, cf);
+        if (req == NULL) {
+            log_err("zv_http_request_get(infd)");
+            close(infd);
+            break;
+        }
+        if (!req->conn_item) {
+            log_err("conn_item alloc failed");
+            close(infd);
+            zv_http_request_put_deferred(req);
+            break;
+        }
+        // 读数据交给后端（io_uring 的 recv 请求）；零拷贝的完成通知要靠 EPOLLERR，这种连接照旧等可读
+        uint32_t recv_hint = ZV_EPOLLRECV;
+        if (cf->zerocopy_threshold_kb > 0) {
+            if (zv_out_chain_enable_zerocopy(&req->out, infd, (size_t)cf->zerocopy_threshold_kb * 1024) < 0) {
+                debug("SO_ZEROCOPY unavailable, fd=%d", infd);
+            } else {
+                recv_hint = 0;
+            }
+        }
+        // 将新连接套接字添加到epoll实例中，监听读事件
+        // EPOLLONESHOT表示事件触发后需要重新注册才能继续监听该事件
+        event.data.ptr = (void *)req->conn_item;
+        event.events = EPOLLIN | EPOLLET | EPOLLONESHOT | recv_hint;
+        zv_epoll_add(epfd, infd, &event);
+        zv_add_timer(req, req->keep_alive_timeout_ms, zv_http_close_conn);// idle timeout
+        ZV_STAT_INC(conns_accepted);
+        req->accept_ns = zv_now_ns();
+        ZV_PROBE2(accept, infd, req->accept_ns);
+        if (inlen >= sizeof(clientaddr)) {
+            req->remote_addr = clientaddr.sin_addr;
+        } else if (cf->access_log) {
+            // 提前接受的连接没带对端地址，只有访问日志要用
+            inlen = sizeof(clientaddr);
+            if (getpeername(infd, (struct sockaddr *)&clientaddr, &inlen) == 0) {
+                req->remote_addr = clientaddr.sin_addr;
+            }
+        }
+    }
+}
+
+// 进程内已启动的 reactor（下标 0 是主线程自己），排空/退出时用它们的 wake_fd 叫醒
+static zv_reactor_t *g_reactors;
+static int g_nreactors;
+// 新一代 worker 的就绪通知：最后一个 reactor 开始接受连接后写一个字节，master 据此让旧 worker 退场
+static int g_ready_fd = -1;
+static int g_unready;
+
+static void wake_other_reactors(void) {
+    uint64_t one = 1;
+    for (int i = 1; i < g_nreactors; i++) {
+        (void)write(g_reactors[i].wake_fd, &one, sizeof(one));
+    }
+}
+
+static void reactor_ready(void) {
+    if (__atomic_sub_fetch(&g_unready, 1, __ATOMIC_ACQ_REL) == 0 && g_ready_fd >= 0) {
+        char c = 1;
+        (void)write(g_ready_fd, &c, 1);
+        close(g_ready_fd);
+        g_ready_fd = -1;
+    }
+}
+
+static size_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_t)ts.tv_sec * 1000 + (size_t)ts.tv_nsec / 1000000;
+}
+
+// reactor 的事件循环
+static int reactor_run(zv_reactor_t *rt) {
+    zv_conf_t *cf = rt->cf;
+    int worker_id = rt->worker_id;
+    int rc;
     // 设置 CPU 亲和性
-    maybe_set_cpu_affinity(cf, worker_id);
+    maybe_set_cpu_affinity(cf, worker_id * cf->reactor_threads + rt->reactor_id);
+    // 计数写进 master 分给这个 reactor 的共享统计 slot
+    zv_stats_attach(worker_id, rt->reactor_id);
+    zv_access_log_attach(rt->reactor_id);
 
     //// 打开一个监听port的套接字，启用SO_REUSEPORT选项（用于多进程工作者）。
-    // 打开监听套接字 每个worker进程独立监听同一端口
-    int listenfd = open_listenfd_reuseport(cf->port);
+    // 打开监听套接字 每个 reactor 独立监听同一端口（开启 reuseport_steering 时由 master 预先创建）
+    int listenfd = (rt->listenfd >= 0) ? rt->listenfd : open_listenfd_reuseport(cf->port);
     if (listenfd < 0) {
         log_err("open_listenfd_reuseport failed (port=%d)", cf->port);
         return 1;
@@ -132,7 +265,8 @@ int zv_worker_run(zv_conf_t *cf, int worker_id) {
     rc = make_socket_non_blocking(listenfd);
     check(rc == 0, "make_socket_non_blocking(listenfd)");
 
-    // 创建epoll实例和分配接收事件的数组
+    // 创建事件实例（epoll 或 io_uring）和分配接收事件的数组
+    zv_event_backend_select(cf->event_backend == ZV_EVENT_BACKEND_IO_URING ? &zv_event_uring : &zv_event_epoll);
     int epfd = zv_epoll_create(0);
     struct epoll_event event;
     // 初始化监听事件数据结构
@@ -143,26 +277,129 @@ int zv_worker_run(zv_conf_t *cf, int worker_id) {
     ((zv_ep_item_t *)request->conn_item)->kind = ZV_EP_KIND_LISTEN; // 事件类型为监听事件
     ((zv_ep_item_t *)request->conn_item)->fd = listenfd;
     ((zv_ep_item_t *)request->conn_item)->r = request;
-    event.data.ptr = (void *)request->conn_item;
-    event.events = EPOLLIN | EPOLLET;
+    // shared 模式下所有 reactor 监听同一个套接字：EPOLLEXCLUSIVE 每个新连接只叫醒其中一个
+    struct epoll_event listen_ev;
+    listen_ev.data.ptr = (void *)request->conn_item;
+    listen_ev.events = EPOLLIN | EPOLLET | ZV_EPOLLACCEPT;
+    if (cf->accept_mode == ZV_ACCEPT_SHARED) {
+        listen_ev.events |= EPOLLEXCLUSIVE;
+    }
+    event = listen_ev;
     zv_epoll_add(epfd, listenfd, &event);
+    // 连接数超过 accept_max_conns 时暂停接受（只在 shared 模式有意义：reuseport 下别的 reactor 接不到这个队列里的连接）
+    int throttle = (cf->accept_mode == ZV_ACCEPT_SHARED && cf->accept_max_conns > 0);
+    size_t max_conns = (size_t)(throttle ? cf->accept_max_conns : 0);
+    size_t resume_conns = max_conns - max_conns / 8;
+    int accepting = 1;
+
+    // 低延迟模式：监听套接字的忙轮询设置会被 accept 出来的连接继承
+    if (cf->busy_poll_us > 0) {
+        if (zv_set_busy_poll(listenfd, cf->busy_poll_us) != 0) {
+            log_warn("SO_BUSY_POLL/SO_PREFER_BUSY_POLL failed, errno=%d", errno);
+        }
+        if (zv_epoll_busy_poll(epfd, cf->busy_poll_us) != 0) {
+            log_warn("%s busy poll unsupported, errno=%d; spinning in user space only", zv_event_backend_name(), errno);
+        }
+    }
+
+    zv_ep_item_t wake_item;
+    if (rt->wake_fd >= 0) {
+        wake_item.kind = ZV_EP_KIND_WAKE;
+        wake_item.fd = rt->wake_fd;
+        wake_item.r = NULL;
+        event.data.ptr = (void *)&wake_item;
+        event.events = EPOLLIN | EPOLLET;
+        zv_epoll_add(epfd, rt->wake_fd, &event);
+    }
+
+    // 辅助线程池：冷文件读入等阻塞工作，完成后经 eventfd 回到事件循环
+    if (zv_aio_init(epfd, rt->helper_threads) < 0) {
+        log_warn("aio helper threads unavailable, cold files are sent inline");
+    }
 
     // 初始化定时器模块
     zv_timer_init();
-    log_info("zaver worker started. worker_id=%d pid=%d", worker_id, getpid());
+    zv_file_cache_init(cf->file_cache_ttl_ms > 0 ? (size_t)cf->file_cache_ttl_ms : 0);
+    log_info("zaver reactor started. worker_id=%d reactor=%d pid=%d backend=%s", worker_id, rt->reactor_id, getpid(), zv_event_backend_name());
+    reactor_ready();
 
     int n;
     int i, fd;
     int time;
-    //初始化接收客户端信息结构体
-    struct sockaddr_in clientaddr;
-    socklen_t inlen = sizeof(struct sockaddr_in);
-    memset(&clientaddr, 0, sizeof(struct sockaddr_in));
+    // 排空：不再接受新连接，已有连接处理完（或到期限）后退出
+    int draining = 0;
+    size_t drain_deadline = 0;
+    // 有被限流的日志欠着汇总时，最多睡 1 秒就回来补上
+    int log_owed = 0;
     // 进入主循环
     while (!zv_stop) 
     {
+        if (zv_quit && !draining) {
+            draining = 1;
+            drain_deadline = now_ms() + (size_t)(cf->drain_timeout_ms > 0 ? cf->drain_timeout_ms : 0);
+            if (rt->reactor_id == 0) {
+                wake_other_reactors();
+            }
+            if (accepting) {
+                event = listen_ev;
+                zv_epoll_del(epfd, listenfd, &event);
+                accepting = 0;
+            }
+            // 在两个 keep-alive 请求之间空等的连接直接关掉；在途的响应发完后带 Connection: close 关闭
+            int idle = zv_expire_timers_if(zv_http_request_idle);
+            // 关闭前把已经排进队列的连接接走，否则关闭自己的 reuseport 监听套接字会把它们重置
+            accept_all(cf, listenfd, epfd);
+            zv_http_request_put(request);
+            request = NULL;
+            close(listenfd);
+            listenfd = -1;
+            log_info("reactor draining. worker_id=%d reactor=%d idle_closed=%d conns=%zu", worker_id, rt->reactor_id, idle, zv_http_request_in_use());
+            (void)idle;
+        }
+        if (draining) {
+            size_t now = now_ms();
+            if (zv_http_request_in_use() == 0) {
+                break;
+            }
+            if (now >= drain_deadline) {
+                log_warn("drain deadline reached, closing %zu connections", zv_http_request_in_use());
+                break;
+            }
+        }
+        if (throttle && !draining) {
+            // 在用的请求块里有一个是监听套接字自己的（request），不算连接
+            size_t conns = zv_http_request_in_use() - (request != NULL);
+            // EPOLLEXCLUSIVE 不能 MOD，只能摘掉再重新挂上；重新挂上时如果队列里已有连接会立即就绪
+            if (accepting && conns >= max_conns) {
+                event = listen_ev;
+                zv_epoll_del(epfd, listenfd, &event);
+                accepting = 0;
+                debug("accept paused, conns=%zu", conns);
+            } else if (!accepting && conns <= resume_conns) {
+                event = listen_ev;
+                zv_epoll_add(epfd, listenfd, &event);
+                accepting = 1;
+                debug("accept resumed, conns=%zu", conns);
+            }
+        }
         time = zv_find_timer();// 获取最近的定时器超时时间
-        n = zv_epoll_wait(epfd, events, MAXEVENTS, time);//用最近的定时器超时时间作为epoll_wait的超时时间
+        if (log_owed && (time < 0 || time > 1000)) {
+            time = 1000;
+        }
+        if (draining) {
+            int left = (int)(drain_deadline - now_ms());
+            if (left < 0) {
+                left = 0;
+            }
+            if (time < 0 || time > left) {
+                time = left;
+            }
+        }
+        if (cf->busy_poll_us > 0 && time != 0) {
+            n = wait_busy_poll(epfd, time, cf->busy_poll_us);
+        } else {
+            n = zv_epoll_wait(epfd, events, MAXEVENTS, time);//用最近的定时器超时时间作为epoll_wait的超时时间
+        }
         // 处理就绪事件
         for (i = 0; i < n; i++) 
         {
@@ -173,67 +410,47 @@ int zv_worker_run(zv_conf_t *cf, int worker_id) {
             fd = it->fd;
 
             if (it->kind == ZV_EP_KIND_LISTEN) {
-                int infd;
-                while (1) {//循环接受所有到来的连接
-                    infd = accept(listenfd, (struct sockaddr *)&clientaddr, &inlen);
-                    if (infd < 0) {
-                        //因为是非阻塞accept 所以没有连接时会返回EAGAIN或EWOULDBLOCK错误码
-                        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
-                            break;
-                        } else {
-                            log_err("accept");
-                            break;
-                        }
-                    }
-                    // 设置新连接套接字为非阻塞模式
-                    rc = make_socket_non_blocking(infd);
-                    check(rc == 0, "make_socket_non_blocking(infd)");
-
-                    // 禁用 Nagle 算法，减少延迟
-                    int one = 1;
-                    if (setsockopt(infd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
-                        log_warn("setsockopt TCP_NODELAY failed, fd=%d", infd);
-                    }
-                    // 为新连接分配请求结构体
-                    zv_http_request_t *req = zv_http_request_get(infd, epfd, cf);
-                    if (req == NULL) {
-                        log_err("zv_http_request_get(infd)");
-                        close(infd);
-                        break;
-                    }
-                    if (!req->conn_item) {
-                        log_err("conn_item alloc failed");
-                        close(infd);
-                        zv_http_request_put_deferred(req);
-                        break;
-                    }
-                    // 将新连接套接字添加到epoll实例中，监听读事件
-                    // EPOLLONESHOT表示事件触发后需要重新注册才能继续监听该事件
-                    event.data.ptr = (void *)req->conn_item;
-                    event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
-                    zv_epoll_add(epfd, infd, &event);
-                    zv_add_timer(req, req->keep_alive_timeout_ms, zv_http_close_conn);// idle timeout
-                }
+                accept_all(cf, listenfd, epfd);
             } else if (it->kind == ZV_EP_KIND_CGI_OUT) {
                 if (!r) continue;
                 /* CGI stdout is readable (or closed/error) */
                 zv_cgi_on_stdout_ready(r);
                 continue;
+            } else if (it->kind == ZV_EP_KIND_AIO) {
+                zv_aio_on_event();
+                continue;
+            } else if (it->kind == ZV_EP_KIND_WAKE) {
+                // 只用来打断等待，循环条件会重新检查 zv_stop
+                uint64_t v;
+                (void)read(fd, &v, sizeof(v));
+                continue;
             } else if (it->kind == ZV_EP_KIND_CGI_IN) {
                 /* GET-only MVP: not used */
                 continue;
             } else // 处理已连接套接字的事件
             {
                 uint32_t ev = events[i].events;
+                // 套接字错误，-1 = 还没读过 SO_ERROR（读一次就清零了，不能再读第二次）
+                int sock_err = -1;
+                // 零拷贝完成通知也走错误队列触发 EPOLLERR：收割后连接照常处理
+                if ((ev & EPOLLERR) && r && zv_out_chain_zc_pending(&r->out)) {
+                    if (zv_http_on_errqueue(r, ev) == 0) {
+                        continue;
+                    }
+                    sock_err = errno;
+                }
                 // 处理错误事件
                 if (ev & EPOLLERR) {
-                    int so_error = 0;
-                    socklen_t so_error_len = sizeof(so_error);
-                    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &so_error_len) == 0 && so_error != 0) {
-                        errno = so_error;
-                    } else {
-                        errno = 0;
+                    if (sock_err < 0) {
+                        int so_error = 0;
+                        socklen_t so_error_len = sizeof(so_error);
+                        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &so_error_len) == 0) {
+                            sock_err = so_error;
+                        } else {
+                            sock_err = 0;
+                        }
                     }
+                    errno = sock_err;
 
                     if (errno == 0 || is_expected_disconnect_errno(errno)) {
                         debug("epoll peer disconnect fd: %d, events=0x%x, errno=%d", r->fd, ev, errno);
@@ -270,21 +487,147 @@ int zv_worker_run(zv_conf_t *cf, int worker_id) {
 
         /* Safe point: now it is ok to return closed requests to freelist. */
         zv_http_request_deferred_flush();
+        // 这一轮攒下的日志一次写出，再去等下一批事件
+        log_owed = zv_log_flush();
     }
 
-    // best-effort cleanup
+    // best-effort cleanup：状态是线程局部的，reactor 线程退出前要把剩下的连接和缓存都释放掉
     if (request) {
         zv_http_request_put(request);
         request = NULL;
     }
 
+    zv_expire_all_timers();
+    zv_aio_shutdown();
     zv_http_request_cache_dump_stats();
-    close(listenfd);
-    close(epfd);
-    if (events) {
-        free(events);
-        events = NULL;
+    zv_out_chain_dump_stats();
+    zv_http_request_cache_release();
+    zv_http_header_cache_release();
+    zv_out_chain_release_cache();
+    zv_file_cache_release();
+    if (listenfd >= 0) {
+        close(listenfd);
     }
+    zv_epoll_destroy(epfd);
 
     return 0;
 }
+
+// reactor 线程的日志先攒在线程缓冲里，每轮循环末尾写一次
+static int reactor_run_buffered(zv_reactor_t *rt) {
+    zv_log_buffered(1);
+    int rc = reactor_run(rt);
+    zv_log_buffered(0);
+    return rc;
+}
+
+static void *reactor_thread(void *arg) {
+    zv_reactor_t *rt = (zv_reactor_t *)arg;
+    rt->rc = reactor_run_buffered(rt);
+    return NULL;
+}
+
+// worker进程的主循环
+int zv_worker_run(zv_conf_t *cf, int worker_id, const int *listen_fds, int ready_fd) {
+    // 安装SIGPIPE信号忽略处理函数
+    if (ignore_sigpipe() != 0) {
+        log_err("install sigal handler for SIGPIPE failed");
+        return 1;
+    }
+    // 重载出来的新一代按新配置的日志级别
+    zv_log_configure(cf->log_level, cf->log_rate_limit);
+    // 覆盖 master 进程的信号处理：保证 Ctrl+C / kill 能让 worker 退出
+    if (zv_install_worker_signals() != 0) {
+        log_err("install worker signals failed");
+        return 1;
+    }
+
+    int n = cf->reactor_threads > 0 ? cf->reactor_threads : 1;
+    // threadnum 是整个 worker 的辅助线程数，平分给各个 reactor
+    int helpers = (cf->thread_num + n - 1) / n;
+    if (helpers < 1) {
+        helpers = 1;
+    }
+
+    zv_reactor_t *rts = (zv_reactor_t *)calloc((size_t)n, sizeof(zv_reactor_t));
+    if (!rts) {
+        log_err("calloc(reactors) failed");
+        return 1;
+    }
+    int i;
+    for (i = 0; i < n; i++) {
+        rts[i].cf = cf;
+        rts[i].worker_id = worker_id;
+        rts[i].reactor_id = i;
+        rts[i].helper_threads = helpers;
+        rts[i].listenfd = listen_fds ? listen_fds[i] : -1;
+        rts[i].wake_fd = (n > 1) ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1;
+        if (n > 1 && rts[i].wake_fd < 0) {
+            log_err("eventfd(reactor wake) failed");
+            n = i;
+            break;
+        }
+    }
+
+    // 访问日志的写线程和每个 reactor 的环要在 reactor 启动前就绪
+    if (zv_access_log_start(cf, worker_id, n) != 0) {
+        for (i = 0; i < n; i++) {
+            if (rts[i].wake_fd >= 0) {
+                close(rts[i].wake_fd);
+            }
+        }
+        free(rts);
+        return 1;
+    }
+
+    g_ready_fd = ready_fd;
+    g_unready = n;
+
+    // 额外的 reactor 线程屏蔽停止信号，让信号总是打断主线程（reactor 0）的等待，再由它叫醒其他 reactor
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int started = 1;
+    for (i = 1; i < n; i++) {
+        if (pthread_create(&rts[i].tid, NULL, reactor_thread, &rts[i]) != 0) {
+            log_err("pthread_create(reactor %d) failed", i);
+            break;
+        }
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    // 没起来的 reactor 不会报就绪，从计数里扣掉；已起来的可能已经在减了，所以不能直接赋值。
+    // reactor 0 还没开始跑，减完至少剩 1，就绪字节仍由最后一个报就绪的 reactor 写
+    if (started < n) {
+        __atomic_sub_fetch(&g_unready, n - started, __ATOMIC_ACQ_REL);
+    }
+
+    g_reactors = rts;
+    g_nreactors = started;
+
+    int rc = (n > 0) ? reactor_run_buffered(&rts[0]) : 1;
+
+    // 排空时其他 reactor 各自等自己的连接处理完再退出，不强行叫停（排空中又收到 SIGINT 除外）
+    if (!zv_quit || zv_stop) {
+        zv_stop = 1;
+        wake_other_reactors();
+    }
+    for (i = 1; i < started; i++) {
+        pthread_join(rts[i].tid, NULL);
+        rc |= rts[i].rc;
+    }
+    for (i = 0; i < n; i++) {
+        if (rts[i].wake_fd >= 0) {
+            close(rts[i].wake_fd);
+        }
+    }
+    g_nreactors = 0;
+    g_reactors = NULL;
+    free(rts);
+    // reactor 都退出了：把环里剩下的条目写完
+    zv_access_log_stop();
+    return rc;
+}
@@ -7,6 +7,11 @@
 
 #include "util.h"
 
-int zv_worker_run(zv_conf_t *cf, int worker_id);
+/*
+ * listen_fds: one inherited listener per reactor, or NULL to open them here.
+ * ready_fd: a byte is written there once every reactor accepts (-1 = none).
+ * SIGQUIT drains: stop accepting, exit when the open connections are done.
+ */
+int zv_worker_run(zv_conf_t *cf, int worker_id, const int *listen_fds, int ready_fd);
 
 #endif
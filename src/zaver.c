@@ -70,13 +70,16 @@ int main(int argc, char* argv[])
         log_err("read conf err: %s", conf_file);
         return 1;
     }
+    zv_log_configure(cf.log_level, cf.log_rate_limit);
 
-    log_status("zaver started. port=%d workers=%d cpu_affinity=%d keep_alive_timeout_ms=%d request_timeout_ms=%d",
+    log_status("zaver started. port=%d workers=%d reactor_threads=%d cpu_affinity=%d keep_alive_timeout_ms=%d request_timeout_ms=%d send_quantum_kb=%d",
                cf.port,
                cf.workers,
+               cf.reactor_threads,
                cf.cpu_affinity,
                cf.keep_alive_timeout_ms,
-               cf.request_timeout_ms);
+               cf.request_timeout_ms,
+               cf.send_quantum_kb);
     //运行服务器
-    return zv_run_server(&cf);
+    return zv_run_server(&cf, conf_file, argv);
 }
@@ -0,0 +1,195 @@
+/*
+ * Leveled, rate-limited, buffered logging (see zv_log.h).
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "zv_log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+int zv_log_level = ZV_LOG_DEBUG;
+int zv_log_rate = ZV_LOG_DEFAULT_RATE;
+
+static __thread int g_buffered;
+static __thread char g_buf[ZV_LOG_BUF_SIZE];
+static __thread size_t g_len;
+// 本线程里欠着一条“已抑制 N 条”汇总的调用点
+static __thread zv_log_site_t *g_pending;
+
+static const char *level_tag(int level) {
+    switch (level) {
+    case ZV_LOG_ERR:
+        return "[ERROR]";
+    case ZV_LOG_WARN:
+        return "[WARN]";
+    case ZV_LOG_NOTICE:
+        return "[STATUS]";
+    case ZV_LOG_INFO:
+        return "[INFO]";
+    default:
+        return "DEBUG";
+    }
+}
+
+static uint32_t now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)ts.tv_sec;
+}
+
+// 一次 write 写完整行（多行），stderr 上几个线程/进程的行不会互相穿插
+static void write_all(const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDERR_FILENO, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+static void output(const char *line, size_t len) {
+    if (!g_buffered) {
+        write_all(line, len);
+        return;
+    }
+    if (g_len + len > sizeof(g_buf)) {
+        write_all(g_buf, g_len);
+        g_len = 0;
+    }
+    memcpy(g_buf + g_len, line, len);
+    g_len += len;
+}
+
+static void summary(zv_log_site_t *site) {
+    char line[256];
+    int n = snprintf(line, sizeof(line), "%s (%s:%d) %u similar messages suppressed\n",
+                     level_tag(site->level), site->file, site->line, site->suppressed);
+    if (n > 0) {
+        output(line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+    site->suppressed = 0;
+}
+
+int zv_log_admit(zv_log_site_t *site, int level, const char *file, int line) {
+    if (zv_log_rate <= 0) {
+        return 1;
+    }
+    uint32_t now = now_sec();
+    if (site->window != now) {
+        if (site->suppressed) {
+            summary(site);
+        }
+        site->window = now;
+        site->count = 0;
+    }
+    if (site->count < (uint32_t)zv_log_rate) {
+        site->count++;
+        return 1;
+    }
+    // 超出预算：只计数，不格式化、不取 strerror
+    if (site->suppressed++ == 0 && !site->pending) {
+        site->level = level;
+        site->file = file;
+        site->line = line;
+        site->pending = 1;
+        site->next = g_pending;
+        g_pending = site;
+    }
+    return 0;
+}
+
+void zv_log_emit(int level, const char *file, int line, int err, const char *fmt, ...) {
+    char buf[ZV_LOG_LINE_MAX];
+    char ebuf[128];
+    int n;
+    va_list ap;
+    if (level <= ZV_LOG_WARN) {
+        const char *es = (err == 0) ? "None" : strerror_r(err, ebuf, sizeof(ebuf));
+        n = snprintf(buf, sizeof(buf), "%s (%s:%d: errno: %s) ", level_tag(level), file, line, es);
+    } else if (level == ZV_LOG_DEBUG) {
+        n = snprintf(buf, sizeof(buf), "DEBUG %s:%d: ", file, line);
+    } else {
+        n = snprintf(buf, sizeof(buf), "%s (%s:%d) ", level_tag(level), file, line);
+    }
+    size_t len = (n > 0) ? (size_t)n : 0;
+    if (len >= sizeof(buf) - 1) {
+        len = sizeof(buf) - 2;
+    }
+    va_start(ap, fmt);
+    n = vsnprintf(buf + len, sizeof(buf) - 1 - len, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        len += ((size_t)n < sizeof(buf) - 1 - len) ? (size_t)n : sizeof(buf) - 2 - len;
+    }
+    buf[len++] = '\n';
+    output(buf, len);
+}
+
+int zv_log_parse_level(const char *name) {
+    static const struct {
+        const char *name;
+        int level;
+    } names[] = {
+        {"error", ZV_LOG_ERR}, {"err", ZV_LOG_ERR}, {"warn", ZV_LOG_WARN}, {"warning", ZV_LOG_WARN},
+        {"notice", ZV_LOG_NOTICE}, {"status", ZV_LOG_NOTICE}, {"info", ZV_LOG_INFO}, {"debug", ZV_LOG_DEBUG},
+    };
+    size_t i;
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(name, names[i].name) == 0) {
+            return names[i].level;
+        }
+    }
+    return -1;
+}
+
+void zv_log_configure(int level, int rate) {
+    zv_log_level = level;
+    zv_log_rate = rate;
+}
+
+void zv_log_buffered(int on) {
+    if (!on) {
+        (void)zv_log_flush();
+    }
+    g_buffered = on;
+}
+
+int zv_log_flush(void) {
+    if (g_pending) {
+        uint32_t now = now_sec();
+        zv_log_site_t **pp = &g_pending;
+        while (*pp) {
+            zv_log_site_t *s = *pp;
+            if (s->suppressed && s->window != now) {
+                summary(s);
+                // 新的一秒从零开始计
+                s->window = now;
+                s->count = 0;
+            }
+            if (s->suppressed == 0) {
+                s->pending = 0;
+                *pp = s->next;
+                s->next = NULL;
+            } else {
+                pp = &s->next;
+            }
+        }
+    }
+    if (g_len > 0) {
+        write_all(g_buf, g_len);
+        g_len = 0;
+    }
+    return g_pending != NULL;
+}
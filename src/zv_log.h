@@ -0,0 +1,70 @@
+/*
+ * Leveled, rate-limited, buffered logging behind the dbg.h macros.
+ *
+ * Every call site has its own thread-local budget of zv_log_rate messages
+ * per second; past it, messages are counted but not formatted, and one
+ * "N similar messages suppressed" line follows once the second is over.
+ * Threads that called zv_log_buffered(1) (the reactors) collect lines in a
+ * thread-local buffer written out by zv_log_flush() once per loop; other
+ * threads write every line with a single write(2).
+ */
+
+#ifndef ZV_LOG_H
+#define ZV_LOG_H
+
+#include <errno.h>
+#include <stdint.h>
+
+#define ZV_LOG_ERR      1
+#define ZV_LOG_WARN     2
+#define ZV_LOG_NOTICE   3   /* log_status */
+#define ZV_LOG_INFO     4
+#define ZV_LOG_DEBUG    5
+
+#define ZV_LOG_DEFAULT_RATE 10      /* messages per call site per second */
+#define ZV_LOG_LINE_MAX     2048    /* longer messages are truncated */
+#define ZV_LOG_BUF_SIZE     8192    /* per buffered thread */
+
+typedef struct zv_log_site_s {
+    uint32_t window;                /* second the counts belong to */
+    uint32_t count;
+    uint32_t suppressed;
+    int pending;                    /* on the thread's list of sites owing a summary */
+    int level;
+    int line;
+    const char *file;
+    struct zv_log_site_s *next;
+} zv_log_site_t;
+
+extern int zv_log_level;            /* messages above this level are skipped */
+extern int zv_log_rate;             /* 0 = no rate limit */
+
+#define zv_log_at(lvl, M, ...) do { \
+    if ((lvl) <= zv_log_level) { \
+        static __thread zv_log_site_t zv_log_site_; \
+        int zv_log_errno_ = errno; \
+        if (zv_log_admit(&zv_log_site_, (lvl), __FILE__, __LINE__)) { \
+            zv_log_emit((lvl), __FILE__, __LINE__, zv_log_errno_, M, ##__VA_ARGS__); \
+        } \
+        errno = zv_log_errno_; \
+    } \
+} while (0)
+
+/* 1: format and write this message; 0: over the site's budget (counted). */
+int zv_log_admit(zv_log_site_t *site, int level, const char *file, int line);
+void zv_log_emit(int level, const char *file, int line, int err, const char *fmt, ...)
+    __attribute__((format(printf, 5, 6)));
+
+/* Level from its name (error, warn, notice, info, debug). return: -1 if unknown */
+int zv_log_parse_level(const char *name);
+void zv_log_configure(int level, int rate);
+/* Calling thread: keep lines in its buffer until zv_log_flush() (on) or write each one (off, flushes). */
+void zv_log_buffered(int on);
+/*
+ * Write the calling thread's buffer and the summaries of sites whose
+ * second is over. return: 1 while summaries are still owed (call again
+ * within a second), 0 otherwise
+ */
+int zv_log_flush(void);
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * Is-enabled semaphores of the USDT probes (see zv_probes.h). Tracers find
+ * them through the stapsdt notes and increment them while attached.
+ */
+
+#include "zv_probes.h"
+
+#ifdef ZV_HAVE_PROBES
+
+#define ZV_PROBE_SEMAPHORE(name) \
+    volatile unsigned short zaver_##name##_semaphore __attribute__((used, section(".probes")));
+ZV_PROBE_LIST(ZV_PROBE_SEMAPHORE)
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Static USDT probes (provider "zaver") along the request lifecycle, in the
+ * systemtap sys/sdt.h format: every site is a nop plus a .note.stapsdt
+ * record that bpftrace, perf and systemtap read from the binary, so no
+ * header or library is needed at build or run time. Each probe has an
+ * is-enabled semaphore the tracer bumps while attached; until then a site
+ * costs one load and a not-taken branch, and its arguments (timestamps
+ * included) are not even computed.
+ *
+ * All arguments are 64-bit signed. Timestamps are CLOCK_MONOTONIC ns,
+ * the same clock as bpftrace's nsecs; elapsed values are ns.
+ *
+ *   accept(fd, accept_ns)
+ *   request_line(fd, start_ns, elapsed_ns)     start: first byte of the request read
+ *   headers(fd, start_ns, elapsed_ns)
+ *   response(fd, status, start_ns, elapsed_ns) response queued
+ *   first_byte(fd, status, start_ns, elapsed_ns)
+ *   response_done(fd, status, start_ns, elapsed_ns)
+ *   timeout(fd, start_ns)                      start_ns 0: idle connection
+ *   close(fd, start_ns)                        start_ns 0: no request in flight
+ *
+ * e.g. bpftrace -e 'usdt:./zaver:zaver:response_done { @[arg1] = hist(arg3 / 1000); }'
+ *
+ * Build with -DZV_NO_PROBES (or on other architectures) to leave no trace.
+ */
+
+#ifndef ZV_PROBES_H
+#define ZV_PROBES_H
+
+#include <stdint.h>
+
+#if !defined(ZV_NO_PROBES) && (defined(__x86_64__) || defined(__aarch64__))
+#define ZV_HAVE_PROBES 1
+#endif
+
+#define ZV_PROBE_LIST(X) \
+    X(accept) X(request_line) X(headers) X(response) \
+    X(first_byte) X(response_done) X(timeout) X(close)
+
+#ifdef ZV_HAVE_PROBES
+
+#define ZV_PROBE_SEMAPHORE_DECL(name) extern volatile unsigned short zaver_##name##_semaphore;
+ZV_PROBE_LIST(ZV_PROBE_SEMAPHORE_DECL)
+#undef ZV_PROBE_SEMAPHORE_DECL
+
+#define ZV_PROBE_ENABLED(name) __builtin_expect(zaver_##name##_semaphore != 0, 0)
+
+/* One stapsdt v3 note: pc, base, semaphore, provider, name, argument spec. */
+#define ZV_PROBE_ASM_(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte zaver_" #name "_semaphore\n" \
+    ".asciz \"zaver\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define ZV_PROBE2(name, x1, x2) do { \
+    if (ZV_PROBE_ENABLED(name)) { \
+        __asm__ __volatile__(ZV_PROBE_ASM_(name, "-8@%[a1] -8@%[a2]") \
+            :: [a1] "nor" ((int64_t)(x1)), [a2] "nor" ((int64_t)(x2))); \
+    } \
+} while (0)
+
+#define ZV_PROBE3(name, x1, x2, x3) do { \
+    if (ZV_PROBE_ENABLED(name)) { \
+        __asm__ __volatile__(ZV_PROBE_ASM_(name, "-8@%[a1] -8@%[a2] -8@%[a3]") \
+            :: [a1] "nor" ((int64_t)(x1)), [a2] "nor" ((int64_t)(x2)), [a3] "nor" ((int64_t)(x3))); \
+    } \
+} while (0)
+
+#define ZV_PROBE4(name, x1, x2, x3, x4) do { \
+    if (ZV_PROBE_ENABLED(name)) { \
+        __asm__ __volatile__(ZV_PROBE_ASM_(name, "-8@%[a1] -8@%[a2] -8@%[a3] -8@%[a4]") \
+            :: [a1] "nor" ((int64_t)(x1)), [a2] "nor" ((int64_t)(x2)), \
+               [a3] "nor" ((int64_t)(x3)), [a4] "nor" ((int64_t)(x4))); \
+    } \
+} while (0)
+
+#else
+
+#define ZV_PROBE_ENABLED(name) 0
+#define ZV_PROBE2(name, x1, x2) do { if (0) { (void)(x1); (void)(x2); } } while (0)
+#define ZV_PROBE3(name, x1, x2, x3) do { if (0) { (void)(x1); (void)(x2); (void)(x3); } } while (0)
+#define ZV_PROBE4(name, x1, x2, x3, x4) do { \
+    if (0) { (void)(x1); (void)(x2); (void)(x3); (void)(x4); } \
+} while (0)
+
+#endif
+
+#endif
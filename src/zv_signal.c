@@ -7,28 +7,65 @@
 #include <string.h>
 
 volatile sig_atomic_t zv_stop = 0;
-// SIGTERM 和 SIGINT 信号处理函数 设置停止标志
+volatile sig_atomic_t zv_quit = 0;
+volatile sig_atomic_t zv_reload = 0;
+volatile sig_atomic_t zv_upgrade = 0;
+volatile sig_atomic_t zv_report = 0;
+// SIGTERM 和 SIGINT 信号处理函数 设置停止标志（记下是哪个信号，master 原样转发给 worker）
 static void on_term(int signo) {
+    zv_stop = signo;
+}
+// SIGQUIT，以及 worker 上的 SIGTERM：排空后退出
+static void on_quit(int signo) {
+    (void)signo;
+    zv_quit = 1;
+}
+// SIGHUP：master 重新读取配置
+static void on_hup(int signo) {
+    (void)signo;
+    zv_reload = 1;
+}
+// SIGUSR2：master 换成磁盘上的新二进制
+static void on_usr2(int signo) {
     (void)signo;
-    zv_stop = 1;
+    zv_upgrade = 1;
 }
-//处理 SIGTERM 和 SIGINT 信号的通用安装函数
-static int install_common(void) {
+// SIGCHLD：master 只用它打断等待（回收在主循环里做）
+static void on_chld(int signo) {
+    (void)signo;
+}
+// SIGUSR1：master 输出各 worker 汇总的统计
+static void on_usr1(int signo) {
+    (void)signo;
+    zv_report = 1;
+}
+static int install_handler(int signo, void (*handler)(int)) {
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = on_term;
+    sa.sa_handler = handler;
     sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-
-    if (sigaction(SIGTERM, &sa, NULL) != 0) return -1;
-    if (sigaction(SIGINT, &sa, NULL) != 0) return -1;
-    return 0;
+    sa.sa_flags = 0;//不设 SA_RESTART：让 waitpid/epoll_wait 被打断，及时检查标志
+    return sigaction(signo, &sa, NULL);
 }
 // 安装 master 进程的信号处理函数
 int zv_install_master_signals(void) {
-    return install_common();
+    if (install_handler(SIGTERM, on_term) != 0) return -1;
+    if (install_handler(SIGINT, on_term) != 0) return -1;
+    if (install_handler(SIGUSR2, on_usr2) != 0) return -1;
+    if (install_handler(SIGUSR1, on_usr1) != 0) return -1;
+    if (install_handler(SIGCHLD, on_chld) != 0) return -1;
+    return install_handler(SIGHUP, on_hup);
 }
 // 安装 worker 进程的信号处理函数
 int zv_install_worker_signals(void) {
-    return install_common();
+    // SIGTERM 平滑停止（不再接新连接，处理完手上的再退出），SIGINT 立即停止
+    if (install_handler(SIGTERM, on_quit) != 0) return -1;
+    if (install_handler(SIGINT, on_term) != 0) return -1;
+    // 重载、升级和统计输出由 master 处理：worker（包括单进程模式）忽略 SIGHUP/SIGUSR2/SIGUSR1
+    if (install_handler(SIGHUP, SIG_IGN) != 0) return -1;
+    if (install_handler(SIGUSR2, SIG_IGN) != 0) return -1;
+    if (install_handler(SIGUSR1, SIG_IGN) != 0) return -1;
+    // 从 master fork 出来的 worker 不需要 master 的 SIGCHLD 处理（CGI 子进程的退出不该打断 epoll_wait）
+    if (install_handler(SIGCHLD, SIG_DFL) != 0) return -1;
+    return install_handler(SIGQUIT, on_quit);
 }
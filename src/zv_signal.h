@@ -7,7 +7,11 @@
 
 #include <signal.h>
 
-extern volatile sig_atomic_t zv_stop;
+extern volatile sig_atomic_t zv_stop;      /* nonzero: stop now (the signal number on the master) */
+extern volatile sig_atomic_t zv_quit;      /* worker: SIGTERM/SIGQUIT, drain and exit */
+extern volatile sig_atomic_t zv_reload;    /* master: SIGHUP, reload the config */
+extern volatile sig_atomic_t zv_upgrade;   /* master: SIGUSR2, exec the new binary */
+extern volatile sig_atomic_t zv_report;    /* master: SIGUSR1, log the live stats */
 
 int zv_install_master_signals(void);
 int zv_install_worker_signals(void);
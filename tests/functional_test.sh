@@ -12,14 +12,25 @@ echo "=== Starting Functional Test ==="
 ROOT_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
 cd "$ROOT_DIR"
 
-LOG_FILE="${ROOT_DIR}/tests/functional_test.server.log"
+# 日志和临时文件都放在临时目录里，测试失败时保留；LOG_FILE 可以从外面指定
+WORK_DIR=$(mktemp -d "${TMPDIR:-/tmp}/zaver_functional.XXXXXX")
+LOG_FILE="${LOG_FILE:-$WORK_DIR/server.log}"
+# 测试用的配置：zaver.conf 再打开访问日志
+RUN_CONF="$WORK_DIR/zaver.conf"
+ACCESS_LOG="$WORK_DIR/access.log"
 
 cleanup() {
+    local rc=$?
     if [[ -n "${SERVER_PID:-}" ]]; then
         # Kill the whole process group (master + workers)
         kill -TERM -- "-${SERVER_PID}" 2>/dev/null || true
         wait "${SERVER_PID}" 2>/dev/null || true
     fi
+    if [[ "$rc" -eq 0 ]]; then
+        rm -rf "$WORK_DIR"
+    else
+        echo "Server log and scratch files kept in $WORK_DIR"
+    fi
 }
 
 trap cleanup EXIT INT TERM
@@ -84,9 +95,11 @@ fi
 echo "Found server binary at: $BIN_PATH"
 
 # 2. 启动服务器
-rm -f "$LOG_FILE"
+rm -f "$LOG_FILE" "$ACCESS_LOG"
+# 指标端点默认关闭，这里打开测试
+{ sed -e '$a\' "$CONF_PATH"; echo "access_log=$ACCESS_LOG"; echo "metrics_path=/__zaver/metrics"; } >"$RUN_CONF"
 ensure_port_free
-setsid "$BIN_PATH" -c "$CONF_PATH" >"$LOG_FILE" 2>&1 &
+setsid "$BIN_PATH" -c "$RUN_CONF" >"$LOG_FILE" 2>&1 &
 SERVER_PID=$!
 echo "Server started with PID $SERVER_PID"
 
@@ -141,7 +154,7 @@ if [[ "$HTTP_CODE" -ne 200 ]]; then
     echo -e "${RED}FAILED: expected 200, got $HTTP_CODE${NC}"
     RESULT=1
 else
-    if ! printf "%s" "$CGI_BODY" | grep -q "hello cgi"; then
+    if ! grep -q "hello cgi" <<<"$CGI_BODY"; then
         echo -e "${RED}FAILED: CGI body missing expected text${NC}"
         echo "--- CGI body ---"
         printf "%s\n" "$CGI_BODY"
@@ -166,7 +179,7 @@ fi
 
 # 4.5 安全回归：软链接逃逸应被拒绝（403）
 DOCROOT="$ROOT_DIR/html"
-OUTSIDE_DIR="$ROOT_DIR/tests/_tmp_outside"
+OUTSIDE_DIR="$WORK_DIR/outside"
 LINK_NAME="$DOCROOT/__ci_symlink_escape__.txt"
 
 mkdir -p "$OUTSIDE_DIR"
@@ -184,6 +197,282 @@ if [[ "$HTTP_CODE" != "403" ]]; then
     RESULT=1
 fi
 
+# 4.6 进程监督：多 worker 模式下杀掉一个 worker，master 应重启它并继续服务
+WORKER_PIDS=$(pgrep -P "$SERVER_PID" 2>/dev/null || true)
+WORKER_COUNT=$(echo "$WORKER_PIDS" | grep -c . || true)
+if [[ "$WORKER_COUNT" -gt 1 ]]; then
+    VICTIM=$(echo "$WORKER_PIDS" | head -n 1)
+    echo "Kill worker pid=$VICTIM (expect respawn, master keeps serving)"
+    # 等访问日志写线程把前面请求的条目刷出去（每 100ms 一次），SIGKILL 会丢掉环里没写的
+    sleep 0.3
+    kill -KILL "$VICTIM" 2>/dev/null || true
+    RESPAWNED=0
+    for _ in $(seq 1 50); do
+        NOW_PIDS=$(pgrep -P "$SERVER_PID" 2>/dev/null || true)
+        if [[ $(echo "$NOW_PIDS" | grep -c .) -eq "$WORKER_COUNT" ]] && ! grep -qx "$VICTIM" <<<"$NOW_PIDS"; then
+            RESPAWNED=1
+            break
+        fi
+        sleep 0.1
+    done
+    HTTP_CODE=$(curl --max-time 3 -o /dev/null -s -w "%{http_code}" "http://127.0.0.1:${PORT}/index.html" || true)
+    if [[ "$RESPAWNED" -ne 1 || "$HTTP_CODE" -ne 200 ]]; then
+        echo -e "${RED}FAILED: worker not respawned (respawned=$RESPAWNED, http=$HTTP_CODE)${NC}"
+        RESULT=1
+    fi
+
+    # 4.7 配置重载：SIGHUP 后换成新一代 worker，旧 worker 排空退出，期间持续可用
+    OLD_PIDS=$(pgrep -P "$SERVER_PID" 2>/dev/null | sort || true)
+    echo "SIGHUP master (expect a new worker generation, no failed requests)"
+    kill -HUP "$SERVER_PID" 2>/dev/null || true
+    RELOAD_FAIL=0
+    RELOADED=0
+    for _ in $(seq 1 50); do
+        HTTP_CODE=$(curl --max-time 3 -o /dev/null -s -w "%{http_code}" "http://127.0.0.1:${PORT}/index.html" || true)
+        if [[ "$HTTP_CODE" -ne 200 ]]; then
+            RELOAD_FAIL=$((RELOAD_FAIL + 1))
+        fi
+        NOW_PIDS=$(pgrep -P "$SERVER_PID" 2>/dev/null | sort || true)
+        if [[ -z "$(comm -12 <(echo "$OLD_PIDS") <(echo "$NOW_PIDS"))" ]]; then
+            RELOADED=1
+            break
+        fi
+        sleep 0.1
+    done
+    if [[ "$RELOADED" -ne 1 || "$RELOAD_FAIL" -ne 0 ]]; then
+        echo -e "${RED}FAILED: reload (new generation=$RELOADED, failed requests=$RELOAD_FAIL)${NC}"
+        RESULT=1
+    fi
+
+    # 4.8 统计：SIGUSR1 让 master 汇总各 worker 的共享计数，重载后旧 worker 的请求也要算在内
+    echo "SIGUSR1 master (expect live totals in the log)"
+    kill -USR1 "$SERVER_PID" 2>/dev/null || true
+    STATS_LINE=""
+    for _ in $(seq 1 20); do
+        STATS_LINE=$(grep -oE "stats: requests=[0-9]+" "$LOG_FILE" | tail -n 1 || true)
+        [[ -n "$STATS_LINE" ]] && break
+        sleep 0.1
+    done
+    if [[ -z "$STATS_LINE" || "${STATS_LINE##*=}" -lt 8 ]]; then
+        echo -e "${RED}FAILED: stats report missing or too low (${STATS_LINE:-none})${NC}"
+        RESULT=1
+    fi
+fi
+
+# 4.9 指标：配置了 metrics_path 时由 worker 直接返回 Prometheus 文本，
+#     包含计数、每个 worker 的连接数和前面那些 2xx 请求的耗时直方图
+METRICS_PATH=$(grep -E '^[[:space:]]*metrics_path[[:space:]]*=' "$RUN_CONF" | tail -n 1 | cut -d= -f2 | tr -d ' \t\r' || true)
+if [[ -n "${METRICS_PATH:-}" ]]; then
+    echo "Request: http://127.0.0.1:${PORT}${METRICS_PATH} (expect 200 + Prometheus text)"
+    METRICS_OUT=$(curl --max-time 3 -s -w "\n%{http_code} %{content_type}" "http://127.0.0.1:${PORT}${METRICS_PATH}?x=1" || true)
+    METRICS_STATUS=${METRICS_OUT##*$'\n'}
+    METRICS_BODY=${METRICS_OUT%$'\n'*}
+    MISSING=""
+    for series in '^zaver_requests_total [0-9]+$' \
+                  '^zaver_responses_total\{class="2xx"\} [1-9]' \
+                  '^zaver_connections\{state="open"\} [1-9]' \
+                  '^zaver_worker_connections\{worker="[0-9]+",reactor="[0-9]+",pid="[0-9]+",state="open"\} ' \
+                  '^zaver_request_duration_seconds_bucket\{class="2xx",le="\+Inf"\} [1-9]' \
+                  '^zaver_request_duration_seconds_count\{class="2xx"\} [1-9]' \
+                  '^zaver_ttfb_seconds_bucket\{class="2xx",le="0\.000001"\} [0-9]+$'; do
+        # here-string 而不是管道：grep -q 提前退出时 pipefail 会把写端的 SIGPIPE 当成没找到
+        if ! grep -qE "$series" <<<"$METRICS_BODY"; then
+            MISSING="$MISSING $series"
+        fi
+    done
+    if [[ "$METRICS_STATUS" != "200 text/plain"* || -n "$MISSING" ]]; then
+        echo -e "${RED}FAILED: metrics endpoint (status=$METRICS_STATUS missing:$MISSING)${NC}"
+        RESULT=1
+    fi
+fi
+
+# 4.10 发送途中文件被截断：Content-Length 已经承诺了原长度，连接必须立即关闭，
+#      不能当作响应发完留着 keep-alive（否则后面的字节会被当成下一个响应）
+TRUNC_FILE="$ROOT_DIR/html/__ci_trunc__.bin"
+# 比回环上发送/接收缓冲区能装下的大得多，截断时一定还在发送
+TRUNC_SIZE=67108864
+head -c "$TRUNC_SIZE" /dev/zero >"$TRUNC_FILE"
+echo "Truncate a file while it is being sent (expect the connection closed short)"
+# 先不读，让服务器把发送缓冲区写满后停在 EPOLLOUT 上；截断后再一口气读完
+exec 3<>"/dev/tcp/127.0.0.1/${PORT}"
+printf 'GET /__ci_trunc__.bin HTTP/1.1\r\nHost: ci\r\n\r\n' >&3
+sleep 0.5
+truncate -s 1048576 "$TRUNC_FILE"
+TRUNC_RC=0
+TRUNC_BYTES=$(timeout 3 cat <&3 | wc -c) || TRUNC_RC=$?
+exec 3<&-
+rm -f "$TRUNC_FILE"
+# 124: 超时，说明连接还挂着
+if [[ "$TRUNC_RC" -ne 0 || "$TRUNC_BYTES" -ge "$TRUNC_SIZE" ]]; then
+    echo -e "${RED}FAILED: truncated file did not close the connection (rc=$TRUNC_RC, bytes=$TRUNC_BYTES)${NC}"
+    RESULT=1
+fi
+
+# 4.11 元数据缓存：TTL 内文件被改短，同一连接（同一个 reactor 的缓存）上的下一个响应要用新的长度
+STALE_FILE="$ROOT_DIR/html/__ci_stale__.txt"
+head -c 4096 /dev/zero | tr '\0' a >"$STALE_FILE"
+echo "Rewrite a cached file between two keep-alive requests (expect the new length)"
+exec 3<>"/dev/tcp/127.0.0.1/${PORT}"
+printf 'GET /__ci_stale__.txt HTTP/1.1\r\nHost: ci\r\n\r\n' >&3
+sleep 0.2
+head -c 100 /dev/zero | tr '\0' b >"$STALE_FILE"
+printf 'GET /__ci_stale__.txt HTTP/1.1\r\nHost: ci\r\nConnection: close\r\n\r\n' >&3
+STALE_RESP=$(timeout 3 cat <&3 | tr -d '\r' || true)
+exec 3<&-
+rm -f "$STALE_FILE"
+if ! grep -q "^Content-length: 100$" <<<"$STALE_RESP" ||
+   [[ "${STALE_RESP: -100}" != "$(head -c 100 /dev/zero | tr '\0' b)" ]]; then
+    echo -e "${RED}FAILED: cached metadata served for a rewritten file${NC}"
+    RESULT=1
+fi
+
+# 4.12 日志限流：一串解析失败的连接，同一调用点每秒只记 log_rate_limit 条，其余汇总成一行
+RATE=$(grep -E '^[[:space:]]*log_rate_limit[[:space:]]*=' "$CONF_PATH" | tail -n 1 | cut -d= -f2 | tr -d ' \t\r' || true)
+if [[ "${RATE:-10}" -gt 0 ]]; then
+    echo "200 malformed requests (expect the parse errors to be rate-limited)"
+    JUNK_BEFORE=$(grep -c "rc != ZV_OK" "$LOG_FILE" || true)
+    for _ in $(seq 1 200); do
+        exec 3<>"/dev/tcp/127.0.0.1/${PORT}"
+        printf 'JUNK\r\n\r\n' >&3
+        exec 3<&-
+    done
+    SUPPRESSED=0
+    for _ in $(seq 1 30); do
+        if grep -q "similar messages suppressed" "$LOG_FILE"; then
+            SUPPRESSED=1
+            break
+        fi
+        sleep 0.1
+    done
+    JUNK_LOGGED=$(( $(grep -c "rc != ZV_OK" "$LOG_FILE" || true) - JUNK_BEFORE ))
+    if [[ "$SUPPRESSED" -ne 1 || "$JUNK_LOGGED" -ge 200 ]]; then
+        echo -e "${RED}FAILED: log rate limit (logged=$JUNK_LOGGED, summary=$SUPPRESSED)${NC}"
+        RESULT=1
+    fi
+fi
+
+# 4.13 平滑停止：SIGTERM 后在途的下载要完整发完，空闲的 keep-alive 连接立即关闭，
+#     请求发了一半的连接收到带 Connection: close 的响应，SIGTERM 前已按 keep-alive 发出的
+#     响应发完就关（不等 keep_alive_timeout），然后服务器自己退出
+DRAIN_FILE="$ROOT_DIR/html/__ci_drain__.bin"
+DRAIN_OUT="$WORK_DIR/drain.bin"
+DRAIN_SIZE=8388608
+head -c "$DRAIN_SIZE" /dev/zero >"$DRAIN_FILE"
+echo "SIGTERM with a download in flight (expect it to finish, idle connections closed, server exits)"
+curl --max-time 20 --limit-rate 4M -s -o "$DRAIN_OUT" -w "%{http_code}" "http://127.0.0.1:${PORT}/__ci_drain__.bin" >"$DRAIN_OUT.code" &
+DL_PID=$!
+exec 3<>"/dev/tcp/127.0.0.1/${PORT}"
+printf 'GET /index.html HTTP/1.1\r\nHost: ci\r\n\r\n' >&3
+exec 4<>"/dev/tcp/127.0.0.1/${PORT}"
+printf 'GET /index.html HTTP/1.1\r\nHost: ci\r\n' >&4
+# 不读：响应头已经带着 keep-alive 发出，剩下的卡在套接字缓冲里
+exec 5<>"/dev/tcp/127.0.0.1/${PORT}"
+printf 'GET /__ci_drain__.bin HTTP/1.1\r\nHost: ci\r\n\r\n' >&5
+sleep 0.5
+kill -TERM "$SERVER_PID"
+sleep 0.3
+printf '\r\n' >&4
+IDLE_RC=0
+timeout 2 cat <&3 >/dev/null || IDLE_RC=$?
+LAST_RESP=$(timeout 3 cat <&4 || true)
+KA_RC=0
+KA_BYTES=$(timeout 3 cat <&5 | wc -c) || KA_RC=$?
+exec 3<&- 4<&- 5<&-
+wait "$DL_PID" || true
+DL_CODE=$(cat "$DRAIN_OUT.code" 2>/dev/null || true)
+DL_SIZE=$(stat -c %s "$DRAIN_OUT" 2>/dev/null || echo 0)
+STOPPED=0
+for _ in $(seq 1 100); do
+    if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+        STOPPED=1
+        break
+    fi
+    sleep 0.1
+done
+rm -f "$DRAIN_FILE" "$DRAIN_OUT" "$DRAIN_OUT.code"
+if [[ "$DL_CODE" != "200" || "$DL_SIZE" -ne "$DRAIN_SIZE" ]]; then
+    echo -e "${RED}FAILED: in-flight download cut off (http=$DL_CODE, bytes=$DL_SIZE)${NC}"
+    RESULT=1
+fi
+if [[ "$IDLE_RC" -ne 0 ]]; then
+    echo -e "${RED}FAILED: idle keep-alive connection left open after SIGTERM${NC}"
+    RESULT=1
+fi
+if [[ "$KA_RC" -ne 0 || "$KA_BYTES" -le "$DRAIN_SIZE" ]]; then
+    echo -e "${RED}FAILED: keep-alive response in flight at SIGTERM not closed after it finished (bytes=$KA_BYTES)${NC}"
+    RESULT=1
+fi
+if ! grep -qi "^Connection: close" <<<"$LAST_RESP"; then
+    echo -e "${RED}FAILED: response during the drain did not carry Connection: close${NC}"
+    RESULT=1
+fi
+if [[ "$STOPPED" -ne 1 ]]; then
+    echo -e "${RED}FAILED: server still running after the drain${NC}"
+    RESULT=1
+else
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=""
+fi
+
+# 4.14 访问日志：worker 退出前写线程把环里剩下的都写完，每行都是完整的默认格式；
+#      一行在响应发完（或连接关闭）时才记，字节数是真正发出的正文，耗时算到最后一个字节
+echo "Access log $ACCESS_LOG (expect one well-formed line per response, sent bytes and full duration)"
+AL_LINE='^127\.0\.0\.1 - - \[[^]]+\] "[^"]*" [0-9]{3} ([0-9]+|-) [0-9]+\.[0-9]{3}$'
+# 限速 4MB/s 的 8MB 下载除去套接字缓冲也要发好几百毫秒（入队只要 0.000）；被截断的文件远没发够 Content-Length
+TRUNC_LOGGED=$(grep -oE "\"GET /__ci_trunc__\.bin HTTP/1\.1\" 200 [0-9]+ " "$ACCESS_LOG" 2>/dev/null | awk '{print $(NF)}' | head -n 1 || true)
+if ! grep -qE "\"GET /__ci_drain__\.bin HTTP/1\.1\" 200 ${DRAIN_SIZE} ([1-9][0-9]*|0\.[1-9])[0-9.]*$" "$ACCESS_LOG" 2>/dev/null ||
+   [[ -z "$TRUNC_LOGGED" || "$TRUNC_LOGGED" -ge "$TRUNC_SIZE" ]]; then
+    echo -e "${RED}FAILED: access log reports planned instead of sent bytes/time (truncated file logged ${TRUNC_LOGGED:-none})${NC}"
+    RESULT=1
+fi
+if ! grep -qE '"GET /index\.html HTTP/1\.1" 200 [0-9]+ ' "$ACCESS_LOG" 2>/dev/null ||
+   ! grep -qE '"GET /__ci_not_found__ HTTP/1\.1" 404 ' "$ACCESS_LOG" ||
+   ! grep -qE "\"GET /__ci_drain__\.bin HTTP/1\.1\" 200 ${DRAIN_SIZE} " "$ACCESS_LOG" ||
+   grep -vqE "$AL_LINE" "$ACCESS_LOG"; then
+    echo -e "${RED}FAILED: access log entries missing or malformed${NC}"
+    tail -n 20 "$ACCESS_LOG" 2>/dev/null || true
+    RESULT=1
+fi
+
+# 4.15 reuseport steering 下 worker 反复崩溃：退避等待期间它的 slot 不再分到连接，
+#      请求全由其他 worker 接住（而不是挂在没人 accept 的监听套接字上）
+STEER_CONF="$WORK_DIR/steer.conf"
+{ sed -e '$a\' "$CONF_PATH"; echo "workers=4"; echo "accept_mode=reuseport"; echo "reuseport_steering=1"; } >"$STEER_CONF"
+setsid "$BIN_PATH" -c "$STEER_CONF" >>"$LOG_FILE" 2>&1 &
+SERVER_PID=$!
+for _ in $(seq 1 50); do
+    if [[ $(pgrep -P "$SERVER_PID" | wc -l) -eq 4 ]] &&
+       [[ $(curl --max-time 1 -o /dev/null -s -w "%{http_code}" "http://127.0.0.1:${PORT}/index.html" || true) == "200" ]]; then
+        break
+    fi
+    sleep 0.1
+done
+VICTIM=$(pgrep -P "$SERVER_PID" | head -n 1 || true)
+echo "Steering on: crash worker pid=$VICTIM repeatedly (expect its slot skipped during the backoff)"
+# 连续快速退出 6 次，第 6 次之后要等 1.6 秒才重启
+for kill_no in $(seq 1 6); do
+    BEFORE=$(pgrep -P "$SERVER_PID" | sort || true)
+    kill -KILL "$VICTIM" 2>/dev/null || true
+    [[ "$kill_no" -eq 6 ]] && break
+    for _ in $(seq 1 100); do
+        VICTIM=$(comm -13 <(echo "$BEFORE") <(pgrep -P "$SERVER_PID" | sort) | head -n 1 || true)
+        [[ -n "$VICTIM" ]] && break
+        sleep 0.02
+    done
+done
+sleep 0.1
+STEER_FAIL=0
+for _ in $(seq 1 20); do
+    HTTP_CODE=$(curl --max-time 0.5 -o /dev/null -s -w "%{http_code}" "http://127.0.0.1:${PORT}/index.html" || true)
+    if [[ "$HTTP_CODE" != "200" ]]; then
+        STEER_FAIL=$((STEER_FAIL + 1))
+    fi
+done
+if [[ "$STEER_FAIL" -ne 0 ]] || ! grep -q "next start in 1600ms" "$LOG_FILE"; then
+    echo -e "${RED}FAILED: requests lost to a crashed worker's steered slot (failed=$STEER_FAIL)${NC}"
+    RESULT=1
+fi
+
 if [[ "$RESULT" -eq 0 ]]; then
     echo -e "${GREEN}All functional + security tests passed.${NC}"
 else
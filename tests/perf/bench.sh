@@ -24,12 +24,21 @@ WRK_TIMEOUT="${WRK_TIMEOUT:-10s}"
 # - suite: run core cases (static small, static big, CGI, 404)
 # - scan_conns: scan CONN_LIST for static small
 # - scan_threads: scan THREAD_LIST for static small
-# - scale_workers: scan WORKER_LIST, restarting server each time, for static small
+# - scale_workers: scan WORKER_LIST for each of SCALE_ACCEPT_MODES (accept_mode), restarting server each time, for static small
 # - claims: Nginx-style headline checks (C10K, idle keep-alive RSS, single-core QPS, linear scalability hints)
-# - full: suite + scan_conns + scan_threads + scale_workers
+# - packets: TCP segments per response (/proc/net/snmp OutSegs) and single-connection small-file latency
+# - fairness: static small latency alone vs while FAIR_BIG_CLIENTS download the big file (send_quantum_kb)
+# - bigconns: BIG_CONNS concurrent big downloads, RSS + kernel TCP memory with default vs tuned send queues
+# - zerocopy: big file via sendfile vs mmap+copy vs mmap+MSG_ZEROCOPY, server CPU seconds per GiB sent
+# - pipeline: static small with HTTP pipelining (depth 1 vs PIPELINE_DEPTH), plus syscalls/request when perf is available
+# - backends: static small + static big with event_backend=epoll vs io_uring, plus server CPU and syscalls/request
+# - busypoll: static small p50/p99 at BUSY_CONNS connections, default loop vs busy_poll_us=BUSY_POLL_US, plus server CPU
+# - full: suite + packets + scan_conns + scan_threads + scale_workers
 MODE="${MODE:-full}"
 CONN_LIST="${CONN_LIST:-50 100 200 500 1000}"
 WORKER_LIST="${WORKER_LIST:-1 2 4}"
+# accept_mode values compared by MODE=scale_workers (shared uses accept_max_conns from the conf).
+SCALE_ACCEPT_MODES="${SCALE_ACCEPT_MODES:-reuseport shared}"
 THREAD_LIST="${THREAD_LIST:-1 2 4 8}"
 
 # Nginx-style headline checks (best-effort, environment-dependent).
@@ -41,6 +50,26 @@ SINGLE_CORE_CONNS="${SINGLE_CORE_CONNS:-2000}"
 SINGLE_CORE_THREADS="${SINGLE_CORE_THREADS:-1}"
 ULIMIT_NOFILE="${ULIMIT_NOFILE:-}"
 
+# Background big-file downloaders for MODE=fairness.
+FAIR_BIG_CLIENTS="${FAIR_BIG_CLIENTS:-4}"
+
+# Concurrent big-file downloads for MODE=bigconns; the "tuned" run uses these send-queue settings.
+BIG_CONNS="${BIG_CONNS:-1000}"
+BIG_TUNED_NOTSENT_LOWAT="${BIG_TUNED_NOTSENT_LOWAT:-131072}"
+BIG_TUNED_SNDBUF="${BIG_TUNED_SNDBUF:-0}"
+
+# Low-concurrency latency comparison for MODE=busypoll.
+BUSY_CONNS="${BUSY_CONNS:-4}"
+BUSY_POLL_US="${BUSY_POLL_US:-50}"
+
+# HTTP pipelining depth for MODE=pipeline (requests written back-to-back per connection).
+PIPELINE_DEPTH="${PIPELINE_DEPTH:-16}"
+PIPELINE_LUA="${ROOT_DIR}/tests/perf/pipeline.lua"
+
+# Optional wrk Lua script (and its single argument) applied to every run_wrk_case.
+WRK_SCRIPT="${WRK_SCRIPT:-}"
+WRK_SCRIPT_ARG="${WRK_SCRIPT_ARG:-}"
+
 BIG_FILE_MB="${BIG_FILE_MB:-256}"
 BIG_FILE_PATH_REL="${BIG_FILE_PATH_REL:-big.bin}"
 
@@ -349,12 +378,26 @@ start_server() {
     wait_ready "http://127.0.0.1:${PORT}/index.html"
 }
 
+# Host-wide TCP OutSegs counter (loopback: includes the client's request and ACK segments).
+tcp_outsegs() {
+    awk '/^Tcp:/ { if (!hdr) { for (i=1; i<=NF; i++) if ($i=="OutSegs") col=i; hdr=1 } else { print $col; exit } }' /proc/net/snmp 2>/dev/null
+}
+
 run_wrk_case() {
     local name="$1"
     local url="$2"
 
+    local script_args=()
+    if [[ -n "${WRK_SCRIPT:-}" ]]; then
+        script_args=(-s "$WRK_SCRIPT")
+    fi
+    local url_args=("$url")
+    if [[ -n "${WRK_SCRIPT_ARG:-}" ]]; then
+        url_args+=(-- "$WRK_SCRIPT_ARG")
+    fi
+
     # Warmup
-    wrk --latency --timeout "$WRK_TIMEOUT" -t"$THREADS" -c"$CONNS" -d"$WARMUP" "$url" >/dev/null 2>&1 || true
+    wrk --latency --timeout "$WRK_TIMEOUT" -t"$THREADS" -c"$CONNS" -d"$WARMUP" "${script_args[@]}" "${url_args[@]}" >/dev/null 2>&1 || true
 
     # Helpers: parse and normalize wrk units for aggregation.
     to_ms() {
@@ -403,11 +446,14 @@ run_wrk_case() {
     local p99_ms_list=""
     local xfer_mibps_list=""
     local non2xx_sum=0
+    local requests_sum=0
     local sockerr_text=""
+    local outsegs_before
+    outsegs_before=$(tcp_outsegs)
 
     for run_i in $(seq 1 "$RUNS"); do
         local out
-        out=$(wrk --latency --timeout "$WRK_TIMEOUT" -t"$THREADS" -c"$CONNS" -d"$DURATION" "$url" 2>/dev/null || true)
+        out=$(wrk --latency --timeout "$WRK_TIMEOUT" -t"$THREADS" -c"$CONNS" -d"$DURATION" "${script_args[@]}" "${url_args[@]}" 2>/dev/null || true)
 
         local rps
         local latency_avg
@@ -431,6 +477,11 @@ run_wrk_case() {
         p99=$(echo "$out" | awk 'BEGIN{f=0} /Latency Distribution/ {f=1; next} f && $1=="99%" {print $2; exit}')
 
         non2xx=$(echo "$out" | awk -F': ' '/Non-2xx or 3xx responses/ {print $2; exit}')
+        local requests
+        requests=$(echo "$out" | awk '/requests in/ {print $1; exit}')
+        if [[ -n "${requests:-}" ]]; then
+            requests_sum=$((requests_sum + requests))
+        fi
         socket_errors=$(echo "$out" | awk -F': ' '/Socket errors/ {print $2; exit}')
 
         if [[ -n "${non2xx:-}" ]]; then
@@ -473,9 +524,17 @@ run_wrk_case() {
     xfer_mibps_mean=$(echo -e "$xfer_mibps_list" | awk 'NF{print}' | mean_of)
 
     LAST_RPS_MEAN="$rps_mean"
+    LAST_P50_MS_MEAN="$p50_ms_mean"
     LAST_P99_MS_MEAN="$p99_ms_mean"
     LAST_XFER_MIBPS_MEAN="$xfer_mibps_mean"
     LAST_LAT_AVG_MS_MEAN="$lat_avg_ms_mean"
+    LAST_REQUESTS_SUM="$requests_sum"
+    LAST_OUTSEGS=""
+    local outsegs_after
+    outsegs_after=$(tcp_outsegs)
+    if [[ -n "${outsegs_before:-}" && -n "${outsegs_after:-}" ]]; then
+        LAST_OUTSEGS=$((outsegs_after - outsegs_before))
+    fi
 
     local notes=""
     if [[ "$non2xx_sum" -ne 0 ]]; then
@@ -505,6 +564,92 @@ run_wrk_case_with_conns() {
     CONNS="$old_conns"
 }
 
+# Kernel-wide TCP memory in KiB (/proc/net/sockstat "mem" is in pages).
+tcp_mem_kb() {
+    local page_kb
+    page_kb=$(( $(getconf PAGESIZE 2>/dev/null || echo 4096) / 1024 ))
+    awk -v pk="$page_kb" '/^TCP:/ { for (i=1; i<NF; i++) if ($i=="mem") { print $(i+1) * pk; exit } }' /proc/net/sockstat 2>/dev/null
+}
+
+# Start wrk with BIG_CONNS connections on the big file, sample memory halfway through.
+# Prints one table row.
+run_bigconns_case() {
+    local label="$1"
+    local conf="$2"
+    local url="${BASE_URL}/${BIG_FILE_PATH_REL}"
+    local secs="${DURATION%s}"
+    local out_file="${ROOT_DIR}/tests/perf/_tmp_bigconns_wrk.txt"
+
+    start_server "$conf"
+    local mem_before
+    mem_before=$(tcp_mem_kb)
+    wrk --timeout "$WRK_TIMEOUT" -t"$THREADS" -c"$BIG_CONNS" -d"$DURATION" "$url" >"$out_file" 2>/dev/null &
+    local wrk_pid=$!
+    sleep $(( secs > 1 ? secs / 2 : 1 ))
+    local rss_kb mem_kb
+    rss_kb=$(sum_rss_kb_tree "$SERVER_PID")
+    mem_kb=$(tcp_mem_kb)
+    wait "$wrk_pid" 2>/dev/null || true
+    stop_server
+
+    local xfer
+    xfer=$(awk '/Transfer\/sec/ {print $2; exit}' "$out_file")
+    rm -f "$out_file"
+    local delta_mib
+    delta_mib=$(awk -v a="$mem_kb" -v b="$mem_before" 'BEGIN{ if(a==""||b=="") print "N/A"; else printf "%.1f", (a-b)/1024 }')
+    echo "| ${label} | ${BIG_CONNS} | ${rss_kb:-N/A} | ${delta_mib} | ${xfer:-N/A} |"
+}
+
+# utime+stime (clock ticks) of the server and its workers.
+server_cpu_ticks() {
+    local pids="$SERVER_PID"
+    if command -v pgrep >/dev/null 2>&1; then
+        pids+=" $(pgrep -P "$SERVER_PID" 2>/dev/null | tr '\n' ' ' || true)"
+    fi
+    local total=0 p t
+    for p in $pids; do
+        # fields after the "(comm)" part: utime is 12th, stime 13th
+        t=$(sed -E 's/^.*\) //' "/proc/${p}/stat" 2>/dev/null | awk '{print $12 + $13}')
+        total=$((total + ${t:-0}))
+    done
+    echo "$total"
+}
+
+server_pids_csv() {
+    local pids="$SERVER_PID"
+    if command -v pgrep >/dev/null 2>&1; then
+        local children
+        children=$(pgrep -P "$SERVER_PID" 2>/dev/null | tr '\n' ' ' || true)
+        pids+=" ${children}"
+    fi
+    echo "$pids" | awk '{ for (i=1; i<=NF; i++) printf "%s%s", (i>1?",":""), $i }'
+}
+
+# Run a wrk case while perf counts the server's syscalls; prints the table row,
+# sets LAST_SYSCALLS (empty when perf is unavailable or not permitted).
+run_wrk_case_counting_syscalls() {
+    local name="$1"
+    local url="$2"
+    LAST_SYSCALLS=""
+
+    if ! command -v perf >/dev/null 2>&1; then
+        run_wrk_case "$name" "$url"
+        return 0
+    fi
+
+    local perf_out="${ROOT_DIR}/tests/perf/_tmp_perf_syscalls.txt"
+    rm -f "$perf_out"
+    perf stat -e raw_syscalls:sys_enter -x, -o "$perf_out" -p "$(server_pids_csv)" >/dev/null 2>&1 &
+    local perf_pid=$!
+    run_wrk_case "$name" "$url"
+    kill -INT "$perf_pid" 2>/dev/null || true
+    wait "$perf_pid" 2>/dev/null || true
+    if [[ -f "$perf_out" ]]; then
+        LAST_SYSCALLS=$(awk -F, '/raw_syscalls:sys_enter/ && $1 ~ /^[0-9]+$/ {print $1; exit}' "$perf_out")
+        rm -f "$perf_out"
+    fi
+}
+
 main() {
     ensure_big_file
     BASE_URL="http://127.0.0.1:${PORT}"
@@ -590,6 +735,48 @@ main() {
             echo
         fi
 
+        if [[ "$MODE" == "packets" || "$MODE" == "full" ]]; then
+            print_section "Packets per Response"
+            print_table_header
+            declare -A PKT_OUTSEGS
+            declare -A PKT_REQS
+            declare -A PKT_LAT
+            declare -A PKT_P99
+            local pkt_cases=("Static small|${BASE_URL}/index.html" "404|${BASE_URL}/no-such-file")
+            WORKERS_LABEL="${WORKERS_CONF:-N/A}"
+            start_server "$CONF_PATH"
+            # One connection, one thread: latency is per response, not queueing.
+            local old_threads="$THREADS" old_conns="$CONNS"
+            THREADS=1
+            CONNS=1
+            for entry in "${pkt_cases[@]}"; do
+                local k="${entry%%|*}" u="${entry#*|}"
+                run_wrk_case "${k} (1 conn)" "$u"
+                PKT_OUTSEGS[$k]="${LAST_OUTSEGS:-}"
+                PKT_REQS[$k]="${LAST_REQUESTS_SUM:-}"
+                PKT_LAT[$k]="${LAST_LAT_AVG_MS_MEAN:-}"
+                PKT_P99[$k]="${LAST_P99_MS_MEAN:-}"
+            done
+            THREADS="$old_threads"
+            CONNS="$old_conns"
+            stop_server
+            echo
+
+            echo "### TCP Segments per Request (loopback, client + server)"
+            echo
+            echo "| Case | Requests | OutSegs | Segs/req | Latency avg(ms) | p99(ms) |"
+            echo "|---|---:|---:|---:|---:|---:|"
+            for entry in "${pkt_cases[@]}"; do
+                local k="${entry%%|*}"
+                local per
+                per=$(awk -v a="${PKT_OUTSEGS[$k]:-}" -v b="${PKT_REQS[$k]:-}" 'BEGIN{ if(a==""||b==""||b==0) print "N/A"; else printf "%.3f", a/b }')
+                echo "| ${k} | ${PKT_REQS[$k]:-N/A} | ${PKT_OUTSEGS[$k]:-N/A} | ${per} | ${PKT_LAT[$k]:-N/A} | ${PKT_P99[$k]:-N/A} |"
+            done
+            echo
+            echo "Each keep-alive request costs at least one client segment; a coalesced small-file response adds one more (ACKs piggyback or are delayed)."
+            echo
+        fi
+
         if [[ "$MODE" == "scan_conns" || "$MODE" == "full" ]]; then
             print_section "Conns Scan (Static small)"
             print_table_header
@@ -620,41 +807,250 @@ main() {
         if [[ "$MODE" == "scale_workers" || "$MODE" == "full" ]]; then
             print_section "Workers Scale (Static small)"
             print_table_header
-            local tmp_conf
+            local tmp_conf mode_conf
             tmp_conf="${ROOT_DIR}/tests/perf/_tmp_zaver.conf"
+            mode_conf="${ROOT_DIR}/tests/perf/_tmp_zaver_mode.conf"
             declare -A SCALE_RPS
 
-            for w in $WORKER_LIST; do
-                make_conf_with_workers "$w" "$tmp_conf"
-                WORKERS_LABEL="$w"
-                start_server "$tmp_conf"
-                run_wrk_case "Static small" "${BASE_URL}/index.html"
-                SCALE_RPS[$w]="${LAST_RPS_MEAN:-}"
-                stop_server
+            for am in $SCALE_ACCEPT_MODES; do
+                make_conf_with_kv "accept_mode" "$am" "$CONF_PATH" "$mode_conf"
+                for w in $WORKER_LIST; do
+                    CONF_PATH="$mode_conf" make_conf_with_workers "$w" "$tmp_conf"
+                    WORKERS_LABEL="$w"
+                    start_server "$tmp_conf"
+                    run_wrk_case "Static small (accept_mode=${am})" "${BASE_URL}/index.html"
+                    SCALE_RPS[$am:$w]="${LAST_RPS_MEAN:-}"
+                    stop_server
+                done
             done
-            rm -f "$tmp_conf" || true
+            rm -f "$tmp_conf" "$mode_conf" || true
             echo
 
             # Summary: speedup and efficiency (best-effort)
             local base_w
             base_w=$(echo "$WORKER_LIST" | awk '{print $1; exit}')
-            local base_rps
-            base_rps="${SCALE_RPS[$base_w]:-}"
-            if [[ -n "${base_rps:-}" ]]; then
-                echo "### Scaling Summary"
-                echo
-                echo "| Workers | RPS(mean) | Speedup | Efficiency |"
-                echo "|---:|---:|---:|---:|"
+            echo "### Scaling Summary"
+            echo
+            echo "| Accept mode | Workers | RPS(mean) | Speedup | Efficiency |"
+            echo "|---|---:|---:|---:|---:|"
+            for am in $SCALE_ACCEPT_MODES; do
+                local base_rps
+                base_rps="${SCALE_RPS[$am:$base_w]:-}"
                 for w in $WORKER_LIST; do
                     local r
-                    r="${SCALE_RPS[$w]:-}"
+                    r="${SCALE_RPS[$am:$w]:-}"
                     local speed eff
                     speed=$(awk -v a="$r" -v b="$base_rps" 'BEGIN{ if(a==""||b==""||b==0) print "N/A"; else printf "%.3f", a/b }')
                     eff=$(awk -v s="$speed" -v w="$w" 'BEGIN{ if(s=="N/A"||w==0) print "N/A"; else printf "%.3f", s/w }')
-                    echo "| ${w} | ${r:-N/A} | ${speed} | ${eff} |"
+                    echo "| ${am} | ${w} | ${r:-N/A} | ${speed} | ${eff} |"
                 done
-                echo
-            fi
+            done
+            echo
+        fi
+
+        if [[ "$MODE" == "fairness" ]]; then
+            print_section "Fairness (Static small vs concurrent big downloads)"
+            print_table_header
+            WORKERS_LABEL="${WORKERS_CONF:-N/A}"
+            start_server "$CONF_PATH"
+            run_wrk_case "Static small (idle)" "${BASE_URL}/index.html"
+            local idle_p99="${LAST_P99_MS_MEAN:-}"
+
+            local bg_pids=()
+            for _ in $(seq 1 "$FAIR_BIG_CLIENTS"); do
+                ( while true; do curl -s -o /dev/null "${BASE_URL}/${BIG_FILE_PATH_REL}" || sleep 0.1; done ) &
+                bg_pids+=("$!")
+            done
+            run_wrk_case "Static small (+${FAIR_BIG_CLIENTS} big downloads)" "${BASE_URL}/index.html"
+            local busy_p99="${LAST_P99_MS_MEAN:-}"
+            for p in "${bg_pids[@]}"; do
+                pkill -P "$p" 2>/dev/null || true
+                kill "$p" 2>/dev/null || true
+                wait "$p" 2>/dev/null || true
+            done
+            stop_server
+            echo
+            echo "- p99 idle: ${idle_p99:-N/A}ms, with big downloads: ${busy_p99:-N/A}ms (send_quantum_kb from conf; 0 disables)"
+            echo
+        fi
+
+        if [[ "$MODE" == "bigconns" ]]; then
+            print_section "Concurrent Big Downloads (${BIG_FILE_MB}MiB x ${BIG_CONNS})"
+            echo "| Send queue | Conns | Server RSS(KiB) | TCP mem delta(MiB) | Transfer/sec |"
+            echo "|---|---:|---:|---:|---:|"
+            local conf_default="${ROOT_DIR}/tests/perf/_tmp_bigconns_default.conf"
+            local conf_tuned="${ROOT_DIR}/tests/perf/_tmp_bigconns_tuned.conf"
+            local tmp_conf="${ROOT_DIR}/tests/perf/_tmp_bigconns.conf"
+            make_conf_with_kv "large_notsent_lowat" "0" "$CONF_PATH" "$tmp_conf"
+            make_conf_with_kv "large_sndbuf" "0" "$tmp_conf" "$conf_default"
+            make_conf_with_kv "large_notsent_lowat" "$BIG_TUNED_NOTSENT_LOWAT" "$CONF_PATH" "$tmp_conf"
+            make_conf_with_kv "large_sndbuf" "$BIG_TUNED_SNDBUF" "$tmp_conf" "$conf_tuned"
+            run_bigconns_case "kernel default" "$conf_default"
+            run_bigconns_case "notsent_lowat=${BIG_TUNED_NOTSENT_LOWAT} sndbuf=${BIG_TUNED_SNDBUF}" "$conf_tuned"
+            rm -f "$conf_default" "$conf_tuned" "$tmp_conf"
+            echo
+        fi
+
+        if [[ "$MODE" == "zerocopy" ]]; then
+            print_section "Big File Send Path (${BIG_FILE_MB}MiB)"
+            print_table_header
+            local zc_kb=$(( BIG_FILE_MB * 1024 / 2 ))
+            local zc_names=("sendfile" "mmap+writev" "mmap+MSG_ZEROCOPY")
+            local zc_mmap=(0 "$zc_kb" "$zc_kb")
+            local zc_zc=(0 0 "$zc_kb")
+            local zc_rows=()
+            local clk_tck
+            clk_tck=$(getconf CLK_TCK 2>/dev/null || echo 100)
+            local tmp_conf="${ROOT_DIR}/tests/perf/_tmp_zc.conf"
+            local run_conf="${ROOT_DIR}/tests/perf/_tmp_zc_run.conf"
+            WORKERS_LABEL="${WORKERS_CONF:-N/A}"
+            for i in 0 1 2; do
+                make_conf_with_kv "mmap_threshold_kb" "${zc_mmap[$i]}" "$CONF_PATH" "$tmp_conf"
+                make_conf_with_kv "zerocopy_threshold_kb" "${zc_zc[$i]}" "$tmp_conf" "$run_conf"
+                start_server "$run_conf"
+                local t0 t1
+                t0=$(server_cpu_ticks)
+                run_wrk_case "Static big (${zc_names[$i]})" "${BASE_URL}/${BIG_FILE_PATH_REL}"
+                t1=$(server_cpu_ticks)
+                stop_server
+                local gib cpu_per_gib
+                gib=$(awk -v r="${LAST_REQUESTS_SUM:-0}" -v mb="$BIG_FILE_MB" 'BEGIN{ printf "%.3f", r*mb/1024 }')
+                cpu_per_gib=$(awk -v d="$((t1 - t0))" -v hz="$clk_tck" -v g="$gib" 'BEGIN{ if(g==0) print "N/A"; else printf "%.3f", d/hz/g }')
+                zc_rows+=("| ${zc_names[$i]} | ${gib} | $(awk -v d="$((t1 - t0))" -v hz="$clk_tck" 'BEGIN{ printf "%.2f", d/hz }') | ${cpu_per_gib} |")
+            done
+            rm -f "$tmp_conf" "$run_conf"
+            echo
+            echo "| Send path | GiB sent | Server CPU(s) | CPU s/GiB |"
+            echo "|---|---:|---:|---:|"
+            printf '%s\n' "${zc_rows[@]}"
+            echo
+            echo "Note: on loopback the kernel completes MSG_ZEROCOPY sends by copying (see the worker's zerocopy stats line in the server log); use a real NIC for meaningful zerocopy numbers."
+            echo
+        fi
+
+        if [[ "$MODE" == "pipeline" ]]; then
+            print_section "Pipelining (Static small)"
+            print_table_header
+            declare -A PIPE_RPS
+            declare -A PIPE_SYSCALLS
+            declare -A PIPE_REQS
+            WORKERS_LABEL="${WORKERS_CONF:-N/A}"
+            start_server "$CONF_PATH"
+            for depth in 1 "$PIPELINE_DEPTH"; do
+                WRK_SCRIPT="$PIPELINE_LUA"
+                WRK_SCRIPT_ARG="$depth"
+                # Only the measured runs are counted (warmup happens inside run_wrk_case, before perf attaches).
+                run_wrk_case_counting_syscalls "Static small (pipeline depth ${depth})" "${BASE_URL}/index.html"
+                PIPE_RPS[$depth]="${LAST_RPS_MEAN:-}"
+                PIPE_SYSCALLS[$depth]="${LAST_SYSCALLS:-}"
+                PIPE_REQS[$depth]="${LAST_REQUESTS_SUM:-}"
+            done
+            WRK_SCRIPT=""
+            WRK_SCRIPT_ARG=""
+            stop_server
+            echo
+
+            echo "### Syscalls per Request"
+            echo
+            echo "| Depth | RPS(mean) | Requests | Server syscalls | Syscalls/req |"
+            echo "|---:|---:|---:|---:|---:|"
+            for depth in 1 "$PIPELINE_DEPTH"; do
+                local sc rq per
+                sc="${PIPE_SYSCALLS[$depth]:-}"
+                rq="${PIPE_REQS[$depth]:-}"
+                per=$(awk -v a="$sc" -v b="$rq" 'BEGIN{ if(a==""||b==""||b==0) print "N/A"; else printf "%.3f", a/b }')
+                echo "| ${depth} | ${PIPE_RPS[$depth]:-N/A} | ${rq:-N/A} | ${sc:-N/A} | ${per} |"
+            done
+            echo
+        fi
+
+        if [[ "$MODE" == "backends" ]]; then
+            print_section "Event Backends (epoll vs io_uring)"
+            print_table_header
+            declare -A BE_RPS
+            declare -A BE_CPU
+            declare -A BE_SYSCALLS
+            declare -A BE_REQS
+            local clk_tck
+            clk_tck=$(getconf CLK_TCK 2>/dev/null || echo 100)
+            local run_conf="${ROOT_DIR}/tests/perf/_tmp_backend.conf"
+            WORKERS_LABEL="${WORKERS_CONF:-N/A}"
+            for be in epoll io_uring; do
+                make_conf_with_kv "event_backend" "$be" "$CONF_PATH" "$run_conf"
+                start_server "$run_conf"
+                local t0 t1
+                t0=$(server_cpu_ticks)
+                run_wrk_case_counting_syscalls "Static small (${be})" "${BASE_URL}/index.html"
+                t1=$(server_cpu_ticks)
+                BE_RPS[$be]="${LAST_RPS_MEAN:-}"
+                BE_SYSCALLS[$be]="${LAST_SYSCALLS:-}"
+                BE_REQS[$be]="${LAST_REQUESTS_SUM:-}"
+                BE_CPU[$be]=$(awk -v d="$((t1 - t0))" -v hz="$clk_tck" 'BEGIN{ printf "%.2f", d/hz }')
+                run_wrk_case "Static big (${be})" "${BASE_URL}/${BIG_FILE_PATH_REL}"
+                stop_server
+            done
+            rm -f "$run_conf"
+            echo
+
+            echo "### Static small per backend"
+            echo
+            echo "| Backend | RPS(mean) | Server CPU(s) | Server syscalls | Syscalls/req |"
+            echo "|---|---:|---:|---:|---:|"
+            for be in epoll io_uring; do
+                local sc rq per
+                sc="${BE_SYSCALLS[$be]:-}"
+                rq="${BE_REQS[$be]:-}"
+                per=$(awk -v a="$sc" -v b="$rq" 'BEGIN{ if(a==""||b==""||b==0) print "N/A"; else printf "%.3f", a/b }')
+                echo "| ${be} | ${BE_RPS[$be]:-N/A} | ${BE_CPU[$be]:-N/A} | ${sc:-N/A} | ${per} |"
+            done
+            echo
+            echo "Note: a worker whose kernel refuses io_uring falls back to epoll and logs a warning; check the server log before comparing."
+            echo
+        fi
+
+        if [[ "$MODE" == "busypoll" ]]; then
+            print_section "Busy Poll (Static small, ${BUSY_CONNS} conns)"
+            print_table_header
+            declare -A BP_P50
+            declare -A BP_P99
+            declare -A BP_RPS
+            declare -A BP_CPU
+            local clk_tck
+            clk_tck=$(getconf CLK_TCK 2>/dev/null || echo 100)
+            local run_conf="${ROOT_DIR}/tests/perf/_tmp_busypoll.conf"
+            local bp_modes=("default|0" "busy_poll_us=${BUSY_POLL_US}|${BUSY_POLL_US}")
+            local old_threads="$THREADS" old_conns="$CONNS"
+            THREADS=1
+            CONNS="$BUSY_CONNS"
+            WORKERS_LABEL="${WORKERS_CONF:-N/A}"
+            for entry in "${bp_modes[@]}"; do
+                local k="${entry%%|*}" us="${entry#*|}"
+                make_conf_with_kv "busy_poll_us" "$us" "$CONF_PATH" "$run_conf"
+                start_server "$run_conf"
+                local t0 t1
+                t0=$(server_cpu_ticks)
+                run_wrk_case "Static small (${k})" "${BASE_URL}/index.html"
+                t1=$(server_cpu_ticks)
+                stop_server
+                BP_P50[$k]="${LAST_P50_MS_MEAN:-}"
+                BP_P99[$k]="${LAST_P99_MS_MEAN:-}"
+                BP_RPS[$k]="${LAST_RPS_MEAN:-}"
+                BP_CPU[$k]=$(awk -v d="$((t1 - t0))" -v hz="$clk_tck" 'BEGIN{ printf "%.2f", d/hz }')
+            done
+            THREADS="$old_threads"
+            CONNS="$old_conns"
+            rm -f "$run_conf"
+            echo
+
+            echo "| Mode | p50(ms) | p99(ms) | RPS(mean) | Server CPU(s) |"
+            echo "|---|---:|---:|---:|---:|"
+            for entry in "${bp_modes[@]}"; do
+                local k="${entry%%|*}"
+                echo "| ${k} | ${BP_P50[$k]:-N/A} | ${BP_P99[$k]:-N/A} | ${BP_RPS[$k]:-N/A} | ${BP_CPU[$k]:-N/A} |"
+            done
+            echo
+            echo "Note: busy polling spins each reactor's CPU while idle, so give every reactor its own core (cpu_affinity=1) and keep the client off those cores. Kernel busy polling only helps on a real NIC; on loopback the gain is the skipped sleep/wakeup."
+            echo
         fi
 
         if [[ "$MODE" == "claims" ]]; then
@@ -0,0 +1,21 @@
+-- HTTP pipelining for wrk: each "request" is DEPTH requests written back-to-back.
+-- usage: wrk -s tests/perf/pipeline.lua http://127.0.0.1:3000/index.html -- 16
+
+init = function(args)
+    local depth = 16
+    for _, a in ipairs(args) do
+        if tonumber(a) then
+            depth = tonumber(a)
+        end
+    end
+    local path = wrk.path
+    local r = {}
+    for i = 1, depth do
+        r[i] = wrk.format(nil, path)
+    end
+    req = table.concat(r)
+end
+
+request = function()
+    return req
+end
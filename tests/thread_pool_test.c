@@ -1,10 +1,17 @@
 #include <threadpool.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/time.h>
 
 #define THREAD_NUM 8
+#define BENCH_TASKS 1000000
 
 pthread_mutex_t lock;
 size_t sum = 0;
 
+static atomic_size_t bench_count;
+static size_t done_count = 0;
+
 static void sum_n(void *arg) {
     size_t n = (size_t) arg;
     int rc;
@@ -18,22 +25,97 @@ static void sum_n(void *arg) {
     check_exit(rc == 0, "pthread_mutex_unlock error");
 }
 
+/* a task that submits more tasks exercises the per-thread deques and stealing */
+static void fan_out(void *arg) {
+    zv_threadpool_t *tp = (zv_threadpool_t *) arg;
+    size_t i;
+    for (i = 0; i < 10; i++) {
+        check_exit(threadpool_add(tp, sum_n, (void *)1) == 0, "nested threadpool_add error");
+    }
+}
+
+static void nop(void *arg) {
+    (void) arg;
+}
+
+static void count_done(void *arg) {
+    done_count += (size_t) arg;
+}
+
+static void bench_task(void *arg) {
+    (void) arg;
+    atomic_fetch_add_explicit(&bench_count, 1, memory_order_relaxed);
+}
+
+static double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void submit(zv_threadpool_t *tp, void (*func)(void *), void *arg) {
+    int rc;
+    while ((rc = threadpool_add(tp, func, arg)) == zv_tp_queue_full) {
+        sched_yield();
+    }
+    check_exit(rc == 0, "threadpool_add error");
+}
+
+static void bench(int threads) {
+    atomic_store(&bench_count, 0);
+
+    zv_threadpool_t *tp = threadpool_init(threads);
+    check_exit(tp != NULL, "threadpool_init error");
+
+    double start = now_sec();
+    size_t i;
+    for (i = 0; i < BENCH_TASKS; i++) {
+        submit(tp, bench_task, NULL);
+    }
+    check_exit(threadpool_destroy(tp, 1) == 0, "threadpool_destroy error");
+    double elapsed = now_sec() - start;
+
+    check_exit(atomic_load(&bench_count) == BENCH_TASKS, "bench count error");
+    printf("threads %2d: %10.0f tasks/sec\n", threads, BENCH_TASKS / elapsed);
+}
+
 int main() {
     int rc;
     check_exit(pthread_mutex_init(&lock, NULL) == 0, "lock init error");
 
     zv_threadpool_t *tp = threadpool_init(THREAD_NUM);
     check_exit(tp != NULL, "threadpool_init error");
-    
+
     size_t i;
     for (i=1; i< 1000; i++){
         rc = threadpool_add(tp, sum_n, (void *)i);
         check_exit(rc == 0, "threadpool_add error");
     }
+    for (i=0; i< 100; i++){
+        rc = threadpool_add(tp, fan_out, (void *)tp);
+        check_exit(rc == 0, "threadpool_add error");
+    }
 
     check_exit(threadpool_destroy(tp, 1) == 0, "threadpool_destroy error");
 
-    check_exit(sum == 499500, "sum error");
+    check_exit(sum == 499500 + 1000, "sum error");
+
+    /* completions are handed back through the eventfd, in whatever order they finished */
+    tp = threadpool_init(THREAD_NUM);
+    check_exit(tp != NULL, "threadpool_init error");
+    for (i=1; i< 1000; i++){
+        rc = threadpool_add_done(tp, nop, count_done, (void *)i);
+        check_exit(rc == 0, "threadpool_add_done error");
+    }
+    while (done_count < 499500) {
+        threadpool_run_completions(tp);
+    }
+    check_exit(threadpool_destroy(tp, 1) == 0, "threadpool_destroy error");
     printf("pass thread_pool_test\n");
+
+    int threads;
+    for (threads = 1; threads <= 16; threads *= 2) {
+        bench(threads);
+    }
     return 0;
 }
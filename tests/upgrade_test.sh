@@ -0,0 +1,208 @@
+#!/bin/bash
+
+set -euo pipefail
+
+# 二进制热升级测试：在持续的新建连接压力下给 master 发 SIGUSR2，
+# 统计失败请求和内核 accept 队列丢弃（TcpExt ListenDrops/ListenOverflows）。
+#
+#   BUILD_DIR=build ./tests/upgrade_test.sh
+#   NEW_BIN=path/to/new/zaver  替换上去的新二进制（默认与旧的相同）
+#   CLIENTS=4 LOAD_SEC=6       压力客户端数量和持续时间
+#   LOG_FILE=path              服务器日志（默认放在临时目录里，测试失败时保留）
+#
+# 默认 accept_mode=reuseport 下旧 worker 关闭自己的监听套接字前会把队列里的连接接走；
+# 极少数恰好在两者之间到达的 SYN 会被重置，开启 net.ipv4.tcp_migrate_req=1 后内核会把它们迁到新的监听套接字。
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+echo "=== Starting Binary Upgrade Test ==="
+
+ROOT_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+cd "$ROOT_DIR"
+
+BUILD_DIR="${BUILD_DIR:-build}"
+CONF_PATH="${CONF_PATH:-$ROOT_DIR/zaver.conf}"
+CLIENTS="${CLIENTS:-4}"
+LOAD_SEC="${LOAD_SEC:-6}"
+TMP_DIR=$(mktemp -d "${TMPDIR:-/tmp}/zaver_upgrade.XXXXXX")
+LOG_FILE="${LOG_FILE:-$TMP_DIR/server.log}"
+
+if [ -f "./${BUILD_DIR}/zaver" ]; then
+    BIN_PATH="./${BUILD_DIR}/zaver"
+elif [ -f "./${BUILD_DIR}/src/zaver" ]; then
+    BIN_PATH="./${BUILD_DIR}/src/zaver"
+else
+    echo -e "${RED}Error: Could not find 'zaver' under BUILD_DIR=${BUILD_DIR}${NC}"
+    exit 1
+fi
+NEW_BIN="${NEW_BIN:-$BIN_PATH}"
+
+PORT=3000
+P=$(grep -E '^[[:space:]]*port[[:space:]]*=' "$CONF_PATH" | tail -n 1 | cut -d= -f2 | tr -d ' \t\r' || true)
+if [[ -n "${P:-}" ]]; then
+    PORT="$P"
+fi
+W=$(grep -E '^[[:space:]]*workers[[:space:]]*=' "$CONF_PATH" | tail -n 1 | cut -d= -f2 | tr -d ' \t\r' || true)
+if [[ "${W:-0}" == "1" ]]; then
+    echo -e "${RED}Error: binary upgrade needs a master process (workers != 1 in $CONF_PATH)${NC}"
+    exit 1
+fi
+
+LOAD_PIDS=()
+cleanup() {
+    local rc=$?
+    for p in "${LOAD_PIDS[@]}"; do
+        kill "$p" 2>/dev/null || true
+    done
+    if [[ -n "${SERVER_PID:-}" ]]; then
+        # 新 master 是旧 master fork 出来的，仍在同一个进程组里
+        kill -TERM -- "-${SERVER_PID}" 2>/dev/null || true
+        wait "${SERVER_PID}" 2>/dev/null || true
+        for _ in $(seq 1 50); do
+            pgrep -g "$SERVER_PID" >/dev/null 2>&1 || break
+            sleep 0.1
+        done
+    fi
+    if [[ "$rc" -eq 0 ]]; then
+        rm -rf "$TMP_DIR"
+    else
+        echo "Server log and client results kept in $TMP_DIR"
+    fi
+}
+trap cleanup EXIT INT TERM
+
+# TcpExt 计数器（整机的，测试期间不要有别的监听套接字在溢出）
+tcpext() {
+    awk -v k="$1" '$1=="TcpExt:" { if (!h) { for (i = 2; i <= NF; i++) idx[$i] = i; h = 1 } else { print $idx[k]; exit } }' /proc/net/netstat
+}
+
+cp "$BIN_PATH" "$TMP_DIR/zaver"
+
+rm -f "$LOG_FILE"
+if ss -ltn 2>/dev/null | grep -qE "[:.]${PORT}\\b"; then
+    echo -e "${RED}Error: port $PORT is already in use${NC}"
+    exit 1
+fi
+setsid "$TMP_DIR/zaver" -c "$CONF_PATH" >"$LOG_FILE" 2>&1 &
+SERVER_PID=$!
+for _ in $(seq 1 50); do
+    CODE=$(curl --max-time 1 -o /dev/null -s -w "%{http_code}" "http://127.0.0.1:${PORT}/index.html" || true)
+    [[ "$CODE" != "000" ]] && break
+    sleep 0.1
+done
+echo "Old master PID $SERVER_PID"
+
+DROPS0=$(tcpext ListenDrops)
+OVERFLOWS0=$(tcpext ListenOverflows)
+
+# 每个请求一个新连接，才能覆盖到 accept 队列
+END=$(( $(date +%s) + LOAD_SEC ))
+for c in $(seq 1 "$CLIENTS"); do
+    (
+        while [[ $(date +%s) -lt $END ]]; do
+            curl --max-time 3 -o /dev/null -s -w "%{http_code}\n" -H "Connection: close" "http://127.0.0.1:${PORT}/index.html" || true
+        done
+    ) >"$TMP_DIR/codes.$c" &
+    LOAD_PIDS+=("$!")
+done
+
+sleep 2
+# 原子替换磁盘上的二进制，再让 master 去 exec 它
+cp "$NEW_BIN" "$TMP_DIR/zaver.new"
+mv -f "$TMP_DIR/zaver.new" "$TMP_DIR/zaver"
+echo "SIGUSR2 -> $SERVER_PID"
+kill -USR2 "$SERVER_PID"
+
+for p in "${LOAD_PIDS[@]}"; do
+    wait "$p" || true
+done
+LOAD_PIDS=()
+
+RESULT=0
+DONE=0
+for _ in $(seq 1 300); do
+    if grep -q "binary upgrade done" "$LOG_FILE"; then
+        DONE=1
+        break
+    fi
+    sleep 0.1
+done
+NEW_PID=$(grep -oE "new master pid=[0-9]+" "$LOG_FILE" | tail -n 1 | cut -d= -f2 || true)
+
+DROPS=$(( $(tcpext ListenDrops) - DROPS0 ))
+OVERFLOWS=$(( $(tcpext ListenOverflows) - OVERFLOWS0 ))
+TOTAL=$(cat "$TMP_DIR"/codes.* | wc -l)
+FAILED=$(cat "$TMP_DIR"/codes.* | grep -vc '^200$' || true)
+
+echo "Requests: $TOTAL, failed: $FAILED, ListenDrops: $DROPS, ListenOverflows: $OVERFLOWS"
+
+if [[ "$DONE" -ne 1 || -z "${NEW_PID:-}" ]]; then
+    echo -e "${RED}FAILED: old master did not hand over${NC}"
+    RESULT=1
+elif kill -0 "$SERVER_PID" 2>/dev/null && [[ "$(ps -o stat= -p "$SERVER_PID" | tr -d ' ')" != Z* ]]; then
+    echo -e "${RED}FAILED: old master $SERVER_PID still running${NC}"
+    RESULT=1
+elif [[ $(pgrep -P "$NEW_PID" | wc -l) -lt 1 ]]; then
+    echo -e "${RED}FAILED: new master $NEW_PID has no workers${NC}"
+    RESULT=1
+fi
+HTTP_CODE=$(curl --max-time 3 -o /dev/null -s -w "%{http_code}" "http://127.0.0.1:${PORT}/index.html" || true)
+if [[ "$HTTP_CODE" -ne 200 ]]; then
+    echo -e "${RED}FAILED: new generation not serving (got $HTTP_CODE)${NC}"
+    RESULT=1
+fi
+if [[ "$FAILED" -ne 0 || "$DROPS" -ne 0 || "$OVERFLOWS" -ne 0 ]]; then
+    echo -e "${RED}FAILED: connections lost during the swap${NC}"
+    RESULT=1
+fi
+
+# 新 master 启动慢的时候，旧 master 照样回收、重启 worker：换上先睡 3 秒的包装脚本再升级一次，期间杀掉一个 worker
+if [[ "$RESULT" -eq 0 ]]; then
+    echo "Slow-starting new binary: kill a worker of $NEW_PID while the upgrade is pending (expect it respawned)"
+    WORKERS=$(pgrep -P "$NEW_PID" | wc -l)
+    VICTIM=$(pgrep -P "$NEW_PID" | head -n 1)
+    cp "$NEW_BIN" "$TMP_DIR/zaver.real"
+    printf '#!/bin/sh\nsleep 3\nexec "%s" "$@"\n' "$TMP_DIR/zaver.real" >"$TMP_DIR/zaver.new"
+    chmod +x "$TMP_DIR/zaver.new"
+    mv -f "$TMP_DIR/zaver.new" "$TMP_DIR/zaver"
+    kill -USR2 "$NEW_PID"
+    sleep 0.5
+    kill -KILL "$VICTIM"
+    RESPAWNED=0
+    for _ in $(seq 1 15); do
+        # 重启回来的 worker 加上还在启动的新 master
+        if [[ $(pgrep -P "$NEW_PID" | grep -vxc "$VICTIM" || true) -eq $(( WORKERS + 1 )) ]]; then
+            RESPAWNED=1
+            break
+        fi
+        sleep 0.1
+    done
+    if [[ "$RESPAWNED" -ne 1 ]]; then
+        echo -e "${RED}FAILED: worker not respawned while the upgrade was pending${NC}"
+        RESULT=1
+    fi
+    DONE=0
+    for _ in $(seq 1 300); do
+        if [[ $(grep -c "binary upgrade done" "$LOG_FILE" || true) -ge 2 ]]; then
+            DONE=1
+            break
+        fi
+        sleep 0.1
+    done
+    HTTP_CODE=$(curl --max-time 3 -o /dev/null -s -w "%{http_code}" "http://127.0.0.1:${PORT}/index.html" || true)
+    if [[ "$DONE" -ne 1 || "$HTTP_CODE" -ne 200 ]]; then
+        echo -e "${RED}FAILED: slow-starting upgrade did not complete (got $HTTP_CODE)${NC}"
+        RESULT=1
+    fi
+    NEW_PID=$(grep -oE "new master pid=[0-9]+" "$LOG_FILE" | tail -n 1 | cut -d= -f2 || true)
+fi
+
+if [[ "$RESULT" -eq 0 ]]; then
+    echo -e "${GREEN}Binary upgrade test passed (new master PID $NEW_PID).${NC}"
+else
+    echo "--- server log (tail) ---"
+    tail -n 50 "$LOG_FILE" || true
+fi
+exit $RESULT